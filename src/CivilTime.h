@@ -0,0 +1,88 @@
+/******************************************************************************
+CivilTime
+Conversion between Unix time and UTC calendar date/time for Kestrel
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Days-from-civil and civil-from-days on the proleptic Gregorian calendar, after
+Howard Hinnant's public domain algorithms. Pure integer math, constexpr, no
+environment or time zone access and no allocation, so it is safe from any
+context and costs nothing when the input is known at compile time. The
+date/time templates work on any struct with int year, month, day, hour,
+minute, second fields (ie dateTimeStruct) and convert in a single pass.
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#ifndef CivilTime_h
+#define CivilTime_h
+
+#include <stdint.h>
+#include <time.h>
+
+namespace CivilTime {
+    struct Date {
+        int year;
+        int month; ///<1-12
+        int day; ///<1-31
+    };
+
+    constexpr int32_t daysFromCivil(int year, int month, int day) //Days since 1970-01-01, negative before
+    {
+        year -= (month <= 2); //Count years from March so the leap day is last
+        int32_t era = (year >= 0 ? year : year - 399)/400;
+        int32_t yearOfEra = year - era*400; //[0, 399]
+        int32_t dayOfYear = (153*(month > 2 ? month - 3 : month + 9) + 2)/5 + day - 1; //[0, 365]
+        int32_t dayOfEra = yearOfEra*365 + yearOfEra/4 - yearOfEra/100 + dayOfYear; //[0, 146096]
+        return era*146097 + dayOfEra - 719468; //719468 days from 0000-03-01 to 1970-01-01
+    }
+
+    constexpr Date civilFromDays(int32_t days)
+    {
+        days += 719468;
+        int32_t era = (days >= 0 ? days : days - 146096)/146097;
+        int32_t dayOfEra = days - era*146097;
+        int32_t yearOfEra = (dayOfEra - dayOfEra/1460 + dayOfEra/36524 - dayOfEra/146096)/365;
+        int32_t dayOfYear = dayOfEra - (365*yearOfEra + yearOfEra/4 - yearOfEra/100);
+        int32_t monthFromMarch = (5*dayOfYear + 2)/153; //[0, 11]
+        int month = monthFromMarch < 10 ? monthFromMarch + 3 : monthFromMarch - 9;
+        return Date{(int)(yearOfEra + era*400 + (month <= 2)), month, (int)(dayOfYear - (153*monthFromMarch + 2)/5 + 1)};
+    }
+
+    constexpr time_t toUnix(int year, int month, int day, int hour, int minute, int second)
+    {
+        return (time_t)daysFromCivil(year, month, day)*86400 + hour*3600 + minute*60 + second;
+    }
+
+    template <typename DateTime>
+    constexpr time_t toUnix(const DateTime &dateTime)
+    {
+        return toUnix(dateTime.year, dateTime.month, dateTime.day, dateTime.hour, dateTime.minute, dateTime.second);
+    }
+
+    template <typename DateTime>
+    constexpr void fromUnix(time_t time, DateTime &dateTime) //Leaves any other fields (ie source) untouched
+    {
+        int32_t days = time/86400;
+        int32_t seconds = time - (time_t)days*86400;
+        if(seconds < 0) { //Round toward earlier day for times before 1970
+            days--;
+            seconds += 86400;
+        }
+        Date date = civilFromDays(days);
+        dateTime.year = date.year;
+        dateTime.month = date.month;
+        dateTime.day = date.day;
+        dateTime.hour = seconds/3600;
+        dateTime.minute = (seconds/60) % 60;
+        dateTime.second = seconds % 60;
+    }
+
+    static_assert(daysFromCivil(1970, 1, 1) == 0, "Epoch");
+    static_assert(daysFromCivil(2000, 3, 1) == 11017, "Leap day of a 400 year century");
+    static_assert(civilFromDays(11016).day == 29, "2000-02-29");
+    static_assert(toUnix(2038, 1, 19, 3, 14, 7) == 2147483647L, "Largest 32 bit time");
+}
+
+#endif
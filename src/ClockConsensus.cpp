@@ -0,0 +1,85 @@
+/******************************************************************************
+ClockConsensus
+Picks the best agreeing set of time sources for Kestrel time sync
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#include "ClockConsensus.h"
+
+bool ClockConsensus::add(uint8_t id, time_t time, time_t uncertainty, uint8_t weight)
+{
+    if(uncertainty < 0) uncertainty = -uncertainty;
+    if(count >= MAX_SOURCES || id >= 32 || uncertainty == 0) return false; //An interval with no width overlaps nothing
+    sources[count].id = id;
+    sources[count].time = time;
+    sources[count].uncertainty = uncertainty;
+    sources[count].weight = weight;
+    count++;
+    return true;
+}
+
+ClockConsensusResult ClockConsensus::resolve(uint8_t required)
+{
+    ClockConsensusResult result;
+    if(count == 0) return result;
+    Edge edges[2*MAX_SOURCES];
+    uint8_t numEdges = 0;
+    for(uint8_t i = 0; i < count; i++) {
+        edges[numEdges++] = {sources[i].time - sources[i].uncertainty, true, i};
+        edges[numEdges++] = {sources[i].time + sources[i].uncertainty, false, i};
+    }
+    for(uint8_t i = 1; i < numEdges; i++) { //Insertion sort, ends before starts at the same value so touching intervals do not agree
+        Edge edge = edges[i];
+        int j = i - 1;
+        while(j >= 0 && (edges[j].value > edge.value || (edges[j].value == edge.value && edges[j].start && !edge.start))) {
+            edges[j + 1] = edges[j];
+            j--;
+        }
+        edges[j + 1] = edge;
+    }
+
+    int weight = 0;
+    int bestWeight = -1;
+    uint8_t bestPrimary = ClockConsensusResult::NONE;
+    for(uint8_t i = 0; i + 1 < numEdges; i++) {
+        weight += edges[i].start ? sources[edges[i].source].weight : -sources[edges[i].source].weight;
+        if(!edges[i].start || edges[i + 1].start) continue; //Overlap peaks just before an end, only those regions are candidates
+        if(weight < bestWeight) continue;
+        time_t low = edges[i].value;
+        time_t high = edges[i + 1].value;
+        uint8_t primary = ClockConsensusResult::NONE;
+        bool covered = (required == ClockConsensusResult::NONE);
+        for(uint8_t s = 0; s < count; s++) { //Find highest priority source covering region, for tie break and required source
+            if(sources[s].time - sources[s].uncertainty > low || sources[s].time + sources[s].uncertainty < high) continue;
+            if(sources[s].id < primary) primary = sources[s].id;
+            if(sources[s].id == required) covered = true;
+        }
+        if(!covered) continue;
+        if(weight == bestWeight && primary >= bestPrimary) continue;
+        bestWeight = weight;
+        bestPrimary = primary;
+        result.low = low;
+        result.high = high;
+    }
+
+    if(bestWeight < 0) return result; //Required source was not registered
+    result.valid = true;
+    result.weight = bestWeight;
+    for(uint8_t s = 0; s < count; s++) { //Collect members of the chosen region
+        const Source &source = sources[s];
+        if(source.time - source.uncertainty > result.low || source.time + source.uncertainty < result.high) continue;
+        result.members++;
+        result.memberMask |= (1UL << source.id);
+        if(source.id < result.primary) {
+            result.secondary = result.primary;
+            result.primary = source.id;
+            result.time = source.time;
+        }
+        else if(source.id < result.secondary) result.secondary = source.id;
+    }
+    return result;
+}
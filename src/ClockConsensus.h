@@ -0,0 +1,65 @@
+/******************************************************************************
+ClockConsensus
+Picks the best agreeing set of time sources for Kestrel time sync
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Each source reports a time and an uncertainty, which makes it the interval
+[time - uncertainty, time + uncertainty]. resolve() sweeps the sorted interval
+ends (Marzullo's algorithm) to find the region covered by the greatest total
+source weight. Intervals must overlap to agree, touching ends do not, so two
+sources of uncertainty u agree when they are less than 2u apart. Equal weight
+is settled in favour of the region holding the lowest source id, so ids double
+as priority (TimeSource numbering). A required source restricts the search to
+regions it covers. Sources are kept in a fixed table, no heap allocation.
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#ifndef ClockConsensus_h
+#define ClockConsensus_h
+
+#include <stdint.h>
+#include <time.h>
+
+struct ClockConsensusResult {
+    static constexpr uint8_t NONE = 0xFF;
+    bool valid = false; ///<At least one source was registered
+    time_t time = 0; ///<Highest priority member's own time
+    time_t low = 0; ///<Confidence interval, every member puts the time in [low, high]
+    time_t high = 0;
+    uint16_t weight = 0; ///<Summed weight of members
+    uint8_t members = 0; ///<Number of agreeing sources
+    uint32_t memberMask = 0; ///<Bit n set if source id n agrees
+    uint8_t primary = NONE; ///<Lowest id in the agreeing set
+    uint8_t secondary = NONE; ///<Next lowest id, NONE if only one member
+};
+
+class ClockConsensus
+{
+    public:
+        static constexpr uint8_t MAX_SOURCES = 8;
+        void clear() {
+            count = 0;
+        }
+        bool add(uint8_t id, time_t time, time_t uncertainty, uint8_t weight = 1); //Id 0-31, lower id is higher priority, uncertainty at least 1. Returns false if table is full
+        ClockConsensusResult resolve(uint8_t required = ClockConsensusResult::NONE); //Best region covered by source id required, if given
+
+    private:
+        struct Source {
+            uint8_t id;
+            time_t time;
+            time_t uncertainty;
+            uint8_t weight;
+        };
+        struct Edge {
+            time_t value;
+            bool start;
+            uint8_t source; ///<Index into sources
+        };
+        Source sources[MAX_SOURCES];
+        uint8_t count = 0;
+};
+
+#endif
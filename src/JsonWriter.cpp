@@ -0,0 +1,552 @@
+/******************************************************************************
+JsonWriter
+Streaming JSON writer for Kestrel reports
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#include "JsonWriter.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+namespace Cbor {
+    constexpr uint8_t UINT = 0;
+    constexpr uint8_t NEGINT = 1;
+    constexpr uint8_t BYTES = 2;
+    constexpr uint8_t TEXT = 3;
+    constexpr uint8_t ARRAY = 4;
+    constexpr uint8_t MAP = 5;
+    constexpr uint8_t TAG = 6;
+    constexpr uint8_t SIMPLE = 7;
+    constexpr uint8_t INDEFINITE = 31;
+    constexpr uint8_t BREAK = 0xFF;
+    constexpr uint8_t TAG_DECIMAL = 4; //Decimal fraction [exponent, mantissa]
+    constexpr uint8_t TAG_BASE16 = 22; //Byte string expected to be shown as hex
+    constexpr uint8_t SIMPLE_FALSE = 20;
+    constexpr uint8_t SIMPLE_TRUE = 21;
+    constexpr uint8_t SIMPLE_NULL = 22;
+};
+
+//Key table, index is the CBOR key. Only ever append and bump ReportFormat::CBOR_SCHEMA, older reports still decode against the longer table
+//Keys seen every diagnostic cycle sit below 24 so they encode as a single byte
+const char* const JsonWriter::keyTable[] = {
+    "Kestrel", "KESTREL", "CODES", "OW", "NUM", "Pos", "PORT_V", "PORT_I", "AVG_P", "LAST_CLR", "ALS", "RH",
+    "ACCEL", "SIV", "FIX", "Temperature", "Free Mem", "Time Fix", "Time Source", "Times", "LOCAL", "Last Sync", "OB", "Talon",
+    "I2C", "TTFF", "Accel_Offset", "RTC_Config", "GPS", "CELL", "GPS_RTC", "RTC", "INC",
+    "Clear", "Red", "Green", "Blue", "IR", "RTC UUID", "Model", "Hardware", "Firmware",
+    "Seq", "Keyframe", //Schema v2
+    "CNT", "FIRST", "LAST", //Schema v3
+    "RST", //Schema v4
+    "WH_DAY" //Schema v5
+};
+const uint8_t JsonWriter::KEY_TABLE_SIZE = sizeof(JsonWriter::keyTable)/sizeof(JsonWriter::keyTable[0]);
+
+JsonWriter::JsonWriter(char *buffer, size_t size, uint8_t format) : buf(buffer), cap(size), format(format)
+{
+    if(format == ReportFormat::CBOR_BASE64) { //Written as plain CBOR until finish()
+        this->format = ReportFormat::CBOR;
+        armor = true;
+    }
+    reset();
+}
+
+void JsonWriter::reset()
+{
+    len = 0;
+    full = false;
+    depth = 0;
+    afterKey = false;
+    armored = false;
+    for(int i = 0; i <= MAX_DEPTH; i++) hasElement[i] = false;
+    if(cap > 0) buf[0] = '\0';
+    if(format == ReportFormat::CBOR) cborHead(Cbor::UINT, ReportFormat::CBOR_SCHEMA); //Sequence always leads with schema version
+}
+
+JsonWriter& JsonWriter::finish()
+{
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    if(!armor || armored || full) return *this;
+    size_t groups = (len + 2)/3;
+    if(4*groups + 1 > cap) { //Armor is 4/3 the size, no room left to convert in place
+        full = true;
+        return *this;
+    }
+    //Work from the last group back, each output group starts at or after its input so nothing is overwritten before it is read
+    size_t binLength = len;
+    for(size_t g = groups; g-- > 0;) {
+        uint8_t in[3] = {0, 0, 0};
+        size_t count = binLength - 3*g < 3 ? binLength - 3*g : 3;
+        for(size_t i = 0; i < count; i++) in[i] = (uint8_t)buf[3*g + i];
+        char *out = &buf[4*g];
+        out[0] = alphabet[in[0] >> 2];
+        out[1] = alphabet[((in[0] & 0x03) << 4) | (in[1] >> 4)];
+        out[2] = count > 1 ? alphabet[((in[1] & 0x0F) << 2) | (in[2] >> 6)] : '=';
+        out[3] = count > 2 ? alphabet[in[2] & 0x3F] : '=';
+    }
+    len = 4*groups;
+    buf[len] = '\0';
+    armored = true;
+    return *this;
+}
+
+size_t JsonWriter::fromBase64(const char *text, size_t length, uint8_t *data, size_t size)
+{
+    if(length % 4 != 0) return 0;
+    size_t out = 0;
+    for(size_t g = 0; g < length; g += 4) {
+        uint32_t bits = 0;
+        uint8_t pad = 0;
+        for(int i = 0; i < 4; i++) {
+            char c = text[g + i];
+            uint8_t val = 0;
+            if(c >= 'A' && c <= 'Z') val = c - 'A';
+            else if(c >= 'a' && c <= 'z') val = c - 'a' + 26;
+            else if(c >= '0' && c <= '9') val = c - '0' + 52;
+            else if(c == '+') val = 62;
+            else if(c == '/') val = 63;
+            else if(c == '=' && i >= 2 && g + 4 == length) pad++; //Padding only at the very end
+            else return 0;
+            if(pad > 0 && c != '=') return 0; //Nothing after padding starts
+            bits = (bits << 6) | val;
+        }
+        for(int i = 0; i < 3 - pad; i++) {
+            if(out >= size) return 0;
+            data[out++] = (bits >> (16 - 8*i)) & 0xFF;
+        }
+    }
+    return out;
+}
+
+void JsonWriter::discard()
+{
+    len = 0;
+    if(cap > 0) buf[0] = '\0';
+}
+
+void JsonWriter::append(char c)
+{
+    if(len + 1 >= cap) { //Always leave room for terminator
+        full = true;
+        return;
+    }
+    buf[len++] = c;
+    buf[len] = '\0';
+}
+
+void JsonWriter::append(const char *text)
+{
+    while(*text != '\0' && !full) append(*text++);
+}
+
+void JsonWriter::separator()
+{
+    if(format != ReportFormat::JSON) return; //CBOR items are self delimiting
+    if(afterKey) { //Value belongs to the key just written
+        afterKey = false;
+        return;
+    }
+    if(hasElement[depth]) append(',');
+    hasElement[depth] = true;
+}
+
+void JsonWriter::cborHead(uint8_t major, uint64_t val)
+{
+    uint8_t bytes = 0;
+    if(val < 24) {
+        append((char)((major << 5) | val));
+        return;
+    }
+    else if(val <= 0xFF) {
+        append((char)((major << 5) | 24));
+        bytes = 1;
+    }
+    else if(val <= 0xFFFF) {
+        append((char)((major << 5) | 25));
+        bytes = 2;
+    }
+    else if(val <= 0xFFFFFFFF) {
+        append((char)((major << 5) | 26));
+        bytes = 4;
+    }
+    else {
+        append((char)((major << 5) | 27));
+        bytes = 8;
+    }
+    for(int i = bytes - 1; i >= 0; i--) append((char)(val >> (8*i))); //Big endian argument
+}
+
+void JsonWriter::cborInt(int64_t val)
+{
+    if(val >= 0) cborHead(Cbor::UINT, val);
+    else cborHead(Cbor::NEGINT, -1 - val);
+}
+
+void JsonWriter::cborString(uint8_t major, const uint8_t *data, size_t length)
+{
+    cborHead(major, length);
+    for(size_t i = 0; i < length; i++) append((char)data[i]);
+}
+
+JsonWriter& JsonWriter::key(const char *name)
+{
+    if(format == ReportFormat::CBOR) {
+        for(uint8_t i = 0; i < KEY_TABLE_SIZE; i++) {
+            if(strcmp(name, keyTable[i]) == 0) {
+                cborHead(Cbor::UINT, i); //Known key, send index only
+                return *this;
+            }
+        }
+        cborString(Cbor::TEXT, (const uint8_t*)name, strlen(name)); //Unknown key, send in full
+        return *this;
+    }
+    separator();
+    append('"');
+    append(name);
+    append("\":");
+    afterKey = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::beginObject(const char *name)
+{
+    if(name != nullptr) key(name);
+    separator();
+    if(format == ReportFormat::CBOR) append((char)((Cbor::MAP << 5) | Cbor::INDEFINITE));
+    else append('{');
+    if(depth < MAX_DEPTH) depth++;
+    hasElement[depth] = false;
+    return *this;
+}
+
+JsonWriter& JsonWriter::endObject()
+{
+    if(format == ReportFormat::CBOR) append((char)Cbor::BREAK);
+    else append('}');
+    if(depth > 0) depth--;
+    return *this;
+}
+
+JsonWriter& JsonWriter::beginArray(const char *name)
+{
+    if(name != nullptr) key(name);
+    separator();
+    if(format == ReportFormat::CBOR) append((char)((Cbor::ARRAY << 5) | Cbor::INDEFINITE));
+    else append('[');
+    if(depth < MAX_DEPTH) depth++;
+    hasElement[depth] = false;
+    return *this;
+}
+
+JsonWriter& JsonWriter::endArray()
+{
+    if(format == ReportFormat::CBOR) append((char)Cbor::BREAK);
+    else append(']');
+    if(depth > 0) depth--;
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(const char *str)
+{
+    if(format == ReportFormat::CBOR) {
+        cborString(Cbor::TEXT, (const uint8_t*)str, strlen(str));
+        return *this;
+    }
+    separator();
+    append('"');
+    append(str);
+    append('"');
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(long val)
+{
+    if(format == ReportFormat::CBOR) {
+        cborInt(val);
+        return *this;
+    }
+    char temp[12];
+    snprintf(temp, sizeof(temp), "%ld", val);
+    return raw(temp);
+}
+
+JsonWriter& JsonWriter::value(unsigned long val)
+{
+    if(format == ReportFormat::CBOR) {
+        cborHead(Cbor::UINT, val);
+        return *this;
+    }
+    char temp[12];
+    snprintf(temp, sizeof(temp), "%lu", val);
+    return raw(temp);
+}
+
+JsonWriter& JsonWriter::value(float val, uint8_t decimals)
+{
+    if(isnan(val) || isinf(val)) return null(); //Not representable in JSON
+    if(format == ReportFormat::CBOR) {
+        double scaled = (double)val;
+        for(int i = 0; i < decimals; i++) scaled = scaled*10.0;
+        if(fabs(scaled) >= 9.0e18) return null(); //Outside fixed point range
+        return fixed(llround(scaled), decimals);
+    }
+    char temp[24];
+    snprintf(temp, sizeof(temp), "%.*f", decimals, val);
+    if(temp[0] == '-' && strspn(&temp[1], "0.") == strlen(&temp[1])) return raw(&temp[1]); //Rounded to zero, drop the sign so -0.001 reads 0.00 as in CBOR
+    return raw(temp);
+}
+
+JsonWriter& JsonWriter::value(bool val)
+{
+    if(format == ReportFormat::CBOR) {
+        cborInt(val ? 1 : 0); //Keep numeric so decode gives the same flag
+        return *this;
+    }
+    return raw(val ? "1" : "0"); //Reports use numeric flags (ie "OW":1)
+}
+
+JsonWriter& JsonWriter::fixed(int64_t mantissa, uint8_t decimals)
+{
+    if(format == ReportFormat::CBOR) {
+        if(decimals == 0) cborInt(mantissa);
+        else {
+            cborHead(Cbor::TAG, Cbor::TAG_DECIMAL);
+            cborHead(Cbor::ARRAY, 2);
+            cborInt(-(int64_t)decimals); //Exponent
+            cborInt(mantissa);
+        }
+        return *this;
+    }
+    char temp[24]; //Built from the back, up to 20 digits + sign + point + terminator
+    int pos = sizeof(temp) - 1;
+    temp[pos] = '\0';
+    uint64_t mag = mantissa < 0 ? (uint64_t)(-(mantissa + 1)) + 1 : (uint64_t)mantissa;
+    int digits = 0;
+    do {
+        if(digits == decimals && decimals > 0) temp[--pos] = '.';
+        temp[--pos] = '0' + (mag % 10);
+        mag = mag/10;
+        digits++;
+    } while((mag > 0 || digits <= decimals) && pos > 2);
+    if(mantissa < 0) temp[--pos] = '-';
+    return raw(&temp[pos]);
+}
+
+JsonWriter& JsonWriter::hex(uint32_t val)
+{
+    if(format == ReportFormat::CBOR) {
+        uint8_t bytes[4];
+        uint8_t count = 0;
+        for(int i = 3; i >= 0; i--) {
+            uint8_t b = (val >> (8*i)) & 0xFF;
+            if(b != 0 || count > 0 || i == 0) bytes[count++] = b; //Drop leading zero bytes
+        }
+        cborHead(Cbor::TAG, Cbor::TAG_BASE16);
+        cborString(Cbor::BYTES, bytes, count);
+        return *this;
+    }
+    char temp[14];
+    snprintf(temp, sizeof(temp), "\"0x%lx\"", (unsigned long)val);
+    return raw(temp);
+}
+
+JsonWriter& JsonWriter::bitmap(const uint8_t *bits, uint16_t numBits)
+{
+    if(format == ReportFormat::CBOR) {
+        cborString(Cbor::BYTES, bits, (numBits + 7)/8);
+        return *this;
+    }
+    beginArray();
+    for(uint16_t i = 0; i < numBits; i++) {
+        if(bits[i/8] & (1 << (i % 8))) value((unsigned int)i);
+    }
+    return endArray();
+}
+
+JsonWriter& JsonWriter::null()
+{
+    if(format == ReportFormat::CBOR) {
+        append((char)((Cbor::SIMPLE << 5) | Cbor::SIMPLE_NULL));
+        return *this;
+    }
+    return raw("null");
+}
+
+JsonWriter& JsonWriter::raw(const char *text)
+{
+    if(format == ReportFormat::CBOR) return value(text); //No CBOR equivalent, keep the text
+    separator();
+    append(text);
+    return *this;
+}
+
+namespace {
+    struct CborReader {
+        const uint8_t *data;
+        size_t length;
+        size_t pos;
+        bool ok;
+        uint8_t major;
+        uint8_t info;
+        uint64_t arg;
+
+        bool atBreak() {
+            return pos < length && data[pos] == Cbor::BREAK;
+        }
+
+        bool readHead() {
+            if(!ok || pos >= length) return ok = false;
+            major = data[pos] >> 5;
+            info = data[pos] & 0x1F;
+            pos++;
+            arg = info;
+            if(info < 24 || info == Cbor::INDEFINITE) return true;
+            if(info > 27) return ok = false; //Reserved
+            uint8_t bytes = 1 << (info - 24);
+            if(pos + bytes > length) return ok = false;
+            arg = 0;
+            for(int i = 0; i < bytes; i++) arg = (arg << 8) | data[pos++];
+            return true;
+        }
+
+        bool readInt(int64_t &val) {
+            if(!readHead()) return false;
+            if(major == Cbor::UINT) val = arg;
+            else if(major == Cbor::NEGINT) val = -1 - (int64_t)arg;
+            else return ok = false;
+            return true;
+        }
+
+        const uint8_t* readBytes(uint8_t expectMajor) { //Read definite length string, length left in arg
+            if(!readHead() || major != expectMajor || info == Cbor::INDEFINITE || arg > length - pos) {
+                ok = false;
+                return nullptr;
+            }
+            const uint8_t *start = &data[pos];
+            pos += arg;
+            return start;
+        }
+    };
+}
+
+size_t JsonWriter::decode(const uint8_t *data, size_t length, char *buffer, size_t size)
+{
+    struct Decoder { //Recursive helpers, local since they only make sense against the schema above
+        static void text(JsonWriter &out, const uint8_t *str, size_t length, bool isKey) {
+            out.separator();
+            out.append('"');
+            for(size_t i = 0; i < length; i++) out.append((char)str[i]);
+            out.append(isKey ? "\":" : "\"");
+            if(isKey) out.afterKey = true;
+        }
+
+        static void key(CborReader &in, JsonWriter &out) {
+            size_t start = in.pos;
+            if(!in.readHead()) return;
+            if(in.major == Cbor::UINT && in.arg < KEY_TABLE_SIZE) out.key(keyTable[in.arg]);
+            else if(in.major == Cbor::TEXT) {
+                in.pos = start; //Re-read as string
+                const uint8_t *str = in.readBytes(Cbor::TEXT);
+                if(str != nullptr) text(out, str, in.arg, true);
+            }
+            else in.ok = false;
+        }
+
+        static void item(CborReader &in, JsonWriter &out, uint8_t depth) {
+            if(depth > MAX_DEPTH) {
+                in.ok = false;
+                return;
+            }
+            size_t start = in.pos;
+            if(!in.readHead()) return;
+            switch(in.major) {
+                case Cbor::UINT:
+                case Cbor::NEGINT: {
+                    in.pos = start;
+                    int64_t val = 0;
+                    if(in.readInt(val)) out.fixed(val, 0);
+                    break;
+                }
+                case Cbor::BYTES: { //Only bitmaps are sent untagged
+                    in.pos = start;
+                    const uint8_t *bits = in.readBytes(Cbor::BYTES);
+                    if(bits != nullptr) out.bitmap(bits, in.arg*8);
+                    break;
+                }
+                case Cbor::TEXT: {
+                    in.pos = start;
+                    const uint8_t *str = in.readBytes(Cbor::TEXT);
+                    if(str != nullptr) text(out, str, in.arg, false);
+                    break;
+                }
+                case Cbor::ARRAY: {
+                    bool indefinite = (in.info == Cbor::INDEFINITE);
+                    uint64_t count = in.arg;
+                    out.beginArray();
+                    for(uint64_t i = 0; in.ok && (indefinite ? !in.atBreak() : i < count); i++) item(in, out, depth + 1);
+                    if(indefinite && in.ok) in.pos++; //Consume break
+                    out.endArray();
+                    break;
+                }
+                case Cbor::MAP: {
+                    bool indefinite = (in.info == Cbor::INDEFINITE);
+                    uint64_t count = in.arg;
+                    out.beginObject();
+                    for(uint64_t i = 0; in.ok && (indefinite ? !in.atBreak() : i < count); i++) {
+                        key(in, out);
+                        item(in, out, depth + 1);
+                    }
+                    if(indefinite && in.ok) in.pos++; //Consume break
+                    out.endObject();
+                    break;
+                }
+                case Cbor::TAG: {
+                    if(in.arg == Cbor::TAG_DECIMAL) {
+                        int64_t exponent = 0;
+                        int64_t mantissa = 0;
+                        if(!in.readHead() || in.major != Cbor::ARRAY || in.arg != 2) in.ok = false;
+                        else if(in.readInt(exponent) && in.readInt(mantissa)) {
+                            if(exponent > 0 || exponent < -18) in.ok = false;
+                            else out.fixed(mantissa, -exponent);
+                        }
+                    }
+                    else if(in.arg == Cbor::TAG_BASE16) {
+                        const uint8_t *bytes = in.readBytes(Cbor::BYTES);
+                        if(bytes != nullptr && in.arg <= 4) {
+                            uint32_t val = 0;
+                            for(uint64_t i = 0; i < in.arg; i++) val = (val << 8) | bytes[i];
+                            out.hex(val);
+                        }
+                        else in.ok = false;
+                    }
+                    else in.ok = false; //Unknown tag
+                    break;
+                }
+                case Cbor::SIMPLE: {
+                    if(in.info == Cbor::SIMPLE_NULL) out.null();
+                    else if(in.info == Cbor::SIMPLE_FALSE) out.value(false);
+                    else if(in.info == Cbor::SIMPLE_TRUE) out.value(true);
+                    else in.ok = false;
+                    break;
+                }
+            }
+        }
+    };
+
+    JsonWriter out(buffer, size, ReportFormat::JSON);
+    CborReader in = {data, length, 0, true, 0, 0, 0};
+    int64_t schema = 0;
+    if(!in.readInt(schema) || schema < 1 || schema > ReportFormat::CBOR_SCHEMA) return 0; //Newer schemas may use keys this table does not have
+    while(in.ok && in.pos < length) { //Top level is a run of key/value pairs, same as the JSON report fragments
+        Decoder::key(in, out);
+        Decoder::item(in, out, 0);
+    }
+    if(!in.ok || out.overflow()) {
+        out.reset();
+        return 0;
+    }
+    return out.length();
+}
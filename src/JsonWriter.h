@@ -0,0 +1,107 @@
+/******************************************************************************
+JsonWriter
+Streaming JSON writer for Kestrel reports
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Writes JSON directly into a fixed, caller supplied buffer. No heap allocation,
+commas between elements are inserted automatically. Output matches the String
+concatenation it replaced, except that non-finite floats (which String printed
+as nan/inf, breaking the JSON) are written as null and values which round to
+zero are written without a sign (String printed -0.00). Anything that does not
+fit sets overflow() rather than truncating silently.
+
+The same calls can instead produce a compact CBOR (RFC 8949) encoding of the
+report. The binary form is a CBOR sequence: schema version, then the report
+key/value pairs. Known keys are replaced by small integers from the versioned
+key table, floats are sent as fixed point decimal fractions and bitmaps as
+byte strings. decode() converts the binary form back into the exact JSON the
+text mode would have produced, so it can be built on the backend as is.
+
+Raw CBOR contains NUL and other control bytes, so it can not be handed to
+Particle.publish, which takes a C string. CBOR_BASE64 writes the same encoding
+and finish() then armors it in place as base64 (RFC 4648), which is what gets
+published. fromBase64() undoes the armor ahead of decode().
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#ifndef JsonWriter_h
+#define JsonWriter_h
+
+#include <Particle.h>
+
+namespace ReportFormat {
+    constexpr uint8_t JSON = 0;
+    constexpr uint8_t CBOR = 1; //Binary, for storage or transports which take bytes
+    constexpr uint8_t CBOR_BASE64 = 2; //CBOR armored as base64 text by finish(), for Particle.publish
+    constexpr uint8_t CBOR_SCHEMA = 5; //Bump whenever the key table changes
+};
+
+class JsonWriter
+{
+    static constexpr uint8_t MAX_DEPTH = 8; ///<Maximum nesting of objects and arrays
+    public:
+        JsonWriter(char *buffer, size_t size, uint8_t format = ReportFormat::JSON);
+        JsonWriter& key(const char *name);
+        JsonWriter& beginObject(const char *name = nullptr);
+        JsonWriter& endObject();
+        JsonWriter& beginArray(const char *name = nullptr);
+        JsonWriter& endArray();
+        JsonWriter& value(const char *str); //Quoted string
+        JsonWriter& value(long val);
+        JsonWriter& value(unsigned long val);
+        JsonWriter& value(int val) {
+            return value((long)val);
+        }
+        JsonWriter& value(unsigned int val) {
+            return value((unsigned long)val);
+        }
+        JsonWriter& value(float val, uint8_t decimals = 2); //Matches String(float) formatting, non-finite values written as null
+        JsonWriter& value(bool val);
+        JsonWriter& fixed(int64_t mantissa, uint8_t decimals); //Exact fixed point value, mantissa*10^-decimals
+        JsonWriter& hex(uint32_t val); //Quoted "0x..." string, as used for error codes
+        JsonWriter& bitmap(const uint8_t *bits, uint16_t numBits); //JSON array of set bit indices, byte string in CBOR
+        JsonWriter& null();
+        JsonWriter& raw(const char *text); //Pre-formatted JSON value, JSON only
+        const char* c_str() {
+            return buf;
+        }
+        size_t length() {
+            return len;
+        }
+        bool overflow() { //True if anything was dropped because the buffer was full
+            return full;
+        }
+        bool exceeds(size_t limit) { //Check output against a transmission limit (ie MAX_MESSAGE_LENGTH)
+            return full || len > limit;
+        }
+        void reset();
+        JsonWriter& finish(); //Complete the report, armors CBOR_BASE64 output as text. Nothing may be written after
+        void discard(); //Drop everything written, leaving an empty buffer (no CBOR schema either)
+        static size_t decode(const uint8_t *data, size_t length, char *buffer, size_t size); //Convert CBOR report back to JSON, returns 0 if malformed
+        static size_t fromBase64(const char *text, size_t length, uint8_t *data, size_t size); //Remove CBOR_BASE64 armor, returns CBOR length or 0 if malformed
+
+    private:
+        char *buf;
+        size_t cap;
+        uint8_t format;
+        bool armor = false; ///<CBOR_BASE64 requested, converted to text by finish()
+        bool armored = false; ///<finish() already converted the buffer
+        size_t len = 0;
+        bool full = false;
+        uint8_t depth = 0;
+        bool hasElement[MAX_DEPTH + 1] = {false}; ///<Element already written at this depth, next one needs a comma
+        bool afterKey = false; ///<Key was just written, value follows without a comma
+        static const char* const keyTable[]; ///<CBOR integer key -> JSON key name, append only
+        static const uint8_t KEY_TABLE_SIZE;
+        void separator();
+        void append(const char *text);
+        void append(char c);
+        void cborHead(uint8_t major, uint64_t val);
+        void cborInt(int64_t val);
+        void cborString(uint8_t major, const uint8_t *data, size_t length);
+};
+
+#endif
@@ -18,18 +18,61 @@ Distributed as-is; no warranty is given.
 #include <Kestrel.h>
 
 Kestrel* Kestrel::selfPointer;
-
-Kestrel::Kestrel(bool useSensors) : ioOB(0x20), ioTalon(0x21), led(0x52), csaAlpha(2, 2, 2, 2, 0x18), csaBeta(2, 10, 10, 10, 0x14)
+char Kestrel::reportBuffer[Kestrel::REPORT_BUFFER_SIZE];
+char Kestrel::frameBuffer[Kestrel::MAX_MESSAGE_LENGTH + 1];
+retained ErrorLogStore Kestrel::errorStore; //Not cleared on reset, validated by loadErrorLog
+retained RtcTrimStore Kestrel::trimStore; //Not cleared on reset, validated by loadRtcTrim
+constexpr float Kestrel::CSA_ALPHA_SENSE[4];
+constexpr float Kestrel::CSA_BETA_SENSE[4];
+constexpr uint8_t Kestrel::INRUSH_CHANNEL[Kestrel::INRUSH_PORTS];
+uint8_t Kestrel::ubxBuffer[MAX_PAYLOAD_SIZE];
+const uint8_t Kestrel::ubxEmptyPayload[Kestrel::UBX_CACHE_PAYLOAD] = {0};
+
+Kestrel::Kestrel(bool useSensors) : ioOB(0x20), ioTalon(0x21), csaAlpha(CSA_ALPHA_SENSE[0], CSA_ALPHA_SENSE[1], CSA_ALPHA_SENSE[2], CSA_ALPHA_SENSE[3], 0x18), csaBeta(CSA_BETA_SENSE[0], CSA_BETA_SENSE[1], CSA_BETA_SENSE[2], CSA_BETA_SENSE[3], CSA_BETA_ADR), obShadow(0x20), talonShadow(0x21), led(0x52)
 {
 	// port = talonPort; //Copy to local
 	// version = hardwareVersion; //Copy to local
     // talonPort = 0x0F; //Set dummy Talon port for reporting
     reportSensors = useSensors;
     sensorInterface = BusType::CORE;
+    loadErrorLog(); //Recover errors thrown before a reset so the next report still carries them
+}
+
+I2CRoute::I2CRoute(Kestrel &logger, bool ob, bool global) : kestrel(logger)
+{
+    prevGlobal = kestrel.enableI2C_Global(global); //Disconnect external bus before connecting internal, pins already in place are skipped (nested guards cost nothing)
+    prevOB = kestrel.enableI2C_OB(ob);
+}
+
+I2CRoute::~I2CRoute()
+{
+    kestrel.enableI2C_Global(prevGlobal); //Return to previous state
+    kestrel.enableI2C_OB(prevOB);
+}
+
+ProfileScope::ProfileScope(Kestrel &logger, uint8_t op) : kestrel(logger), operation(op)
+{
+    startTime = millis();
+    startBusOps = kestrel.expanderOps + kestrel.routeWrites;
+}
+
+ProfileScope::~ProfileScope()
+{
+    OperationProfile &profile = kestrel.profiles[operation];
+    profile.calls++;
+    profile.lastDuration = millis() - startTime - excluded;
+    if(profile.lastDuration > profile.maxDuration) profile.maxDuration = profile.lastDuration;
+    profile.lastBusOps = (kestrel.expanderOps + kestrel.routeWrites) - startBusOps;
+}
+
+void ProfileScope::exclude(unsigned long duration)
+{
+    excluded += duration;
 }
 
 String Kestrel::begin(time_t time, bool &criticalFault, bool &fault)
 {
+    ProfileScope profile(*this, ProfileOp::BEGIN);
     selfPointer = this;
     System.on(time_changed, timechange_handler);
     System.on(out_of_memory, outOfMemoryHandler);
@@ -41,22 +84,26 @@ String Kestrel::begin(time_t time, bool &criticalFault, bool &fault)
         Wire.setClock(400000);
 	// #endif
     if(!initDone) throwError(SYSTEM_RESET | ((System.resetReason() << 8) & 0xFF00)); //Throw reset error with reason for reset as subtype. Truncate resetReason to one byte. This will include all predefined reasons, but will prevent issues if user returns some large (technically can be up to 32 bits) custom reset reason
-    bool globState = enableI2C_Global(false); //Turn off external I2C
-    bool obState = enableI2C_OB(true); //Turn on internal I2C
+    I2CRoute route(*this); //Turn off external I2C and turn on internal I2C until return
     if(ioOB.begin() != 0) criticalFault = true;
     if(ioTalon.begin() != 0) criticalFault = true;
     ioTalon.safeMode(PCAL9535A::SAFEOFF); //DEBUG! //Turn safe mode off to speed up turn-off times for Talons
+    obShadow.valid = false; //Expanders were just (re)initialized, reload shadow registers before next write
+    talonShadow.valid = false;
     enableAuxPower(true); //Turn on aux power 
     if(csaAlpha.begin() == false) { //If fails at default address, then try alt v1.9 address
         csaAlpha.setAddress(0x19);
+        csaAlphaAdr = 0x19;
         if(csaAlpha.begin()) boardVersion = HardwareVersion::MODEL_1v9; //If alt address works, board must be a v1.9
         //else THROW ERROR! FIX!
     }
     csaBeta.begin();
     csaAlpha.setFrequency(Frequency::SPS_64); //Set to ensure at least 24 hours between accumulator rollover 
+    for(int i = 0; i < OnboardSensor::COUNT; i++) sensors[i].ready = false; //Re-probe everything after a (re)start, CSAs were just reset above
+    energyBase[0].valid = false; //Accumulator contents unknown after begin, re-baseline
+    energyBase[1].valid = false;
     // delay(100); //DEBUG! For GPS
-    ioOB.pinMode(PinsOB::LED_EN, OUTPUT);
-	ioOB.digitalWrite(PinsOB::LED_EN, LOW); //Turn on LED indicators 
+    writeExpanderPin(obShadow, PinsOB::LED_EN, LOW); //Turn on LED indicators 
     led.begin();
     if(!initDone) { //Only set state if not done already
         led.setOutputMode(OpenDrain); //Set device to use open drain outputs
@@ -75,16 +122,10 @@ String Kestrel::begin(time_t time, bool &criticalFault, bool &fault)
         rtc.enableAlarm(false, 0); //Disable all alarms on startup //DEBUG! Use to prevent alarm 1 from ever being activated 
         rtc.enableAlarm(false, 1); 
         rtc.setMode(MCP79412::Mode::Normal); //Make sure to enforce normal mode
+        loadRtcTrim(); //Restore calibration if the RTC lost it
     }
     //Perform wakeup in case switched off already
-    Serial.println("Wake GPS"); //DEBUG!
-    ioOB.pinMode(PinsOB::GPS_INT, OUTPUT); //Turn GPS back on by toggling int pin
-    ioOB.digitalWrite(PinsOB::GPS_INT, LOW);
-    delay(1000);
-    ioOB.digitalWrite(PinsOB::GPS_INT, HIGH);
-    delay(1000);
-    ioOB.digitalWrite(PinsOB::GPS_INT, LOW);
-    delay(1000);
+    gpsEnsureAwake(); //Only pulses GPS_INT if receiver is not already responding
     if(gps.begin() == false) {
         criticalFault = true; //DEBUG! ??
         throwError(GPS_INIT_FAIL);
@@ -138,90 +179,239 @@ String Kestrel::begin(time_t time, bool &criticalFault, bool &fault)
     }
     // if(Particle.connected() == false) criticalFault = true; //If not connected to cell set critical error
     // if(criticalFault) setIndicatorState(IndicatorLight::STAT, IndicatorMode::ERROR_CRITICAL); //If there is a critical fault, set the stat light
-    for(int i = 1; i <= numTalonPorts; i++) {
-        enablePower(i, false); //Default all power to off
-        enableData(i, false); //Default all data to off
-    }
+    disablePowerAll(); //Default all power to off
+    disableDataAll(); //Default all data to off
     initDone = true;
     syncTime(true); //Force a time sync on startup 
     // Particle.syncTime(); //DEBUG!
     // ioOB.pinMode(PinsOB::)
-    enableI2C_Global(globState); //Return to previous state
-    enableI2C_OB(obState);
    
     return ""; //DEBUG!
 }
 
 String Kestrel::getErrors()
 {
-    // uint32_t temp[10] = {0}; //Temp array to store error vals read in from drivers
+    getErrors(reportBuffer, MAX_MESSAGE_LENGTH + 1); //Keep each error report to one transmission, the rest follow in the next
+    return String(reportBuffer);
+}
+
+size_t Kestrel::getErrors(char *buffer, size_t size)
+{
+    //Merge in rtc errors so they are deduplicated as well. The rtc driver keeps no times, so these are stamped with the time of this report
+    for(size_t i = 0; i < min(sizeof(rtc.errors)/sizeof(rtc.errors[0]), rtc.numErrors); i++) throwError(rtc.errors[i]);
+    if(rtc.numErrors > sizeof(rtc.errors)/sizeof(rtc.errors[0])) errorStore.dropped += rtc.numErrors - sizeof(rtc.errors)/sizeof(rtc.errors[0]); //Count anything the rtc driver overwrote as dropped
+    rtc.numErrors = 0;
+
+    JsonWriter json(buffer, size);
+    uint8_t count = errorStore.used;
+    writeErrorReport(json, count);
+    while(json.overflow() && count > 0) { //Report the oldest codes that fit, the rest stay logged for the next report
+        json.reset();
+        writeErrorReport(json, --count);
+    }
+    if(json.overflow()) return finishReport(json, ReportType::ERRORS); //Not even an empty report fits, keep the whole log
+    if(count < errorStore.used) {
+        releaseErrors(count);
+        throwError(REPORT_OVERFLOW | (ReportType::ERRORS << 8)); //Tell the backend the rest follow
+    }
+    else clearErrorLog(); //Clear errors as they are read
+    return json.length();
+}
 
-    String output = "\"KESTREL\":{"; // OPEN JSON BLOB
-	output = output + "\"CODES\":["; //Open codes pair
+void Kestrel::writeErrorReport(JsonWriter &json, uint8_t count)
+{
+    json.beginObject("KESTREL"); // OPEN JSON BLOB
+    json.beginArray("CODES"); //Open codes pair
+	for(int i = 0; i < count; i++) json.hex(errorStore.records[i].code); //Add each error code in order first seen
+	json.endArray(); //close codes pair
+	json.beginArray("CNT"); //Number of times each code was thrown
+	for(int i = 0; i < count; i++) json.value((unsigned int)errorStore.records[i].count);
+	json.endArray();
+	//Times are seconds before the report rather than UNIX times, a third the size. null if time was not valid when thrown or now
+	uint32_t now = Time.isValid() ? Time.now() : 0;
+	json.beginArray("FIRST"); //How long ago each code was first thrown
+	for(int i = 0; i < count; i++) writeErrorAge(json, errorStore.records[i].firstSeen, now);
+	json.endArray();
+	json.beginArray("LAST"); //How long ago each code was last thrown
+	for(int i = 0; i < count; i++) writeErrorAge(json, errorStore.records[i].lastSeen, now);
+	json.endArray();
+	json.key("OW").value(errorStore.dropped > 0); //Indicate if any codes were lost 
+	json.key("NUM").value((unsigned long)errorStore.thrown); //Append number of errors, repeats included
+	if(errorStore.resets > 0) json.key("RST").value((unsigned int)errorStore.resets); //Report carries errors from before a reset
+	json.endObject(); //CLOSE JSON BLOB
+}
 
-	for(int i = 0; i < min(MAX_NUM_ERRORS, numErrors); i++) { //Interate over used element of array without exceeding bounds
-		output = output + "\"0x" + String(errors[i], HEX) + "\","; //Add each error code
-		errors[i] = 0; //Clear errors as they are read
-	}
-    for(int i = 0; i < min(sizeof(rtc.errors), rtc.numErrors); i++) { //Interate rtc errors
-		output = output + "\"0x" + String(rtc.errors[i], HEX) + "\","; //Add each error code
-		rtc.errors[i] = 0; //Clear errors as they are read
-	}
-	if(output.substring(output.length() - 1).equals(",")) {
-		output = output.substring(0, output.length() - 1); //Trim trailing ','
-	}
-	output = output + "],"; //close codes pair
-	output =  output + "\"OW\":"; //Open state pair
-	if(numErrors > MAX_NUM_ERRORS || rtc.numErrors > sizeof(rtc.errors)) output = output + "1,"; //If overwritten, indicate the overwrite is true
-	else output = output + "0,"; //Otherwise set it as clear
-	output = output + "\"NUM\":" + String(numErrors + rtc.numErrors); //Append number of errors
-	// output = output + "\"Pos\":[" + String(talonPort + 1) + "," + String(sensorPort + 1) + "]"; //Concatonate position 
-	output = output + "}"; //CLOSE JSON BLOB
-	numErrors = 0; //Clear error count
-    rtc.numErrors = 0; 
-	return output;
+void Kestrel::writeErrorAge(JsonWriter &json, uint32_t seen, uint32_t now)
+{
+    if(seen == 0 || now == 0) json.null();
+    else json.value((unsigned long)(now > seen ? now - seen : 0)); //Clock may have been set back since
+}
+
+size_t Kestrel::finishReport(JsonWriter &json, uint8_t report)
+{
+    //A report that overflowed its buffer is cut mid value, never hand it out. Drop it and log why
+    json.finish(); //Armor CBOR_BASE64 reports so they can be published as text
+    if(!json.overflow()) return json.length();
+    json.discard();
+    throwError(REPORT_OVERFLOW | (report << 8));
+    return 0;
+}
+
+int Kestrel::throwError(uint32_t error)
+{
+    uint32_t now = Time.isValid() ? Time.now() : 0; //Keep to system time, may be called from system event handlers
+    errorStore.thrown++;
+    for(int i = 0; i < errorStore.used; i++) {
+        ErrorRecord &record = errorStore.records[i];
+        if(record.code == error) { //Repeat, count it in place so the order of first occurrence is kept
+            if(record.count < 0xFFFF) record.count++;
+            record.lastSeen = now;
+            sealErrorRecord(record);
+            errorStore.crc = errorLogCrc(errorStore);
+            return errorStore.thrown;
+        }
+    }
+    if(errorStore.used >= ErrorLogStore::SIZE) errorStore.dropped++; //Keep the oldest codes, they are usually the cause of what follows
+    else {
+        ErrorRecord &record = errorStore.records[errorStore.used];
+        record.code = error;
+        record.count = 1;
+        record.firstSeen = now;
+        record.lastSeen = now;
+        sealErrorRecord(record);
+        errorStore.used++;
+    }
+    errorStore.crc = errorLogCrc(errorStore);
+    return errorStore.thrown;
+}
+
+void Kestrel::loadErrorLog()
+{
+    if(errorStore.magic != ErrorLogStore::MAGIC) { //Cold boot, start over
+        clearErrorLog();
+        return;
+    }
+    bool headerGood = errorStore.used <= ErrorLogStore::SIZE && errorStore.crc == errorLogCrc(errorStore);
+    if(!headerGood) { //Count and totals are lost, but each record carries its own CRC. Check every slot, cleared ones never pass
+        errorStore.used = ErrorLogStore::SIZE;
+        errorStore.dropped = 1; //Unknown how many, flag it with OW
+        errorStore.resets = 0;
+    }
+    uint8_t kept = 0;
+    uint32_t thrown = 0;
+    for(int i = 0; i < errorStore.used; i++) { //Keep only records which survived intact, in order
+        ErrorRecord &record = errorStore.records[i];
+        uint16_t crc = record.crc;
+        sealErrorRecord(record);
+        if(record.crc != crc) {
+            if(headerGood) errorStore.dropped++;
+            continue;
+        }
+        thrown += record.count;
+        errorStore.records[kept++] = record;
+    }
+    for(int i = kept; i < errorStore.used; i++) errorStore.records[i] = ErrorRecord(); //Clear the rest so a later header loss can not revive them
+    errorStore.used = kept;
+    if(!headerGood) errorStore.thrown = thrown;
+    if((kept > 0 || errorStore.dropped > 0) && errorStore.resets < 0xFF) errorStore.resets++; //Only count resets which something in the report lived through
+    errorStore.crc = errorLogCrc(errorStore);
+}
+
+void Kestrel::clearErrorLog()
+{
+    errorStore.magic = ErrorLogStore::MAGIC;
+    for(int i = 0; i < ErrorLogStore::SIZE; i++) errorStore.records[i] = ErrorRecord(); //Zeroed records fail their CRC, so reported codes are never revived
+    errorStore.used = 0;
+    errorStore.resets = 0;
+    errorStore.thrown = 0;
+    errorStore.dropped = 0;
+    errorStore.crc = errorLogCrc(errorStore);
+}
+
+void Kestrel::releaseErrors(uint8_t count)
+{
+    //Remove the first count records once reported, the rest move to the front and start a new report
+    uint8_t kept = 0;
+    errorStore.thrown = 0;
+    for(int i = count; i < errorStore.used; i++) {
+        errorStore.records[kept++] = errorStore.records[i];
+        errorStore.thrown += errorStore.records[i].count;
+    }
+    for(int i = kept; i < errorStore.used; i++) errorStore.records[i] = ErrorRecord();
+    errorStore.used = kept;
+    errorStore.resets = 0; //Already reported by RST
+    errorStore.dropped = 0; //Already reported by OW
+    errorStore.crc = errorLogCrc(errorStore);
+}
+
+void Kestrel::sealErrorRecord(ErrorRecord &record)
+{
+    uint16_t crc = crc16((const uint8_t*)&record.code, sizeof(record.code));
+    crc = crc16((const uint8_t*)&record.count, sizeof(record.count), crc);
+    crc = crc16((const uint8_t*)&record.firstSeen, sizeof(record.firstSeen), crc);
+    record.crc = crc16((const uint8_t*)&record.lastSeen, sizeof(record.lastSeen), crc);
+}
+
+uint16_t Kestrel::errorLogCrc(const ErrorLogStore &store)
+{
+    uint16_t crc = crc16((const uint8_t*)&store.magic, sizeof(store.magic));
+    crc = crc16(&store.used, sizeof(store.used), crc);
+    crc = crc16(&store.resets, sizeof(store.resets), crc);
+    crc = crc16((const uint8_t*)&store.thrown, sizeof(store.thrown), crc);
+    return crc16((const uint8_t*)&store.dropped, sizeof(store.dropped), crc);
+}
+
+uint16_t Kestrel::crc16(const uint8_t *data, size_t len, uint16_t crc)
+{
+    for(size_t i = 0; i < len; i++) { //CRC-16/CCITT, bitwise to avoid a lookup table
+        crc ^= (uint16_t)data[i] << 8;
+        for(int b = 0; b < 8; b++) crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+    }
+    return crc;
 }
 
 String Kestrel::getData(time_t time)
 {
+    getData(reportBuffer, sizeof(reportBuffer), time);
+    return String(reportBuffer);
+}
+
+size_t Kestrel::getData(char *buffer, size_t size, time_t time, uint8_t format)
+{
+    JsonWriter json(buffer, size, format);
     if(reportSensors) {
         bool auxState = enableAuxPower(true); //Turn on AUX power for light sensor
-        bool globState = enableI2C_Global(false); //Turn off external I2C
-        bool obState = enableI2C_OB(true); //Turn on internal I2C
-        String output = "\"Kestrel\":{"; //Open JSON blob
-        output = output + "\"ALS\":{";
-        int error = als.begin();
-        if(error == 0) {
-            bool readState = false;
-            als.AutoRange(); //Get new values
-            // delay(1000); //DEBUG!
-            String alsStr[5]; 
-            for(int i = 0; i < 5; i++) { //Grab values from each channel, check for error and insert nulls as appropriate 
-                float val = als.GetValue(static_cast<VEML3328::Channel>(i), readState); 
-                if(readState) {
-                    alsStr[i] = "null"; //If error, report null
-                    throwError(ALS_DATA_FAIL); //Throw error
-                    readState = false; //Reset flag
-                }
-                else alsStr[i] = String(val);
+        I2CRoute route(*this); //Turn off external I2C and turn on internal I2C until return
+        json.beginObject("Kestrel"); //Open JSON blob
+        OnboardSample onboard;
+        startConversions(Conversion::ALS_CHANNELS, onboard);
+        collectConversions(onboard);
+        json.beginObject("ALS");
+        if(onboard.alsValid) {
+            const char *alsNames[5] = {"Clear", "Red", "Green", "Blue", "IR"};
+            for(int i = 0; i < 5; i++) { //Insert nulls for any channel which failed
+                if(onboard.alsChannelValid[i]) json.key(alsNames[i]).value(onboard.alsChannels[i]);
+                else json.key(alsNames[i]).null(); 
             }
-            output = output + "\"Clear\":" + alsStr[0] + ",\"Red\":" + alsStr[1] + ",\"Green\":" + alsStr[2] + ",\"Blue\":" + alsStr[3] + ",\"IR\":" + alsStr[4]; //appenbd ALS results 
-            // if(readState[0] || readState[1] || readState[2] || readState[3] || readState[4]) throwError(ALS_DATA_FAIL); //If ANY of the channel reads fail, throw an error 
         }
         else {
-            output = output + "\"Red\":null,\"Green\":null,\"Blue\":null,\"Clear\":null,\"IR\":null";
-            throwError(ALS_INIT_FAIL | (error << 8)); //Throw error with I2C status included 
+            json.key("Red").null().key("Green").null().key("Blue").null().key("Clear").null().key("IR").null();
         }
-        output = output + "},\"Pos\":[15]}";
-        enableI2C_Global(globState); //Return to previous state
-        enableI2C_OB(obState);
+        json.endObject();
+        json.beginArray("Pos").value(15).endArray();
+        json.endObject();
         enableAuxPower(auxState);
-        return output;
     }
-    return "";
+    return finishReport(json, ReportType::DATA);
 }
 
 String Kestrel::getMetadata()
+{
+    getMetadata(reportBuffer, sizeof(reportBuffer));
+    return String(reportBuffer);
+}
+
+size_t Kestrel::getMetadata(char *buffer, size_t size)
 {
     //RTC UUID
     //GPS SN
@@ -233,9 +423,9 @@ String Kestrel::getMetadata()
     //
     unsigned long metadataStart = millis();
     bool auxState = enableAuxPower(true); //Turn on AUX power for GPS
-    bool globState = enableI2C_Global(false); //Turn off external I2C
-    bool obState = enableI2C_OB(true); //Turn on internal I2C
-    String metadata = "\"Kestrel\":{";
+    I2CRoute route(*this); //Turn off external I2C and turn on internal I2C until return
+    JsonWriter json(buffer, size);
+    json.beginObject("Kestrel");
     ////////// ADD GPS INFO
     // if(gps.begin() == false) throwError(GPS_INIT_FAIL);
     // else {
@@ -253,38 +443,49 @@ String Kestrel::getMetadata()
     // }
 
     String rtcUUID = rtc.getUUIDString(); 
-    if(!rtcUUID.equals("null")) rtcUUID = "\"" + rtcUUID + "\""; //If not null, wrap with quotes for JSON, otherwise leave as null 
-    metadata = metadata + "\"RTC UUID\":" + rtcUUID + ","; //Append RTC UUID
+    if(!rtcUUID.equals("null")) json.key("RTC UUID").value(rtcUUID.c_str()); //If not null, wrap with quotes for JSON, otherwise leave as null 
+    else json.key("RTC UUID").null();
 
     /////// Particle info //////////// 
-    // metadata = metadata + "\"OS\":\"" + System.version() + "\",";
-    // metadata = metadata + "\"ID\":\"" + System.deviceID() + "\",";
-    if(PLATFORM_ID == PLATFORM_BSOM) metadata = metadata + "\"Model\":\"BSoM\","; //Report BSoM
-    else if (PLATFORM_ID == PLATFORM_B5SOM) metadata = metadata + "\"Model\":\"B5SoM\","; //Report B5SoM
-    else metadata = metadata + "\"Model\":null,"; //Report null if for some reason the firmware is running on another device 
-
-    if(boardVersion == HardwareVersion::PRE_1v9) metadata = metadata + "\"Hardware\":\"<v1.9\",";
-    if(boardVersion == HardwareVersion::MODEL_1v9) metadata = metadata + "\"Hardware\":\"v1.9\",";
+    // json.key("OS").value(System.version().c_str());
+    // json.key("ID").value(System.deviceID().c_str());
+    if(PLATFORM_ID == PLATFORM_BSOM) json.key("Model").value("BSoM"); //Report BSoM
+    else if (PLATFORM_ID == PLATFORM_B5SOM) json.key("Model").value("B5SoM"); //Report B5SoM
+    else json.key("Model").null(); //Report null if for some reason the firmware is running on another device 
+
+    if(boardVersion == HardwareVersion::PRE_1v9) json.key("Hardware").value("<v1.9");
+    if(boardVersion == HardwareVersion::MODEL_1v9) json.key("Hardware").value("v1.9");
     ///////// ADD SHT40!
 
-	
-	metadata = metadata + "\"Firmware\":\"v" + FIRMWARE_VERSION + "\","; //Report firmware version as modded BCD
-	metadata = metadata + "\"Pos\":[15]"; //Concatonate position 
-	metadata = metadata + "}"; //CLOSE  
+	char firmware[16];
+	snprintf(firmware, sizeof(firmware), "v%s", FIRMWARE_VERSION.c_str());
+	json.key("Firmware").value(firmware); //Report firmware version as modded BCD
+	json.beginArray("Pos").value(15).endArray(); //Concatonate position 
+	json.endObject(); //CLOSE  
     if((millis() - metadataStart) > loggerCollectMax) throwError(EXCEED_COLLECT_TIME | 0x300 | portErrorCode); //Throw error for metadata taking too long
     enableAuxPower(auxState); //Return to previous state
-    enableI2C_Global(globState); 
-    enableI2C_OB(obState);
-	return metadata; 
+	return finishReport(json, ReportType::METADATA); 
 	// return ""; //DEBUG!
 }
 
 String Kestrel::selfDiagnostic(uint8_t diagnosticLevel, time_t time)
 {
+    selfDiagnostic(reportBuffer, sizeof(reportBuffer), diagnosticLevel, time);
+    return String(reportBuffer);
+}
+
+size_t Kestrel::selfDiagnostic(char *buffer, size_t size, uint8_t diagnosticLevel, time_t time, uint8_t format)
+{
+    ProfileScope profile(*this, ProfileOp::DIAGNOSTIC);
     unsigned long diagnosticStart = millis(); //Keep track of when the test starts  
-    bool globState = enableI2C_Global(false); //Turn off external I2C
-    bool obState = enableI2C_OB(true); //Turn on internal I2C
-	String output = "\"Kestrel\":{";
+    I2CRoute route(*this); //Turn off external I2C and turn on internal I2C until return
+    JsonWriter json(buffer, size, format);
+    uint16_t &sinceKeyframe = diagSinceKeyframe[diagnosticLevel < DIAG_LEVELS ? diagnosticLevel : DIAG_LEVELS - 1]; //Count per level, each level carries different fields so its keyframes must be its own
+    diagKeyframe = (sinceKeyframe == 0 || sinceKeyframe >= diagKeyframeInterval); //Send every tracked field on the first report at this level and every diagKeyframeInterval reports after
+    if(diagKeyframe) sinceKeyframe = 0;
+    sinceKeyframe++;
+    diagPendingFields = 0; //A report never confirmed is superseded by this one
+	json.beginObject("Kestrel");
 	if(diagnosticLevel == 0) {
 		//TBD
 	}
@@ -295,15 +496,17 @@ String Kestrel::selfDiagnostic(uint8_t diagnosticLevel, time_t time)
 
 	if(diagnosticLevel <= 2) {
 		//TBD
-        if(accelUsed == AccelType::MXC6655) output = output + "\"Accel_Offset\":[" + String(accel.offset[0]) + "," + String(accel.offset[1]) + "," + String(accel.offset[2]) + "],"; 
-        if(accelUsed == AccelType::BMA456) output = output + "\"Accel_Offset\":[0,0,0],"; 
+        if(accelUsed == AccelType::MXC6655 && diagnosticChanged(DiagnosticField::ACCEL_OFFSET, accel.offset, sizeof(accel.offset))) json.beginArray("Accel_Offset").value(accel.offset[0]).value(accel.offset[1]).value(accel.offset[2]).endArray(); 
+        const float noOffset[3] = {0};
+        if(accelUsed == AccelType::BMA456 && diagnosticChanged(DiagnosticField::ACCEL_OFFSET, noOffset, sizeof(noOffset))) json.beginArray("Accel_Offset").value(0).value(0).value(0).endArray(); 
         uint8_t rtcConfigA = (rtc.readByte(0) & 0x80); //Read in ST bit
         rtcConfigA = rtcConfigA | ((rtc.readByte(3) & 0x38) << 1); //Read in OSCRUN, PWRFAIL, VBATEN bits
         uint8_t rtcConfigB = rtc.readByte(7); //Read in control byte
         uint8_t rtcConfigC = rtc.readByte(8); //Read in trim byte
         uint8_t rtcConfigD = rtc.readByte(0x0D); //Read in ALARM0 reg
         uint8_t rtcConfigE = rtc.readByte(0x14); //Read in ALARM1 reg
-        output = output + "\"RTC_Config\":[" + String(rtcConfigA) + "," + String(rtcConfigB) + "," + String(rtcConfigC) + "," + String(rtcConfigD) + "," + String(rtcConfigE) + "],"; //Concatonate to output
+        const uint8_t rtcConfig[5] = {rtcConfigA, rtcConfigB, rtcConfigC, rtcConfigD, rtcConfigE};
+        if(diagnosticChanged(DiagnosticField::RTC_CONFIG, rtcConfig, sizeof(rtcConfig))) json.beginArray("RTC_Config").value(rtcConfigA).value(rtcConfigB).value(rtcConfigC).value(rtcConfigD).value(rtcConfigE).endArray(); //Concatonate to output
 	}
 
 	if(diagnosticLevel <= 3) {
@@ -319,326 +522,761 @@ String Kestrel::selfDiagnostic(uint8_t diagnosticLevel, time_t time)
 
         //GRAB TTFF FROM GPS
         enableAuxPower(true); //Make sure power is applied to GPS
-        uint8_t customPayload[MAX_PAYLOAD_SIZE]; // This array holds the payload data bytes. MAX_PAYLOAD_SIZE defaults to 256. The CFG_RATE payload is only 6 bytes!
-        gps.setPacketCfgPayloadSize(MAX_PAYLOAD_SIZE);
-        ubxPacket customCfg = {0, 0, 0, 0, 0, customPayload, 0, 0, SFE_UBLOX_PACKET_VALIDITY_NOT_DEFINED, SFE_UBLOX_PACKET_VALIDITY_NOT_DEFINED};
-        customCfg.cls = UBX_CLASS_NAV; // This is the message Class
-        customCfg.id = UBX_NAV_STATUS; // This is the message ID
-        customCfg.len = 0; // Setting the len (length) to zero let's us poll the current settings
-        customCfg.startingSpot = 0; // Always set the startingSpot to zero (unless you really know what you are doing)
-        uint16_t maxWait = 1500; // Wait for up to 250ms (Serial may need a lot longer e.g. 1100)
-        if (gps.sendCommand(&customCfg, maxWait) != SFE_UBLOX_STATUS_DATA_RECEIVED) {
+        const uint8_t *customPayload = nullptr; //Points into UBX cache, zeroed if poll fails
+        if (!pollUbx(UBX_CLASS_NAV, UBX_NAV_STATUS, customPayload, UBX_STATUS_MAX_AGE)) { //Reuse NAV-STATUS if already polled this wake
             Serial.println("GPS READ FAIL"); //DEBUG!
             throwError(GPS_READ_FAIL); // We are expecting data and an ACK, throw error otherwise
         }
         unsigned long ttff = 0;
         for(int i = 0; i < 4; i++) ttff = ttff | (customPayload[8 + i] << 8*i); //Concatonate the 4 bytes of the TTFF value
-        if(customPayload[4] >= 2 && customPayload[4] <= 4) output = output + "\"TTFF\":" + String(ttff) + ","; //Append TTFF
-        else output = output + "\"TTFF\":null,"; //If no fix, append null
-        // Serial.print("GPS UTC Seconds: "); //DEBUG!
-        // Serial.println(customPayload[18]);
-        // Serial.print("GPS UTC Validity: "); //DEBUG!
-        // Serial.println(customPayload[19], HEX);
+        if(customPayload[4] >= 2 && customPayload[4] <= 4) json.key("TTFF").value((uint32_t)ttff); //Append TTFF
+        else json.key("TTFF").null(); //If no fix, append null
  	}
 
 	if(diagnosticLevel <= 4) {
+        OnboardSample onboard;
+        //Let onboard sensors convert while the CSAs are read. Only the SHT4x conversion (5ms) and the first BMA456 flush interval (10ms) are actually waiting,
+        //so the gain is the CSA reads (about 3.5ms at 100kHz) hidden under them, not the sum of every sensor's read time
+        startConversions(Conversion::ALS_LUX | Conversion::ATMOS | Conversion::ACCEL, onboard);
         static time_t lastAccReset = 0; //Grab time that accumulators were reset. Set to 0 on restart
-        ioOB.digitalWrite(PinsOB::CSA_EN, HIGH); //Enable CSA GPIO control
-        bool initA = csaAlpha.begin();
-        bool initB = csaBeta.begin();
+        writeExpanderPin(obShadow, PinsOB::CSA_EN, HIGH); //Enable CSA GPIO control
+        bool initA = sensorReady(OnboardSensor::CSA_ALPHA); //Channels are configured once, when the CSA is first probed
+        bool initB = sensorReady(OnboardSensor::CSA_BETA);
+        if(initA && lastAccReset == 0) { //If unknown time since last reset, clear accumulators on csa Alpha before they are read
+            csaAlpha.update(true); 
+            energyBase[0].valid = false; //Accumulators restart from zero, take new baseline on next read
+            lastAccReset = getTime(); //Update time of reset
+        }
+        CsaReading readingA;
+        CsaReading readingB;
+        bool refreshedA = initA && refreshCsa(csaAlphaAdr); //Latch both before reading either, so one refresh time covers the pair
+        bool refreshedB = initB && refreshCsa(CSA_BETA_ADR);
+        if(initA && !(refreshedA && readCsaBulk(csaAlphaAdr, CSA_ALPHA_BIDIR, CSA_ALPHA_SENSE, readingA, false))) { //Two block reads per device
+            throwError(CSA_OB_READ_FAIL | 0xA00); //Throw read error for CSA A
+            sensorFailed(OnboardSensor::CSA_ALPHA);
+        }
+        if(initB && !(refreshedB && readCsaBulk(CSA_BETA_ADR, CSA_BETA_BIDIR, CSA_BETA_SENSE, readingB, false))) {
+            throwError(CSA_OB_READ_FAIL | 0xB00); //Throw read error for CSA B
+            sensorFailed(OnboardSensor::CSA_BETA);
+        }
+        if(readingA.valid) {
+            sensors[OnboardSensor::CSA_ALPHA].reads++;
+            accountEnergy(0, readingA);
+            addBatterySample(readingA.voltage[0], readingA.current[0]); //CH1 is the battery
+        }
+        if(readingB.valid) {
+            sensors[OnboardSensor::CSA_BETA].reads++;
+            accountEnergy(1, readingB);
+        }
 		if(initA == true || initB == true) { //Only proceed if one of the ADCs connects correctly
 			// adcSense.SetResolution(18); //Set to max resolution (we paid for it right?) 
-            //Setup CSAs
-            if(initA == true) {
-                csaAlpha.enableChannel(Channel::CH1, true); //Enable all channels
-                csaAlpha.enableChannel(Channel::CH2, true);
-                csaAlpha.enableChannel(Channel::CH3, true);
-                csaAlpha.enableChannel(Channel::CH4, true);
-                csaAlpha.setCurrentDirection(Channel::CH1, BIDIRECTIONAL);
-                csaAlpha.setCurrentDirection(Channel::CH2, UNIDIRECTIONAL);
-                csaAlpha.setCurrentDirection(Channel::CH3, UNIDIRECTIONAL);
-                csaAlpha.setCurrentDirection(Channel::CH4, UNIDIRECTIONAL);
-            }
-
-            if(initB == true) {
-                csaBeta.enableChannel(Channel::CH1, true); //Enable all channels
-                csaBeta.enableChannel(Channel::CH2, true);
-                csaBeta.enableChannel(Channel::CH3, true);
-                csaBeta.enableChannel(Channel::CH4, true);
-                csaBeta.setCurrentDirection(Channel::CH1, UNIDIRECTIONAL);
-                csaBeta.setCurrentDirection(Channel::CH2, UNIDIRECTIONAL);
-                csaBeta.setCurrentDirection(Channel::CH3, UNIDIRECTIONAL);
-                csaBeta.setCurrentDirection(Channel::CH4, UNIDIRECTIONAL);
-            }
-			output = output + "\"PORT_V\":["; //Open group
-			// ioSense.digitalWrite(pinsSense::MUX_SEL2, LOW); //Read voltages
-            if(initA == true) {
-                // csaAlpha.enableChannel(Channel::CH1, true); //Enable all channels
-                // csaAlpha.enableChannel(Channel::CH2, true);
-                // csaAlpha.enableChannel(Channel::CH3, true);
-                // csaAlpha.enableChannel(Channel::CH4, true);
-                for(int i = 0; i < 4; i++){ //Increment through all ports
-                    bool err = false;
-                    float val = csaAlpha.getBusVoltage(Channel::CH1 + i, true, err); //Get bus voltage with averaging 
-                    if(!err) output = output + String(val, 6); //If no error, report as normal
-                    else {
-                        throwError(CSA_OB_READ_FAIL | 0xA00); //Throw read error for CSA A
-                        output = output + "null"; //Otherwise append null
-                    }
-                    output = output + ","; //Append comma 
-                }
-            }
-            else output = output + "null,null,null,null,"; //Append nulls if can't connect to csa alpha
-
-			if(initB == true) {
-                
-                // delay(1000); //Wait for new data //DEBUG!
-                for(int i = 0; i < 4; i++){ //Increment through all ports
-                    bool err = false;
-                    float val = csaBeta.getBusVoltage(Channel::CH1 + i, true, err); //Get bus voltage with averaging 
-                    if(!err) output = output + String(val, 6); //If no error, report as normal
-                    else {
-                        throwError(CSA_OB_READ_FAIL | 0xB00); //Throw read error for CSA B
-                        output = output + "null"; //Otherwise append null
-                    }
-                    if(i < 3) output = output + ","; //Append comma if not the last reading
-                }
+			json.beginArray("PORT_V"); //Open group
+            for(int i = 0; i < 4; i++) { //Bus voltage with averaging, null if not read
+                if(readingA.valid) json.value(readingA.voltage[i], 6);
+                else json.null();
             }
-            else {
-                output = output + "null,null,null,null"; //Append nulls if can't connect to csa beta
-                throwError(CSA_OB_INIT_FAIL | 0xB00); //Throw error for ADC beta failure
+            for(int i = 0; i < 4; i++) {
+                if(readingB.valid) json.value(readingB.voltage[i], 6);
+                else json.null();
             }
+            if(!initB) throwError(CSA_OB_INIT_FAIL | 0xB00); //Throw error for ADC beta failure
+			json.endArray(); //Close group
 
-			output = output + "],"; //Close group
-			output = output + "\"PORT_I\":["; //Open group
-            if(initA == true) {
-                // csaAlpha.enableChannel(Channel::CH1, true); //Enable all channels
-                // csaAlpha.enableChannel(Channel::CH2, true);
-                // csaAlpha.enableChannel(Channel::CH3, true);
-                // csaAlpha.enableChannel(Channel::CH4, true);
-                for(int i = 0; i < 4; i++){ //Increment through all ports
-                    bool err = false;
-                    float val = csaAlpha.getCurrent(Channel::CH1 + i, true, err); //Get current with averaging
-                    if(!err) output = output + String(val, 6); //If no error, report as normal
-                    else {
-                        throwError(CSA_OB_READ_FAIL | 0xA00); //Throw read error for CSA A
-                        output = output + "null"; //Otherwise append null
-                    }
-                    output = output + ","; //Append comma 
-                }
+			json.beginArray("PORT_I"); //Open group
+            for(int i = 0; i < 4; i++) { //Current with averaging, null if not read
+                if(readingA.valid) json.value(readingA.current[i], 6);
+                else json.null();
             }
-            else {
-                output = output + "null,null,null,null,"; //Append nulls if can't connect to csa alpha
-                throwError(CSA_OB_INIT_FAIL | 0xA00); //Throw error for ADC failure
+            for(int i = 0; i < 4; i++) {
+                if(readingB.valid) json.value(readingB.current[i], 6);
+                else json.null();
             }
-
-			if(initB == true) {
-                // csaBeta.enableChannel(Channel::CH1, true); //Enable all channels
-                // csaBeta.enableChannel(Channel::CH2, true);
-                // csaBeta.enableChannel(Channel::CH3, true);
-                // csaBeta.enableChannel(Channel::CH4, true);
-                for(int i = 0; i < 4; i++){ //Increment through all ports
-                    bool err = false;
-                    float val = csaBeta.getCurrent(Channel::CH1 + i, true, err); //Get current with averaging
-                    if(!err) output = output + String(val, 6); //If no error, report as normal
-                    else {
-                        throwError(CSA_OB_READ_FAIL | 0xB00); //Throw read error for CSA B
-                        output = output + "null"; //Otherwise append null
-                    }
-                    if(i < 3) output = output + ","; //Append comma if not the last reading
-                }
-            }
-            else {
-                output = output + "null,null,null,null"; //Append nulls if can't connect to csa beta
-                throwError(CSA_OB_INIT_FAIL | 0xB00); //Throw error for ADC failure
-            }
-			output = output + "],"; //Close group
-            output = output + "\"AVG_P\":["; //Open group
-            if(lastAccReset == 0) { //If unknown time since last reset, clear accumulators on csa Alpha
-                csaAlpha.update(true); 
-                lastAccReset = getTime(); //Update time of reset
+            if(!initA) throwError(CSA_OB_INIT_FAIL | 0xA00); //Throw error for ADC failure
+            if(!initB) throwError(CSA_OB_INIT_FAIL | 0xB00); //Throw error for ADC failure
+			json.endArray(); //Close group
+
+            json.beginArray("AVG_P"); //Open group
+            for(int i = 0; i < 4; i++) { //Average power since accumulator clear
+                if(readingA.valid) json.value(readingA.power[i]);
+                else json.null();
             }
-            if(initA == true) {
-                for(int i = 0; i < 4; i++){ //Increment through all ports
-                    bool err = false;
-                    float val = csaAlpha.getPowerAvg(Channel::CH1 + i, err); //Get bus power
-                    if(!err) output = output + String(val); //If no error, report as normal
-                    else {
-                        throwError(CSA_OB_READ_FAIL | 0xA00); //Throw read error for CSA A
-                        output = output + "null"; //Otherwise append null
-                    }
-                    if(i < 3) output = output + ","; //Append comma if not the last reading
-                }
-            }
-            else {
-                output = output + "null,null,null,null"; //Append nulls if can't connect to csa alpha
-                throwError(CSA_OB_INIT_FAIL | 0xA00); //Throw error for ADC failure
-            }
-            output = output + "],"; //Close group
-            output = output + "\"LAST_CLR\":" + String((int)lastAccReset) + ","; //Append the time of the last accumulator clear
+            if(!initA) throwError(CSA_OB_INIT_FAIL | 0xA00); //Throw error for ADC failure
+            json.endArray(); //Close group
+            json.key("LAST_CLR").value((int)lastAccReset); //Append the time of the last accumulator clear
+            json.beginArray("WH_DAY"); //Energy per channel so far today (UTC), same order as PORT_V
+            for(int i = 0; i < ENERGY_CHANNELS; i++) json.value(getEnergyDay(i, 0), 4);
+            json.endArray();
             if((getTime() - lastAccReset) > 86400 && (getTime() % 86400) < 3600) { //If it is zero hour in UTC and it has been more than 24 hours since the last reset, clear accumulators 
                 csaAlpha.update(true); 
+                energyBase[0] = EnergyBaseline(); //Just read above, so counting on from zero loses nothing
+                energyBase[0].valid = true;
+                energyBase[0].updated = millis();
                 lastAccReset = getTime(); //Update time of reset
             }
 			
 		}
 		else { //If unable to initialzie ADC
-			output = output + "\"PORT_V\":[null],\"PORT_I\":[null],\"AVG_P\":[null],";
+			json.beginArray("PORT_V").null().endArray();
+			json.beginArray("PORT_I").null().endArray();
+			json.beginArray("AVG_P").null().endArray();
 			throwError(CSA_OB_INIT_FAIL); //Throw error for global CSA failure
 		}
-        output = output + "\"ALS\":";
-        int error = als.begin();
-        if(error == 0) {
-            als.AutoRange();
-            output = output + String(als.GetLux()) + ","; //appenbd ALS results 
-        }
-        else {
-            output = output + "null,";
-            throwError(ALS_INIT_FAIL | (error << 8)); //Throw error with I2C status included 
-        }
-
-        String temperatureString = "\"Temperature\":["; //Used to gather temp from multiple sources
-        if(atmos.begin()) {
-            atmos.setPrecision(SHT4X_MED_PRECISION); //Set to mid performance 
-            sensors_event_t humidity, temp;
-            atmos.getEvent(&humidity, &temp);
-            output = output + "\"RH\":" + String(humidity.relative_humidity, 4) + ","; //Concatonate atmos data 
-            temperatureString = temperatureString + String(temp.temperature, 4) + ",";
+        collectConversions(onboard); //Pick up results of conversions started before the CSA reads
+        if(onboard.alsValid) json.key("ALS").value(onboard.lux); //appenbd ALS results 
+        else json.key("ALS").null();
+
+        float temperature[2] = {0}; //Used to gather temp from multiple sources, reported together after the other values
+        bool temperatureValid[2] = {false, false};
+        uint8_t temperatureDecimals[2] = {4, 4};
+        if(onboard.atmosValid) {
+            json.key("RH").value(onboard.humidity, 4); //Concatonate atmos data 
+            temperature[0] = onboard.atmosTemp;
+            temperatureValid[0] = true;
         }
         else {
-            output = output + "\"RH\":null,"; //append null string
-            temperatureString = temperatureString + "null,";
+            json.key("RH").null(); //append null string
             //THROW ERROR
         }
-        atmos.~Adafruit_SHT4x(); //Delete objects
 
-        if(accelUsed == AccelType::MXC6655) { //If MXC6655 is used, proceed with reading
-            int accelInitError = accel.begin();
-            if(accelInitError == 0) {
-                
-                int accelError = accel.updateAccelAll();
-                if(accelError != 0) {
-                    throwError(ACCEL_DATA_FAIL | (accelError << 8)); //Throw error for failure to communicate with accel, OR error code
-                    //FIX! Null outputs??
-                }
-                output = output + "\"ACCEL\":[" + String(accel.data[0]) + "," + String(accel.data[1]) + "," + String(accel.data[2]) + "],"; 
-                temperatureString = temperatureString + String(accel.getTemp(), 4);
-            }
-            else {
-                throwError(ACCEL_DATA_FAIL); //Throw error for failure to communicate with accel
-                output = output + "\"ACCEL\":[null],";
-                temperatureString = temperatureString + "null";
-            }
-        }
-        else if (accelUsed == AccelType::BMA456) { //If BMA456 is used, proceed with reading
-            bool bma456Present = bma456.begin();
-            float x = 0, y = 0, z = 0;
-            int32_t temp = 0;
-            bma456.initialize();
-            for(int i = 0; i < 5; i++) { //FIX! DEBUG!
-                bma456.getAcceleration(&x, &y, &z);
-                delay(10);
-            }
-            
-            temp = bma456.getTemperature();
-
-            if(bma456Present) { //FIX! Check directly for failure instead of implied failure by presence or abscence 
-                output = output + "\"ACCEL\":[" + String(x/1000.0) + "," + String(y/1000.0) + "," + String(z/1000.0) + "],"; 
-                temperatureString = temperatureString + String(temp);
-            }
-            else {
-                output = output + "\"ACCEL\":[null,null,null],"; 
-                temperatureString = temperatureString + "null";
-            }
+        if(onboard.accelValid) {
+            json.beginArray("ACCEL").value(onboard.accel[0]).value(onboard.accel[1]).value(onboard.accel[2]).endArray(); 
+            temperature[1] = onboard.accelTemp;
+            temperatureValid[1] = true;
+            temperatureDecimals[1] = onboard.accelTempDecimals;
         }
+        else if(accelUsed == AccelType::MXC6655) json.beginArray("ACCEL").null().endArray();
+        else if(accelUsed == AccelType::BMA456) json.beginArray("ACCEL").null().null().null().endArray(); 
 
 		// ioSense.digitalWrite(pinsSense::MUX_EN, HIGH); //Turn MUX back off 
 		// digitalWrite(KestrelPins::PortBPins[talonPort], LOW); //Return to default external connecton
-        temperatureString = temperatureString + "]";
-        output = output + "\"SIV\":" + String(gps.getSIV()) + ",\"FIX\":" + String(gps.getFixType()) + ",";
-		output = output + temperatureString + ","; 
-		// return output + ",\"Pos\":[" + String(port) + "]}}";
-		// return output;
-
+        updatePvt(); //Reuse recent PVT poll if one exists
+        json.key("SIV").value(pvt.siv).key("FIX").value(pvt.fixType);
+        json.beginArray("Temperature");
+        for(int i = 0; i < 2; i++) {
+            if(temperatureValid[i]) json.value(temperature[i], temperatureDecimals[i]);
+            else json.null();
+        }
+        json.endArray();
 	}
 
 	if(diagnosticLevel <= 5) {
-		// output = output + "\"lvl-5\":{"; //OPEN JSON BLOB
         if(System.freeMemory() < 15600) { //Throw error if RAM usage >90% //FIX! Check dynamically for amount of RAM available based on OS, etc 
             throwError(RAM_CRITICAL); 
             criticalFault = true; //Let WDT off leash to fix issue
         }
         else if(System.freeMemory() < 46800) throwError(RAM_LOW); //Throw error if RAM usage >75% //FIX! Check dynamically for amount of RAM available based on OS, etc 
-        output = output + "\"Free Mem\":" + String(System.freeMemory()) + ","; //DEBUG! Move to higher level later on
-        output = output + "\"Time Fix\":" + String(timeFix) + ","; //Append time sync value
-        output = output + "\"Time Source\":[\"" + sourceNames[timeSourceA] + "\",\"" + sourceNames[timeSourceB] + "\"],"; //Report the time souce selected from the last sync
-        output = output + "\"Times\":{\"LOCAL\":" + String((int)times[numClockSources - 1]) + ","; //Always have current time listed 
+        json.key("Free Mem").value((uint32_t)System.freeMemory()); //DEBUG! Move to higher level later on
+        json.key("Time Fix").value(timeFix); //Append time sync value
+        const int8_t timeSources[2] = {timeSourceA, timeSourceB};
+        if(diagnosticChanged(DiagnosticField::TIME_SOURCE, timeSources, sizeof(timeSources))) json.beginArray("Time Source").value(sourceNames[timeSourceA]).value(sourceNames[timeSourceB]).endArray(); //Report the time souce selected from the last sync
+        json.beginObject("Times");
+        json.key("LOCAL").value((int)times[numClockSources - 1]); //Always have current time listed 
         for(int i = 0; i < numClockSources - 1; i++) {
             if(sourceRequested[i] == true) { //Only report the clock sources which were requested 
-                if(sourceAvailable[i] == true) {
-                    output = output + "\"" + sourceNames[i] + "\":" + String((int)times[i]) + ","; //If result is valid, append number
-                }
-                else output = output + "\"" + sourceNames[i] + "\":null,"; //If result not valid, append null
+                if(sourceAvailable[i] == true) json.key(sourceNames[i]).value((int)times[i]); //If result is valid, append number
+                else json.key(sourceNames[i]).null(); //If result not valid, append null
             }
         }
-        if(output.endsWith(",")) output.remove(output.length() - 1); //Trim trailing comma if needed
-        output = output + "},"; //Close blob
-        // output = output + "\"Times\":[" + String((int)timeSyncVals[0]) + "," + String((int)timeSyncVals[1]) + "," + String((int)timeSyncVals[2]) + "],"; //Add reported times from last sync
-        if(lastTimeSync > 0) output = output + "\"Last Sync\":" + String((int)lastTimeSync) + ",";
-        else output = output + "\"Last Sync\":null,";
-        output = output + "\"OB\":" + ioOB.readBus() + ",\"Talon\":" + ioTalon.readBus() + ","; //Report the bus readings from the IO expanders
-        output = output + "\"I2C\":["; //Append identifer 
+        json.endObject(); //Close blob
+        if(lastTimeSync > 0) json.key("Last Sync").value((int)lastTimeSync);
+        else json.key("Last Sync").null();
+        uint16_t obBus = ioOB.readBus();
+        uint16_t talonBus = ioTalon.readBus();
+        if(diagnosticChanged(DiagnosticField::OB_BUS, &obBus, sizeof(obBus))) json.key("OB").value((uint32_t)obBus); //Report the bus readings from the IO expanders
+        if(diagnosticChanged(DiagnosticField::TALON_BUS, &talonBus, sizeof(talonBus))) json.key("Talon").value((uint32_t)talonBus);
+        uint8_t i2cPresent[16] = {0}; //One bit per 7 bit address
         for(int adr = 0; adr < 128; adr++) { //Check for addresses present 
             Wire.beginTransmission(adr);
             // Wire.write(0x00);
             int error = Wire.endTransmission();
-            // if(adr == 0) { //DEBUG!
-            //     // Serial.print("Zero Error: ");
-            //     // Serial.println(error); 
-            // }
-            if(error == 0) {
-                output = output + String(adr) + ",";
-            }
+            if(error == 0) i2cPresent[adr/8] |= (1 << (adr % 8));
             delay(1); //DEBUG!
         }
-        if(output.substring(output.length() - 1).equals(",")) {
-            output = output.substring(0, output.length() - 1); //Trim trailing ',' if present
-        }
-        output = output + "],"; //Close array
+        if(diagnosticChanged(DiagnosticField::I2C, i2cPresent, sizeof(i2cPresent))) json.key("I2C").bitmap(i2cPresent, 128); //List of addresses in JSON, 16 byte bitmap in CBOR
 	}
     if((millis() - diagnosticStart) > loggerCollectMax) throwError(EXCEED_COLLECT_TIME | 0x200 | portErrorCode); //Throw error for diagnostic taking too long
-    enableI2C_Global(globState); //Return to previous state
-    enableI2C_OB(obState);
-	return output + "\"Pos\":[15]}"; //Write position in logical form - Return compleated closed output
+    if(diagKeyframeInterval > 0) json.key("Seq").value((uint32_t)diagSequence++).key("Keyframe").value(diagKeyframe); //Let backend detect gaps and know when it has full state
+	json.beginArray("Pos").value(15).endArray(); //Write position in logical form
+	json.endObject(); //Return compleated closed output
+    size_t length = finishReport(json, ReportType::DIAGNOSTIC);
+    if(length == 0) diagPendingFields = 0; //Dropped, nothing to confirm
+	return length;
+}
+
+void Kestrel::setDiagnosticDelta(uint16_t keyframeInterval)
+{
+    diagKeyframeInterval = keyframeInterval;
+    forceDiagnosticKeyframe(); //Start over with a keyframe
+}
+
+void Kestrel::confirmDiagnostic()
+{
+    for(int field = 0; field < DiagnosticField::COUNT; field++) {
+        if(diagPendingFields & (1 << field)) memcpy(diagBaseline[field], diagPending[field], DIAG_BASELINE_SIZE);
+    }
+    diagBaselineFields |= diagPendingFields;
+    diagPendingFields = 0;
+}
+
+bool Kestrel::diagnosticChanged(uint8_t field, const void *data, size_t len)
+{
+    if(diagKeyframeInterval == 0) return true; //Delta mode off, report everything
+    if(len > DIAG_BASELINE_SIZE) len = DIAG_BASELINE_SIZE;
+    if(!diagKeyframe && (diagBaselineFields & (1 << field)) && memcmp(diagBaseline[field], data, len) == 0) return false; //Unchanged since last confirmed report, leave out
+    memset(diagPending[field], 0, DIAG_BASELINE_SIZE);
+    memcpy(diagPending[field], data, len); //Only becomes the baseline once confirmDiagnostic says the report got through
+    diagPendingFields |= (1 << field);
+    return true;
+}
+
+bool Kestrel::sensorReady(uint8_t sensor)
+{
+    SensorHandle &handle = sensors[sensor];
+    if(handle.ready) return true; //Already probed and configured
+    handle.inits++;
+    switch(sensor) {
+        case OnboardSensor::ALS: {
+            int error = als.begin();
+            handle.ready = (error == 0);
+            alsRanged = false; //Configuration lost, next read needs a full search
+            if(!handle.ready) throwError(ALS_INIT_FAIL | (error << 8)); //Throw error with I2C status included 
+            break;
+        }
+        case OnboardSensor::ATMOS:
+            handle.ready = atmos.begin();
+            if(handle.ready) atmos.setPrecision(SHT4X_MED_PRECISION); //Set to mid performance 
+            break;
+        case OnboardSensor::ACCEL:
+            if(accelUsed == AccelType::BMA456) {
+                handle.ready = bma456.begin();
+                if(handle.ready) bma456.initialize();
+                accelSettleStart = millis(); //First samples after initialize are not valid
+            }
+            else {
+                handle.ready = (accel.begin() == 0);
+                if(!handle.ready) throwError(ACCEL_DATA_FAIL); //Throw error for failure to communicate with accel
+            }
+            break;
+        case OnboardSensor::CSA_ALPHA:
+            handle.ready = csaAlpha.begin();
+            if(handle.ready) {
+                csaAlpha.enableChannel(Channel::CH1, true); //Enable all channels
+                csaAlpha.enableChannel(Channel::CH2, true);
+                csaAlpha.enableChannel(Channel::CH3, true);
+                csaAlpha.enableChannel(Channel::CH4, true);
+                csaAlpha.setCurrentDirection(Channel::CH1, BIDIRECTIONAL);
+                csaAlpha.setCurrentDirection(Channel::CH2, UNIDIRECTIONAL);
+                csaAlpha.setCurrentDirection(Channel::CH3, UNIDIRECTIONAL);
+                csaAlpha.setCurrentDirection(Channel::CH4, UNIDIRECTIONAL);
+            }
+            break;
+        case OnboardSensor::CSA_BETA:
+            handle.ready = csaBeta.begin();
+            if(handle.ready) {
+                csaBeta.enableChannel(Channel::CH1, true); //Enable all channels
+                csaBeta.enableChannel(Channel::CH2, true);
+                csaBeta.enableChannel(Channel::CH3, true);
+                csaBeta.enableChannel(Channel::CH4, true);
+                csaBetaEnabled = 0x0F;
+                csaBeta.setCurrentDirection(Channel::CH1, UNIDIRECTIONAL);
+                csaBeta.setCurrentDirection(Channel::CH2, UNIDIRECTIONAL);
+                csaBeta.setCurrentDirection(Channel::CH3, UNIDIRECTIONAL);
+                csaBeta.setCurrentDirection(Channel::CH4, UNIDIRECTIONAL);
+            }
+            break;
+    }
+    if(!handle.ready) handle.failures++;
+    return handle.ready;
+}
+
+void Kestrel::startConversions(uint8_t conversions, OnboardSample &sample)
+{
+    sample = OnboardSample();
+    sample.requested = conversions;
+    if(conversions & Conversion::ATMOS) { //SHT4x converts on command, kick it off now and read it last
+        atmosPending = false;
+        if(sensorReady(OnboardSensor::ATMOS)) {
+            Wire.beginTransmission(ATMOS_ADR);
+            Wire.write(ATMOS_MEASURE_MED);
+            if(Wire.endTransmission() == 0) {
+                atmosPending = true;
+                atmosTriggered = millis();
+            }
+            else sensorFailed(OnboardSensor::ATMOS);
+        }
+    }
+    if(conversions & Conversion::ACCEL) {
+        accelFlushed = 0;
+        if(sensorReady(OnboardSensor::ACCEL) && accelUsed == AccelType::BMA456 && millis() - accelSettleStart >= ACCEL_SETTLE_TIME) { //First flush read now, the work before collect covers part of the wait for the next
+            float x = 0, y = 0, z = 0;
+            bma456.getAcceleration(&x, &y, &z);
+            accelFlushed = 1;
+            accelFlushLast = millis();
+        }
+    }
+    if(conversions & (Conversion::ALS_CHANNELS | Conversion::ALS_LUX)) sensorReady(OnboardSensor::ALS); //Free running, make sure it is configured
+}
+
+void Kestrel::collectConversions(OnboardSample &sample)
+{
+    if((sample.requested & (Conversion::ALS_CHANNELS | Conversion::ALS_LUX)) && sensors[OnboardSensor::ALS].ready) {
+        ProfileScope alsProfile(*this, ProfileOp::ALS_READ);
+        bool readFail = false;
+        alsUpdateRange(); //Only searches gain/integration time if the previous range no longer fits
+        if(sample.requested & Conversion::ALS_CHANNELS) {
+            for(int i = 0; i < 5; i++) { //Grab values from each channel, check for error
+                bool readState = false;
+                sample.alsChannels[i] = als.GetValue(static_cast<VEML3328::Channel>(i), readState); 
+                sample.alsChannelValid[i] = !readState;
+                if(readState) {
+                    throwError(ALS_DATA_FAIL); //Throw error
+                    readFail = true;
+                }
+            }
+        }
+        if(sample.requested & Conversion::ALS_LUX) sample.lux = als.GetLux();
+        sample.alsValid = true;
+        sensors[OnboardSensor::ALS].reads++;
+        if(readFail) sensorFailed(OnboardSensor::ALS); //Re-probe on next read
+    }
+
+    if((sample.requested & Conversion::ACCEL) && sensors[OnboardSensor::ACCEL].ready) {
+        sensors[OnboardSensor::ACCEL].reads++;
+        if(accelUsed == AccelType::MXC6655) { //If MXC6655 is used, proceed with reading
+            int accelError = accel.updateAccelAll();
+            if(accelError != 0) {
+                throwError(ACCEL_DATA_FAIL | (accelError << 8)); //Throw error for failure to communicate with accel, OR error code
+                sensorFailed(OnboardSensor::ACCEL);
+                //FIX! Null outputs??
+            }
+            for(int i = 0; i < 3; i++) sample.accel[i] = accel.data[i];
+            sample.accelTemp = accel.getTemp();
+            sample.accelValid = true;
+        }
+        else if(accelUsed == AccelType::BMA456) { //FIX! Check directly for failure instead of implied failure by presence or abscence 
+            while(millis() - accelSettleStart < ACCEL_SETTLE_TIME) delay(1); //Normally long over by the time we get here
+            float x = 0, y = 0, z = 0;
+            for(; accelFlushed < ACCEL_FLUSH_READS; accelFlushed++) { //Same five reads 10ms apart as before the split, only the last is kept
+                if(accelFlushed > 0) while(millis() - accelFlushLast < ACCEL_FLUSH_INTERVAL) delay(1);
+                bma456.getAcceleration(&x, &y, &z);
+                accelFlushLast = millis();
+            }
+            sample.accel[0] = x/1000.0f;
+            sample.accel[1] = y/1000.0f;
+            sample.accel[2] = z/1000.0f;
+            sample.accelTemp = bma456.getTemperature();
+            sample.accelTempDecimals = 0; //BMA456 reports whole degrees
+            sample.accelValid = true;
+        }
+    }
+
+    if((sample.requested & Conversion::ATMOS) && atmosPending) { //Collected last so the other sensors cover the conversion time
+        atmosPending = false;
+        while(millis() - atmosTriggered < ATMOS_CONVERSION_TIME) delay(1);
+        uint8_t data[6] = {0};
+        bool readGood = (Wire.requestFrom(ATMOS_ADR, (uint8_t)6) == 6);
+        for(int i = 0; i < 6 && readGood; i++) data[i] = Wire.read();
+        readGood = readGood && crc8(&data[0], 2) == data[2] && crc8(&data[3], 2) == data[5]; //Each word carries its own CRC
+        if(readGood) {
+            uint16_t tTicks = (data[0] << 8) | data[1];
+            uint16_t rhTicks = (data[3] << 8) | data[4];
+            sample.atmosTemp = -45.0 + 175.0*tTicks/65535.0; //Conversion from SHT4x datasheet
+            sample.humidity = min(max(-6.0 + 125.0*rhTicks/65535.0, 0.0), 100.0); //Clamp to physical range, as the Adafruit driver does
+            sample.atmosValid = true;
+            sensors[OnboardSensor::ATMOS].reads++;
+        }
+        else sensorFailed(OnboardSensor::ATMOS); //Read failed, re-probe next time
+    }
+}
+
+uint8_t Kestrel::crc8(const uint8_t *data, size_t len)
+{
+    uint8_t crc = 0xFF;
+    for(size_t i = 0; i < len; i++) { //CRC-8 poly 0x31, as used by Sensirion parts
+        crc ^= data[i];
+        for(int b = 0; b < 8; b++) crc = (crc & 0x80) ? (crc << 1) ^ 0x31 : (crc << 1);
+    }
+    return crc;
+}
+
+bool Kestrel::refreshCsa(uint8_t adr)
+{
+    Wire.beginTransmission(adr);
+    Wire.write(CSA_REFRESH_V); //Latch new values without clearing the accumulators
+    if(Wire.endTransmission() != 0) return false;
+    csaRefreshed = micros();
+    return true;
+}
+
+bool Kestrel::readCsaBulk(uint8_t adr, uint8_t bidirectional, const float sense[4], CsaReading &reading, bool refresh)
+{
+    reading.valid = false;
+    if(refresh && !refreshCsa(adr)) return false;
+    while(micros() - csaRefreshed < CSA_REFRESH_TIME) {} //Registers are valid 1ms after refresh, already passed if other work was done since
+
+    uint8_t acc[CSA_ACC_BLOCK] = {0}; //ACC_COUNT followed by VPOWER1_ACC to VPOWER4_ACC
+    uint8_t avg[CSA_AVG_BLOCK] = {0}; //VBUS1_AVG to VBUS4_AVG followed by VSENSE1_AVG to VSENSE4_AVG
+    const uint8_t blockStart[2] = {CSA_ACC_COUNT, CSA_VBUS_AVG};
+    uint8_t *blockData[2] = {acc, avg};
+    const uint8_t blockLength[2] = {CSA_ACC_BLOCK, CSA_AVG_BLOCK};
+    for(int b = 0; b < 2; b++) { //Each block is one pointer write and one read, registers auto increment
+        Wire.beginTransmission(adr);
+        Wire.write(blockStart[b]);
+        if(Wire.endTransmission(false) != 0) return false;
+        if(Wire.requestFrom(adr, blockLength[b]) != blockLength[b]) return false;
+        for(int i = 0; i < blockLength[b]; i++) blockData[b][i] = Wire.read();
+    }
+
+    uint32_t count = ((uint32_t)acc[0] << 16) | ((uint32_t)acc[1] << 8) | acc[2];
+    reading.count = count;
+    for(int ch = 0; ch < 4; ch++) {
+        bool bidir = bidirectional & (1 << ch);
+        float senseOhms = sense[ch]/1000.0; //Sense resistors given in mOhm
+        uint16_t vbus = (avg[2*ch] << 8) | avg[2*ch + 1];
+        uint16_t vsense = (avg[8 + 2*ch] << 8) | avg[8 + 2*ch + 1];
+        reading.voltage[ch] = 32.0*vbus/65536.0; //32V full scale, bus is always unipolar here
+        if(bidir) reading.current[ch] = (0.1/senseOhms)*(int16_t)vsense/32768.0; //+/-100mV full scale
+        else reading.current[ch] = (0.1/senseOhms)*vsense/65536.0; //100mV full scale
+
+        uint64_t raw = 0;
+        for(int i = 0; i < 6; i++) raw = (raw << 8) | acc[3 + 6*ch + i]; //48 bit accumulator
+        reading.accumulator[ch] = raw;
+        double power = 0;
+        if(bidir) {
+            int64_t signedRaw = (raw & 0x800000000000ULL) ? (int64_t)(raw | 0xFFFF000000000000ULL) : (int64_t)raw; //Sign extend 48 bit value
+            power = (double)signedRaw*(3.2/senseOhms)/134217728.0; //2^27 for bipolar
+        }
+        else power = (double)raw*(3.2/senseOhms)/268435456.0; //2^28 for unipolar, 3.2 = 32V * 100mV full scale power
+        reading.power[ch] = count > 0 ? power/count : 0; //Average power since last accumulator clear
+    }
+    reading.valid = true;
+    return true;
+}
+
+bool Kestrel::readCsa(uint8_t device, CsaReading &reading)
+{
+    reading.valid = false;
+    if(device > 1) return false;
+    I2CRoute route(*this); //Turn off external I2C and turn on internal I2C until return
+    if(device == 0) return readCsaBulk(csaAlphaAdr, CSA_ALPHA_BIDIR, CSA_ALPHA_SENSE, reading);
+    return readCsaBulk(CSA_BETA_ADR, CSA_BETA_BIDIR, CSA_BETA_SENSE, reading);
+}
+
+void Kestrel::accountEnergy(uint8_t device, const CsaReading &reading)
+{
+    EnergyBaseline &base = energyBase[device];
+    const float *sense = (device == 0) ? CSA_ALPHA_SENSE : CSA_BETA_SENSE;
+    uint8_t bidirectional = (device == 0) ? CSA_ALPHA_BIDIR : CSA_BETA_BIDIR;
+    uint16_t sampleRate = (device == 0) ? CSA_ALPHA_SPS : CSA_BETA_SPS;
+    unsigned long now = millis();
+    float elapsed = (now - base.updated)/1000.0; //[s]
+    bool valid = base.valid;
+    uint32_t deltaCount = (reading.count - base.count) & 0xFFFFFF; //24 bit counter, modular difference covers one rollover
+    if(valid && elapsed >= 16777216.0/sampleRate) valid = false; //ACC_COUNT may have wrapped more than once (about 4.5h at 1024 SPS), the count no longer says how many samples the sums cover. Re-baseline
+    float expected = elapsed*sampleRate; //Samples the interval should hold
+    if(valid && fabs(deltaCount - expected) > CSA_COUNT_TOLERANCE*expected + sampleRate*CSA_COUNT_SLACK) valid = false; //Count does not match the time passed, accumulators were cleared behind our back. Re-baseline
+    if(valid && deltaCount > 0) {
+        binEnergy(); //Move to current hour/day
+        for(int ch = 0; ch < 4; ch++) {
+            int64_t deltaAcc = (reading.accumulator[ch] - base.accumulator[ch]) & 0xFFFFFFFFFFFFULL; //48 bit accumulator, modular difference
+            double lsb = (3.2/(sense[ch]/1000.0))/268435456.0; //[W] per unit, 2^28 unipolar
+            if(bidirectional & (1 << ch)) {
+                if(deltaAcc & 0x800000000000LL) deltaAcc -= 0x1000000000000LL; //Sign extend 48 bit difference
+                lsb = lsb*2.0; //2^27 bipolar
+            }
+            float wh = (deltaAcc*lsb/deltaCount)*elapsed/3600.0; //Average power over the interval times its length, independent of actual sample rate
+            energyHour[energyHourIndex][4*device + ch] += wh;
+            energyDay[energyDayIndex][4*device + ch] += wh;
+            if(device == 1 && ch == TALON_BULK_CHANNEL) accountPortEnergy(wh);
+        }
+    }
+    base.count = reading.count;
+    for(int ch = 0; ch < 4; ch++) base.accumulator[ch] = reading.accumulator[ch];
+    base.updated = now;
+    base.valid = true;
+}
+
+void Kestrel::accountPortEnergy(float wh)
+{
+    //Ports share the bulk rail. Split by each powered port's settled current from its last inrush capture, evenly if none was captured.
+    //Exact when one port is on at a time, enablePower closes an interval on every change so the set of powered ports is constant within it
+    float weight[ENERGY_PORTS] = {0};
+    float total = 0;
+    uint8_t powered = 0;
+    for(int p = 0; p < ENERGY_PORTS; p++) {
+        if(!talonShadow.valid || !(talonShadow.output & (1 << PinsTalon::EN[p]))) continue;
+        powered++;
+        weight[p] = (inrush[p].valid && inrush[p].final > 0) ? inrush[p].final : 0;
+        total += weight[p];
+    }
+    if(powered == 0) return; //Rail quiescent draw, no port to charge it to
+    for(int p = 0; p < ENERGY_PORTS; p++) {
+        if(!talonShadow.valid || !(talonShadow.output & (1 << PinsTalon::EN[p]))) continue;
+        float share = total > 0 ? weight[p]/total : 1.0/powered;
+        energyPortHour[energyHourIndex][p] += wh*share;
+        energyPortDay[energyDayIndex][p] += wh*share;
+    }
+}
+
+bool Kestrel::updateBulkEnergy(float &current)
+{
+    if(!sensors[OnboardSensor::CSA_BETA].ready) return false; //Only accounted once a diagnostic has configured csaBeta
+    CsaReading reading;
+    if(!readCsaBulk(CSA_BETA_ADR, CSA_BETA_BIDIR, CSA_BETA_SENSE, reading)) return false;
+    accountEnergy(1, reading);
+    current = reading.current[TALON_BULK_CHANNEL];
+    return true;
+}
+
+void Kestrel::binEnergy()
+{
+    if(!Time.isValid()) return; //Keep adding to current bins until time is known
+    uint32_t hour = Time.now()/3600;
+    uint32_t day = hour/24; //UTC days, lines up with the accumulator clear
+    if(energyHourNumber == 0) energyHourNumber = hour; //First bins since reset
+    if(energyDayNumber == 0) energyDayNumber = day;
+    while(energyHourNumber < hour) { //Advance, clearing any hours with no reads
+        energyHourNumber++;
+        energyHourIndex = (energyHourIndex + 1) % ENERGY_HOURS;
+        for(int ch = 0; ch < ENERGY_CHANNELS; ch++) energyHour[energyHourIndex][ch] = 0;
+        for(int p = 0; p < ENERGY_PORTS; p++) energyPortHour[energyHourIndex][p] = 0;
+        if(hour - energyHourNumber > ENERGY_HOURS) energyHourNumber = hour - ENERGY_HOURS; //Whole ring cleared, skip ahead
+    }
+    while(energyDayNumber < day) {
+        energyDayNumber++;
+        energyDayIndex = (energyDayIndex + 1) % ENERGY_DAYS;
+        for(int ch = 0; ch < ENERGY_CHANNELS; ch++) energyDay[energyDayIndex][ch] = 0;
+        for(int p = 0; p < ENERGY_PORTS; p++) energyPortDay[energyDayIndex][p] = 0;
+        if(day - energyDayNumber > ENERGY_DAYS) energyDayNumber = day - ENERGY_DAYS;
+    }
+}
+
+float Kestrel::getEnergyHour(uint8_t channel, uint8_t hoursAgo)
+{
+    if(channel >= ENERGY_CHANNELS || hoursAgo >= ENERGY_HOURS) return 0;
+    return energyHour[(energyHourIndex + ENERGY_HOURS - hoursAgo) % ENERGY_HOURS][channel];
+}
+
+float Kestrel::getEnergyDay(uint8_t channel, uint8_t daysAgo)
+{
+    if(channel >= ENERGY_CHANNELS || daysAgo >= ENERGY_DAYS) return 0;
+    return energyDay[(energyDayIndex + ENERGY_DAYS - daysAgo) % ENERGY_DAYS][channel];
+}
+
+float Kestrel::getEnergyPortHour(uint8_t port, uint8_t hoursAgo)
+{
+    if(port < 1 || port > ENERGY_PORTS || hoursAgo >= ENERGY_HOURS) return 0;
+    return energyPortHour[(energyHourIndex + ENERGY_HOURS - hoursAgo) % ENERGY_HOURS][port - 1];
+}
+
+float Kestrel::getEnergyPortDay(uint8_t port, uint8_t daysAgo)
+{
+    if(port < 1 || port > ENERGY_PORTS || daysAgo >= ENERGY_DAYS) return 0;
+    return energyPortDay[(energyDayIndex + ENERGY_DAYS - daysAgo) % ENERGY_DAYS][port - 1];
+}
+
+bool Kestrel::alsReadRaw(uint16_t &raw)
+{
+    Wire.beginTransmission(ALS_ADR);
+    Wire.write(ALS_CLEAR_REG);
+    if(Wire.endTransmission(false) != 0) return false;
+    if(Wire.requestFrom(ALS_ADR, (uint8_t)2) != 2) return false;
+    raw = Wire.read(); //Low byte first
+    raw = raw | (Wire.read() << 8);
+    return true;
+}
+
+bool Kestrel::alsUpdateRange()
+{
+    uint16_t raw = 0;
+    if(alsRanged && alsReadRaw(raw)) { //Check the clear channel against the range left from last time
+        bool saturated = raw >= ALS_SATURATED && !alsAtMinSensitivity;
+        bool underRange = raw <= ALS_UNDERRANGE && !alsAtMaxSensitivity;
+        if(!saturated && !underRange) return false; //Previous range still fits, keep it
+    }
+    als.AutoRange(); //Full gain/integration time search
+    alsRangeSearches++;
+    alsRanged = true;
+    if(alsReadRaw(raw)) { //If search still ends at an edge we are at the limit of the sensor, don't search again until light moves the other way
+        alsAtMinSensitivity = (raw >= ALS_SATURATED);
+        alsAtMaxSensitivity = (raw <= ALS_UNDERRANGE);
+    }
+    else alsRanged = false;
+    return true;
+}
+
+void Kestrel::sensorFailed(uint8_t sensor)
+{
+    sensors[sensor].ready = false; //Re-probe before next use
+    sensors[sensor].failures++;
+}
+
+bool Kestrel::updateLocation(bool forceUpdate) 
+{
+    bool status = false;
+    if(updateGPS || forceUpdate) {
+        I2CRoute route(*this); //Turn off external I2C and turn on internal I2C until return
+        enableAuxPower(true); //Turn on aux power 
+        bool pvtGood = updatePvt(); 
+        Serial.print("PVT Response: "); //DEBUG!
+        Serial.println(pvtGood);
+        if(pvtGood && pvt.fixType >= 2 && pvt.fixType <= 4 && pvt.gnssFixOk) { //Only update if GPS has at least a 2D fix
+            Serial.println("UPDATE GPS"); //DEBUG!
+            longitude = pvt.longitude;
+            latitude = pvt.latitude;
+            altitude = pvt.altitude;
+            posTime = getTime(); //Update time that GPS measure was made
+            updateGPS = false; //Clear flag when done
+            status = true;
+        }
+        else {
+            throwError(GPS_UNAVAILABLE); //If no fix available, throw error
+            status = false;
+        }
+    }
+    return status;
+}
+
+void Kestrel::setGpsPowerState(uint8_t state)
+{
+    bool wasAwake = (gpsPowerState == GpsPower::WAKING || gpsPowerState == GpsPower::READY);
+    bool isAwake = (state == GpsPower::WAKING || state == GpsPower::READY);
+    if(!wasAwake && isAwake) gpsAwakeSince = millis(); //Start awake time interval
+    if(wasAwake && !isAwake) {
+        gpsAwakeTotal = gpsAwakeTotal + (millis() - gpsAwakeSince); //Close awake time interval
+        clearUbxCache(); //Receiver state is lost when powered down
+        pvt.valid = false;
+    }
+    gpsPowerState = state;
+}
+
+bool Kestrel::gpsPresent()
+{
+    Wire.beginTransmission(GPS_ADR); //Address ACK is enough to know receiver is running, no UBX traffic needed
+    return (Wire.endTransmission() == 0);
+}
+
+uint8_t Kestrel::gpsWakeStart()
+{
+    if(gpsPowerState == GpsPower::WAKING) return gpsPowerState; //Pulse already underway
+    enableAuxPower(true); //Make sure receiver has power
+    I2CRoute route(*this); //Turn off external I2C and turn on internal I2C until return
+    if(gpsPresent()) { //Already awake, skip the wake pulse entirely 
+        gpsPulsesSkipped++;
+        setGpsPowerState(GpsPower::READY);
+        return gpsPowerState;
+    }
+    Serial.println("Wake GPS"); //DEBUG!
+    writeExpanderPin(obShadow, PinsOB::GPS_INT, LOW); //Turn GPS back on by toggling int pin
+    gpsWakeCount++;
+    gpsWakeStep = 0;
+    gpsStepStart = millis();
+    setGpsPowerState(GpsPower::WAKING);
+    return gpsPowerState;
+}
+
+uint8_t Kestrel::gpsPollWake()
+{
+    if(gpsPowerState != GpsPower::WAKING) return gpsPowerState;
+    if((millis() - gpsStepStart) < 1000) return gpsPowerState; //Each step of the wake pulse is 1 second
+    I2CRoute route(*this); //Turn off external I2C and turn on internal I2C until return
+    gpsStepStart = millis();
+    gpsWakeStep++;
+    if(gpsWakeStep == 1) writeExpanderPin(obShadow, PinsOB::GPS_INT, HIGH);
+    else if(gpsWakeStep == 2) writeExpanderPin(obShadow, PinsOB::GPS_INT, LOW);
+    else setGpsPowerState(gpsPresent() ? GpsPower::READY : GpsPower::OFF); //Pulse complete, check if receiver came up
+    return gpsPowerState;
+}
+
+bool Kestrel::gpsEnsureAwake()
+{
+    gpsWakeStart();
+    while(gpsPollWake() == GpsPower::WAKING) delay(1); //Wait out wake pulse
+    return (gpsPowerState == GpsPower::READY);
+}
+
+bool Kestrel::gpsSleep()
+{
+    bool result = gps.powerOffWithInterrupt(3600000, VAL_RXM_PMREQ_WAKEUPSOURCE_EXTINT0); //Shutdown for an hour unless woken up via pin trip
+    if(!result) throwError(GPS_READ_FAIL); 
+    else setGpsPowerState(GpsPower::BACKUP);
+    return result;
+}
+
+unsigned long Kestrel::getGpsAwakeTime()
+{
+    if(gpsPowerState == GpsPower::WAKING || gpsPowerState == GpsPower::READY) return gpsAwakeTotal + (millis() - gpsAwakeSince); //Include interval in progress
+    return gpsAwakeTotal;
+}
+
+bool Kestrel::updatePvt(bool force)
+{
+    if(!force && pvt.valid && (millis() - pvt.updated) < PVT_MAX_AGE) return true; //Snapshot is fresh enough, no need to poll receiver
+    I2CRoute route(*this); //Turn off external I2C and turn on internal I2C until return
+    ubxTransactions++;
+    pvt.updated = millis();
+    pvt.valid = gps.getPVT(); //Single NAV-PVT transaction
+    if(pvt.valid) { //Each field is read exactly once after getPVT, so library serves it from the packet just received rather than polling again
+        pvt.fixType = gps.getFixType();
+        pvt.gnssFixOk = gps.getGnssFixOk();
+        pvt.siv = gps.getSIV();
+        pvt.latitude = gps.getLatitude();
+        pvt.longitude = gps.getLongitude();
+        pvt.altitude = gps.getAltitude();
+    }
+    else { //Clear stale values so failed poll is not mistaken for a fix
+        pvt.fixType = 0;
+        pvt.gnssFixOk = false;
+        pvt.siv = 0;
+    }
+    return pvt.valid;
 }
 
-bool Kestrel::updateLocation(bool forceUpdate) 
+bool Kestrel::pollUbx(uint8_t cls, uint8_t id, const uint8_t *&payload, unsigned long maxAge, uint16_t maxWait)
 {
-    bool status = false;
-    if(updateGPS || forceUpdate) {
-        bool globState = enableI2C_Global(false); //Turn off external I2C
-        bool obState = enableI2C_OB(true); //Turn on internal I2C
-        enableAuxPower(true); //Turn on aux power 
-        Serial.print("PVT Response: "); //DEBUG!
-        Serial.println(gps.getPVT());
-        // gps.getPVT(); //Force updated call //DEBUG!
-        if(gps.getPVT() && gps.getFixType() >= 2 && gps.getFixType() <= 4 && gps.getGnssFixOk()) { //Only update if GPS has at least a 2D fix
-            Serial.println("UPDATE GPS"); //DEBUG!
-            longitude = gps.getLongitude();
-            latitude = gps.getLatitude();
-            altitude = gps.getAltitude();
-            posTime = getTime(); //Update time that GPS measure was made
-            updateGPS = false; //Clear flag when done
-            status = true;
+    //Return payload of the given UBX message, from cache if it was received within maxAge [ms], otherwise poll receiver
+    UbxCacheEntry *entry = nullptr;
+    for(int i = 0; i < UBX_CACHE_SIZE; i++) { //Look for existing entry for this message
+        if(ubxCache[i].cls == cls && ubxCache[i].id == id) {
+            entry = &ubxCache[i];
+            break;
         }
-        else {
-            throwError(GPS_UNAVAILABLE); //If no fix available, throw error
-            status = false;
+    }
+    if(entry != nullptr && entry->valid && (millis() - entry->updated) < maxAge) { //Fresh enough, skip the poll
+        payload = entry->payload;
+        return true;
+    }
+    if(entry == nullptr) { //Replace the oldest (or unused) entry
+        entry = &ubxCache[0];
+        for(int i = 1; i < UBX_CACHE_SIZE; i++) {
+            if(ubxCache[i].cls == 0 || (entry->cls != 0 && (millis() - ubxCache[i].updated) > (millis() - entry->updated))) entry = &ubxCache[i];
         }
-        enableI2C_Global(globState); //Return to previous state
-        enableI2C_OB(obState);
     }
-    return status;
+    I2CRoute route(*this); //Turn off external I2C and turn on internal I2C until return
+    if(!ubxCfgSized) { //Only size the library packet buffer once, the library reallocates on every call
+        gps.setPacketCfgPayloadSize(MAX_PAYLOAD_SIZE);
+        ubxCfgSized = true;
+    }
+    ubxPacket customCfg = {0, 0, 0, 0, 0, ubxBuffer, 0, 0, SFE_UBLOX_PACKET_VALIDITY_NOT_DEFINED, SFE_UBLOX_PACKET_VALIDITY_NOT_DEFINED};
+    customCfg.cls = cls; // This is the message Class
+    customCfg.id = id; // This is the message ID
+    customCfg.len = 0; // Setting the len (length) to zero let's us poll the current settings
+    customCfg.startingSpot = 0; // Always set the startingSpot to zero (unless you really know what you are doing)
+    ubxTransactions++;
+    entry->cls = cls;
+    entry->id = id;
+    entry->updated = millis();
+    entry->valid = (gps.sendCommand(&customCfg, maxWait) == SFE_UBLOX_STATUS_DATA_RECEIVED);
+    entry->len = entry->valid ? min(customCfg.len, UBX_CACHE_PAYLOAD) : 0;
+    if(entry->valid) memcpy(entry->payload, ubxBuffer, UBX_CACHE_PAYLOAD);
+    else memset(entry->payload, 0, UBX_CACHE_PAYLOAD); //Callers read fields regardless of result, make sure they see zeros
+    payload = entry->payload;
+    return entry->valid;
+}
+
+void Kestrel::clearUbxCache()
+{
+    for(int i = 0; i < UBX_CACHE_SIZE; i++) ubxCache[i].valid = false;
 }
 
 bool Kestrel::connectToCell()
@@ -662,18 +1300,114 @@ bool Kestrel::enablePower(uint8_t port, bool state)
     }
     if(port == 0 || port > numTalonPorts) throwError(KESTREL_PORT_RANGE_FAIL | portErrorCode);
     else {
-        bool obState = enableI2C_OB(true);
-        bool globState = enableI2C_Global(false);
+        I2CRoute route(*this); //Turn off external I2C and turn on internal I2C until return
         // Wire.reset(); //DEBUG!
-        ioTalon.pinMode(PinsTalon::EN[port - 1], OUTPUT);
-        ioTalon.digitalWrite(PinsTalon::EN[port - 1], state);
-        enableI2C_Global(globState); //Return to previous state
-        enableI2C_OB(obState);
+        float before = 0; //Load of the ports already on
+        bool bulkRead = updateBulkEnergy(before); //Close the energy interval for the ports powered until now
+        writeExpanderPin(talonShadow, PinsTalon::EN[port - 1], state);
+        unsigned long start = micros(); //Rail is on once the expander write completes
+        if(state && inrushDuration > 0 && port <= INRUSH_PORTS) {
+            if(!(csaBetaEnabled & (1 << INRUSH_CHANNEL[port - 1]))) inrush[port - 1] = InrushSummary(); //Channel is not converting, nothing to capture
+            else captureInrush(port, start, bulkRead ? before : 0);
+        }
     }
     
     return false; //DEBUG!
 }
 
+void Kestrel::setInrushCapture(uint16_t duration)
+{
+    inrushDuration = duration > INRUSH_MAX_DURATION ? INRUSH_MAX_DURATION : duration;
+}
+
+bool Kestrel::readCsaWord(uint8_t adr, uint8_t reg, uint16_t &val)
+{
+    Wire.beginTransmission(adr);
+    Wire.write(reg);
+    if(Wire.endTransmission(false) != 0) return false;
+    if(Wire.requestFrom(adr, (uint8_t)2) != 2) return false;
+    val = Wire.read() << 8;
+    val |= Wire.read();
+    return true;
+}
+
+bool Kestrel::captureInrush(uint8_t port, unsigned long start, float before)
+{
+    //Runs at csaBeta's 1024 SPS, one sample per conversion cycle. Each refresh latches the last conversion, which can be read 1ms later, so read and next refresh are pipelined.
+    //Bus voltage is only read once at the end, energy assumes the rail holds its voltage through the inrush
+    InrushSummary &result = inrush[port - 1];
+    result = InrushSummary();
+    result.before = before;
+    uint8_t ch = INRUSH_CHANNEL[port - 1];
+    bool bidir = CSA_BETA_BIDIR & (1 << ch);
+    float scale = (0.1/(CSA_BETA_SENSE[ch]/1000.0))/(bidir ? 32768.0 : 65536.0); //[A] per count, 100mV full scale
+    unsigned long window = inrushDuration*1000UL; //[us]
+    inrushHead = 0;
+    inrushCount = 0;
+    double charge = 0; //[C]
+    unsigned long lastTime = 0;
+
+    Wire.beginTransmission(CSA_BETA_ADR);
+    Wire.write(CSA_REFRESH_V); //Refresh without clearing accumulators, energy accounting is unaffected
+    if(Wire.endTransmission() != 0) return false;
+    unsigned long refreshed = micros();
+    while(micros() - start < window) {
+        while(micros() - refreshed < 1000); //Wait for refreshed registers
+        uint16_t raw = 0;
+        bool ok = readCsaWord(CSA_BETA_ADR, CSA_VSENSE + ch, raw);
+        unsigned long sampleTime = refreshed - start; //Values were latched at refresh
+        Wire.beginTransmission(CSA_BETA_ADR);
+        Wire.write(CSA_REFRESH_V);
+        if(Wire.endTransmission() != 0 || !ok) return false;
+        refreshed = micros();
+
+        float current = (bidir ? (int16_t)raw*scale : raw*scale) - before; //Bulk rail also carries the ports already on
+        if(result.samples == 0 || current > result.peak) {
+            result.peak = current;
+            result.peakTime = sampleTime;
+        }
+        charge += current*(sampleTime - lastTime)/1000000.0; //Rectangle from last sample, first one covers time since enable
+        lastTime = sampleTime;
+        result.samples++;
+        inrushRaw[inrushHead] = raw;
+        inrushTime[inrushHead] = sampleTime;
+        inrushHead = (inrushHead + 1) % INRUSH_SAMPLES; //Keep most recent, the tail is what settle time needs
+        if(inrushCount < INRUSH_SAMPLES) inrushCount++;
+    }
+    if(inrushCount == 0) return false;
+    while(micros() - refreshed < 1000);
+    uint16_t vbus = 0;
+    if(!readCsaWord(CSA_BETA_ADR, CSA_VBUS + ch, vbus)) return false;
+    result.energy = charge*32.0*vbus/65536.0; //32V full scale
+
+    uint8_t finalSamples = inrushCount < INRUSH_FINAL_SAMPLES ? inrushCount : INRUSH_FINAL_SAMPLES;
+    float sum = 0;
+    for(int i = 1; i <= finalSamples; i++) {
+        uint16_t raw = inrushRaw[(inrushHead + INRUSH_SAMPLES - i) % INRUSH_SAMPLES];
+        sum += (bidir ? (int16_t)raw*scale : raw*scale) - before;
+    }
+    result.final = sum/finalSamples;
+    float band = fabs(result.final)*INRUSH_SETTLE_BAND;
+    if(band < INRUSH_SETTLE_FLOOR) band = INRUSH_SETTLE_FLOOR;
+    uint16_t oldest = (inrushHead + INRUSH_SAMPLES - inrushCount) % INRUSH_SAMPLES;
+    result.settleTime = inrushTime[oldest]; //If every retained sample is in band, settled no later than the oldest one
+    result.settled = true;
+    for(int i = 1; i <= inrushCount; i++) { //Walk back from newest to the last sample outside the band
+        uint16_t index = (inrushHead + INRUSH_SAMPLES - i) % INRUSH_SAMPLES;
+        float current = (bidir ? (int16_t)inrushRaw[index]*scale : inrushRaw[index]*scale) - before;
+        if(fabs(current - result.final) > band) {
+            if(i == 1) { //Still outside at the end of the window
+                result.settled = false;
+                result.settleTime = window;
+            }
+            else result.settleTime = inrushTime[(index + 1) % INRUSH_SAMPLES];
+            break;
+        }
+    }
+    result.valid = true;
+    return true;
+}
+
 bool Kestrel::enableData(uint8_t port, bool state)
 {
     //FIX! Throw error is port out of range
@@ -684,16 +1418,12 @@ bool Kestrel::enableData(uint8_t port, bool state)
     }
     if(port == 0 || port > numTalonPorts) throwError(KESTREL_PORT_RANGE_FAIL | portErrorCode);
     else {
-        bool obState = enableI2C_OB(true);
-        bool globState = enableI2C_Global(false);
+        I2CRoute route(*this); //Turn off external I2C and turn on internal I2C until return
         // Wire.reset(); //DEBUG!
         // ioTalon.pinMode(PinsTalon::SEL[port - 1], OUTPUT);
         // ioTalon.digitalWrite(PinsTalon::SEL[port - 1], LOW); //DEBUG!
-        ioTalon.pinMode(PinsTalon::I2C_EN[port - 1], OUTPUT);
-        ioTalon.digitalWrite(PinsTalon::I2C_EN[port - 1], state);
+        writeExpanderPin(talonShadow, PinsTalon::I2C_EN[port - 1], state);
         // Serial.println(PinsTalon::I2C_EN[port - 1]); //DEBUG!
-        enableI2C_Global(globState); //Return to previous state
-        enableI2C_OB(obState);
     }
     
     return false; //DEBUG!
@@ -708,16 +1438,12 @@ bool Kestrel::setDirection(uint8_t port, bool sel)
     }
     if(port == 0 || port > numTalonPorts) throwError(KESTREL_PORT_RANGE_FAIL | portErrorCode);
     else {
-        bool obState = enableI2C_OB(true);
-        bool globState = enableI2C_Global(false);
+        I2CRoute route(*this); //Turn off external I2C and turn on internal I2C until return
         // Wire.reset(); //DEBUG!
-        ioTalon.pinMode(PinsTalon::SEL[port - 1], OUTPUT);
-        ioTalon.digitalWrite(PinsTalon::SEL[port - 1], sel); //DEBUG!
+        writeExpanderPin(talonShadow, PinsTalon::SEL[port - 1], sel); //DEBUG!
         // ioTalon.pinMode(PinsTalon::I2C_EN[port - 1], OUTPUT);
         // ioTalon.digitalWrite(PinsTalon::I2C_EN[port - 1], state);
         // Serial.println(PinsTalon::I2C_EN[port - 1]); //DEBUG!
-        enableI2C_Global(globState); //Return to previous state
-        enableI2C_OB(obState);
     }
     
     return false; //DEBUG!
@@ -731,12 +1457,9 @@ bool Kestrel::getFault(uint8_t port)
     if(port == 0 || port > numTalonPorts) throwError(KESTREL_PORT_RANGE_FAIL | portErrorCode);
     else {
         bool state = true;
-        bool globState = enableI2C_Global(false);
-        bool obState = enableI2C_OB(true);
+        I2CRoute route(*this); //Turn off external I2C and turn on internal I2C until return
         if(ioTalon.digitalRead(PinsTalon::EN[port - 1]) == HIGH) state = false; //If fault line is high, return false for no fault 
         else state = true; //If there is a read failure or otherwise unable to read, assume a fault
-        enableI2C_Global(globState); //Return to previous state
-        enableI2C_OB(obState);
         return state;
     }
     return true;
@@ -745,86 +1468,184 @@ bool Kestrel::getFault(uint8_t port)
 
 bool Kestrel::enableI2C_OB(bool state)
 {
-    bool currentState = digitalRead(Pins::I2C_OB_EN); 
+    bool currentState = routeOBKnown ? routeOB : digitalRead(Pins::I2C_OB_EN); //Only read back pin until driver has taken control of it
+    if(routeOBKnown && currentState == state) { //Already routed as requested, skip the pin write
+        routeWritesSaved++;
+        return currentState;
+    }
     pinMode(Pins::I2C_OB_EN, OUTPUT);
 	digitalWrite(Pins::I2C_OB_EN, state);
+    routeOB = state;
+    routeOBKnown = true;
+    routeWrites++;
     // Wire.reset(); //DEBUG!
     return currentState; 
 }
 
 bool Kestrel::enableI2C_Global(bool state)
 {
-    bool currentState = digitalRead(Pins::I2C_GLOBAL_EN); 
+    bool currentState = routeGlobalKnown ? routeGlobal : digitalRead(Pins::I2C_GLOBAL_EN); //Only read back pin until driver has taken control of it
+    if(routeGlobalKnown && currentState == state) { //Already routed as requested, skip the pin write
+        routeWritesSaved++;
+        return currentState;
+    }
     pinMode(Pins::I2C_GLOBAL_EN, OUTPUT);
 	digitalWrite(Pins::I2C_GLOBAL_EN, state);
+    routeGlobal = state;
+    routeGlobalKnown = true;
+    routeWrites++;
     // Wire.reset(); //DEBUG!
     return currentState; 
 }
 
 bool Kestrel::enableI2C_External(bool state)
 {
-    bool globState = enableI2C_Global(false);
-	bool obState = enableI2C_OB(true);
+    I2CRoute route(*this); //Turn off external I2C and turn on internal I2C until return
 	//Turn on external I2C port
-    bool currentState = ioOB.digitalRead(PinsOB::I2C_EXT_EN);
-	ioOB.pinMode(PinsOB::I2C_EXT_EN, OUTPUT);
-	ioOB.digitalWrite(PinsOB::I2C_EXT_EN, state);
-    enableI2C_Global(globState); //Return to previous state
-    enableI2C_OB(obState);
+    bool currentState = readExpanderPin(obShadow, ioOB, PinsOB::I2C_EXT_EN);
+	writeExpanderPin(obShadow, PinsOB::I2C_EXT_EN, state);
     return currentState; //DEBUG! How to return failure? Don't both and just throw error??
 }
 
 bool Kestrel::disablePowerAll()
 {
-    for(int i = 1; i <= 5; i++) {
-        enablePower(i, false);
-    }
+    uint16_t mask = 0;
+    for(size_t i = 0; i < sizeof(PinsTalon::EN); i++) mask = mask | (1 << PinsTalon::EN[i]); //Gather all power enables, port 5 has no power control
+    I2CRoute route(*this); //Turn off external I2C and turn on internal I2C until return
+    writeTalonBus(mask, 0); //Turn off all ports in a single write
     return false; //DEBUG!
 }
 
 bool Kestrel::disableDataAll()
 {
-    for(int i = 1; i <= 5; i++) {
-        enableData(i, false);
-    }
+    uint16_t mask = 0;
+    for(size_t i = 0; i < sizeof(PinsTalon::I2C_EN); i++) mask = mask | (1 << PinsTalon::I2C_EN[i]); //Gather all data enables for Talon ports
+    I2CRoute route(*this); //Turn off external I2C and turn on internal I2C until return
+    writeTalonBus(mask, 0); //Turn off all ports in a single write
+    enableData(5, false); //Port 5 data is the external I2C port on the OB expander
     return 0; //DEBUG!
 }
 
+bool Kestrel::writeTalonBus(uint16_t mask, uint16_t state)
+{
+    uint16_t powerMask = 0;
+    for(size_t i = 0; i < sizeof(PinsTalon::EN); i++) powerMask = powerMask | (1 << PinsTalon::EN[i]);
+    if(!talonShadow.valid || ((talonShadow.output ^ state) & mask & powerMask)) { //Ports powered are changing, close the energy interval for the ones on until now (as enablePower)
+        I2CRoute route(*this); //Turn off external I2C and turn on internal I2C until return
+        float current = 0;
+        updateBulkEnergy(current);
+    }
+    return writeExpander(talonShadow, mask, state);
+}
+
+bool Kestrel::writeOBBus(uint16_t mask, uint16_t state)
+{
+    return writeExpander(obShadow, mask, state);
+}
+
+bool Kestrel::loadExpander(ExpanderShadow &io)
+{
+    const uint8_t regs[4] = {EXPANDER_OUTPUT_REG, EXPANDER_CONFIG_REG, EXPANDER_PULL_ENABLE_REG, EXPANDER_PULL_SELECT_REG};
+    uint16_t vals[4] = {0};
+    for(int r = 0; r < 4; r++) { //Read output, config and pull register pairs 
+        expanderOps++;
+        Wire.beginTransmission(io.adr);
+        Wire.write(regs[r]);
+        if(Wire.endTransmission(false) != 0) {
+            io.valid = false;
+            return false; //Leave shadow invalid so next write retries the load
+        }
+        if(Wire.requestFrom(io.adr, (uint8_t)2) != 2) {
+            io.valid = false;
+            return false;
+        }
+        vals[r] = Wire.read(); //Port 0 is low byte
+        vals[r] = vals[r] | (Wire.read() << 8); //Port 1 is high byte
+    }
+    io.output = vals[0];
+    io.config = vals[1];
+    io.pullEnable = vals[2];
+    io.pullSelect = vals[3];
+    io.valid = true;
+    return true;
+}
+
+bool Kestrel::writeExpanderReg(ExpanderShadow &io, uint8_t reg, uint16_t &shadow, uint16_t val)
+{
+    //Write a register pair only if it differs from the shadow copy
+    if(val == shadow) return true;
+    expanderOps++;
+    Wire.beginTransmission(io.adr);
+    Wire.write(reg);
+    Wire.write(val & 0xFF);
+    Wire.write(val >> 8);
+    if(Wire.endTransmission() != 0) {
+        io.valid = false; //Unknown state of device, force reload
+        return false;
+    }
+    shadow = val;
+    return true;
+}
+
+bool Kestrel::writeExpander(ExpanderShadow &io, uint16_t mask, uint16_t state)
+{
+    //Drives all pins in mask as outputs with the matching bits of state, only touching registers which actually change 
+    if(!io.valid && !loadExpander(io)) return false; 
+    if(!writeExpanderReg(io, EXPANDER_OUTPUT_REG, io.output, (io.output & ~mask) | (state & mask))) return false; //Set output levels first so pins do not glitch when switched to outputs
+    return writeExpanderReg(io, EXPANDER_CONFIG_REG, io.config, io.config & ~mask); //Clear config bit to make pin an output
+}
+
+bool Kestrel::inputExpander(ExpanderShadow &io, uint16_t mask, bool pullup)
+{
+    //Releases all pins in mask to inputs with the pull resistor selected (pull-up or pull-down), only touching registers which actually change 
+    if(!io.valid && !loadExpander(io)) return false; 
+    if(!writeExpanderReg(io, EXPANDER_PULL_SELECT_REG, io.pullSelect, pullup ? (io.pullSelect | mask) : (io.pullSelect & ~mask))) return false;
+    if(!writeExpanderReg(io, EXPANDER_PULL_ENABLE_REG, io.pullEnable, io.pullEnable | mask)) return false; //Pull in place before pin floats
+    return writeExpanderReg(io, EXPANDER_CONFIG_REG, io.config, io.config | mask); //Set config bit to make pin an input
+}
+
+bool Kestrel::writeExpanderPin(ExpanderShadow &io, uint8_t pin, bool state)
+{
+    return writeExpander(io, 1 << pin, state ? (1 << pin) : 0);
+}
+
+int Kestrel::readExpanderPin(ExpanderShadow &io, PCAL9535A &dev, uint8_t pin)
+{
+    if(!io.valid) loadExpander(io);
+    if(io.valid && (io.config & (1 << pin)) == 0) return (io.output >> pin) & 0x01; //If pin is a known output, report driven state without a bus read
+    return dev.digitalRead(pin); //Otherwise read the actual pin level
+}
+
 bool Kestrel::enableSD(bool state)
 {
-    bool globState = enableI2C_Global(false);
-	bool obState = enableI2C_OB(true);
-    bool currentState = ioOB.digitalRead(PinsOB::SD_EN);
+    I2CRoute route(*this); //Turn off external I2C and turn on internal I2C until return
+    bool currentState = readExpanderPin(obShadow, ioOB, PinsOB::SD_EN);
     if(state) {
         enableAuxPower(true); //Make sure Aux power is on
-        ioOB.pinMode(PinsOB::SD_EN, OUTPUT);
-        ioOB.digitalWrite(PinsOB::SD_EN, HIGH);
+        writeExpanderPin(obShadow, PinsOB::SD_EN, HIGH);
     }
     else if(!state) {
-        ioOB.pinMode(PinsOB::SD_EN, OUTPUT);
-        ioOB.digitalWrite(PinsOB::SD_EN, LOW);
+        writeExpanderPin(obShadow, PinsOB::SD_EN, LOW);
     }
-    enableI2C_Global(globState); //Return to previous state
-    enableI2C_OB(obState);
     return currentState; //DEBUG! How to return failure? Don't both and just throw error??
 }
 
 bool Kestrel::sdInserted()
 {
-    ioOB.pinMode(PinsOB::SD_CD, INPUT_PULLUP);
-    if(ioOB.digitalRead(PinsOB::SD_CD) == LOW) return true; //If switch is closed, return true
+    inputExpander(obShadow, 1 << PinsOB::SD_CD, true); //Card detect switch to ground, pulled up
+    if(readExpanderPin(obShadow, ioOB, PinsOB::SD_CD) == LOW) return true; //If switch is closed, return true
     else return false; //Otherwise it is not inserted 
 }
 
 bool Kestrel::enableAuxPower(bool state)
 {
-    bool globState = enableI2C_Global(false);
-	bool obState = enableI2C_OB(true);
-    bool currentState = ioOB.digitalRead(PinsOB::AUX_EN);
-    ioOB.pinMode(PinsOB::AUX_EN, OUTPUT);
-    ioOB.digitalWrite(PinsOB::AUX_EN, state); 
-    enableI2C_Global(globState); //Return to previous state
-    enableI2C_OB(obState);
+    I2CRoute route(*this); //Turn off external I2C and turn on internal I2C until return
+    bool currentState = readExpanderPin(obShadow, ioOB, PinsOB::AUX_EN);
+    writeExpanderPin(obShadow, PinsOB::AUX_EN, state); 
+    if(!state) {
+        setGpsPowerState(GpsPower::OFF); //GPS is powered from aux rail
+        sensors[OnboardSensor::ALS].ready = false; //So is the ALS, it loses its configuration
+    }
     return currentState; //DEBUG! How to return failure? Don't both and just throw error??
 }
 
@@ -835,18 +1656,13 @@ uint8_t Kestrel::updateTime()
     static uint8_t timeSource = syncTime();
     static time_t lastRunTime = millis();
 
-    if((millis() - lastRunTime) > 60000) { //Only sync time if it has been more than 60 seconds since last synchronization
+    if((millis() - lastRunTime) > getSyncInterval()*1000UL) { //Only sync once the drift model says the clocks may have wandered, at most every 60 seconds
         timeSource = syncTime(); 
         lastRunTime = millis();
     }
     // if(Time.isValid()) { //If particle time is valid, set from this
     currentDateTime.source = timeSource; //sync time and record source of current time
-    currentDateTime.year = Time.year();
-    currentDateTime.month = Time.month();
-    currentDateTime.day = Time.day();
-    currentDateTime.hour = Time.hour();
-    currentDateTime.minute = Time.minute();
-    currentDateTime.second = Time.second();
+    CivilTime::fromUnix(Time.now(), currentDateTime); //One conversion, consistent even if the second rolls over mid update
     
     return currentDateTime.source; //debug!
     // }
@@ -863,32 +1679,29 @@ uint8_t Kestrel::updateTime()
     // return false;
 }
 
-uint8_t Kestrel::syncTime(bool force)
+bool Kestrel::startTimeSync(bool force)
 {
-    //Synchronize time across GPS, Cell and RTC
+    //Begin synchronizing time across GPS, Cell and RTC. Local sources are read immediately, remote sources are advanced by pollTimeSync()
+    if(syncStatus == SyncStatus::IN_PROGRESS) { //Only one sync can be in flight, fold request into the current one
+        syncForce = syncForce || force;
+        return false;
+    }
     Serial.println("TIME SYNC!"); //DEBUG!
     // Timestamp t = getRawTime(); //Get updated time
-    bool currentAux = enableAuxPower(true);
-    bool currentGlob = enableI2C_Global(false);
-    bool currentOB = enableI2C_OB(true);
-    
-    // bool timeGood = true; //Result of time testing to see if time matches, assume the time is valid to start with 
-    timeGood = true; //Assume good and clear if any deviation 
+    syncStatus = SyncStatus::IN_PROGRESS;
+    syncForce = force;
+    syncAuxState = enableAuxPower(true);
+    I2CRoute route(*this); //Turn off external I2C and turn on internal I2C until return
 
-    time_t gpsTime = 0;
-    time_t gpsSatTime = 0;
     time_t cellTime = 0;
     time_t rtcTime = 0;
     
-    static time_t previousTime = 0; //Init to current time to throw warnings on startup, etc
-    static unsigned long previousMillis = 0; //Init to current time to throw warnings on startup, etc
-    
-    
     //Grab Particle RTC time and expected time from millis delta
-    time_t particleTime = Time.isValid() ? Time.now() : 0; //Set to current time if valid, if not, set to 0
-    times[numClockSources - 1] = particleTime; //Grab current particle RTC time
+    syncParticleTime = Time.isValid() ? Time.now() : 0; //Set to current time if valid, if not, set to 0
+    times[numClockSources - 1] = syncParticleTime; //Grab current particle RTC time
+    sourceCaptured[numClockSources - 1] = millis();
 
-    if(particleTime == 0) throwError(CLOCK_UNAVAILABLE); //If time is not valid, throw system wide error for base clock
+    if(syncParticleTime == 0) throwError(CLOCK_UNAVAILABLE); //If time is not valid, throw system wide error for base clock
     
     
     Serial.print("Timebase Start: "); //DEBUG!
@@ -911,64 +1724,95 @@ uint8_t Kestrel::syncTime(bool force)
         Serial.println(cellTime);  
         sourceAvailable[TimeSource::RTC] = true;
         times[TimeSource::RTC] = rtcTime; //Grab last time
+        sourceCaptured[TimeSource::RTC] = millis();
     }
     /////////// INCREMENT TIME ///////////////////
-    unsigned long deltaTime = millis() - previousMillis; //Calculate delta time since last call
+    unsigned long deltaTime = millis() - syncPreviousMillis; //Calculate delta time since last call
     deltaTime = deltaTime/1000; //Convert to seconds - Do this as seperate process to make sure rollover math works correclty 
     sourceRequested[TimeSource::INCREMENT] = true; 
-    if(previousTime == 0 || previousMillis == 0) sourceAvailable[TimeSource::INCREMENT] = false; //If set for the first time or not incremented, ignore
+    if(syncPreviousTime == 0 || syncPreviousMillis == 0) sourceAvailable[TimeSource::INCREMENT] = false; //If set for the first time or not incremented, ignore
     else sourceAvailable[TimeSource::INCREMENT] = true;
-    times[TimeSource::INCREMENT] = previousTime + deltaTime; //The expected time is the delta added to the last time recorded 
+    times[TimeSource::INCREMENT] = syncPreviousTime + deltaTime; //The expected time is the delta added to the last time recorded 
+    sourceCaptured[TimeSource::INCREMENT] = syncPreviousMillis + deltaTime*1000; //Whole seconds counted so far, the remainder is added at finish
     
     /////////// CELL TIME //////////////////
     sourceRequested[TimeSource::CELLULAR] = true;
     if(Particle.connected()) { //Only enter if there is not already a sync pending 
         timeSyncRequested = true;
         Particle.syncTime();
-        // waitFor(Particle.syncTimePending, 500); //Wait up to 0.5 seconds for system to assert a syncTime
-        // waitFor(Particle.syncTimeDone, 10000); //Wait until sync is done, at most 10 seconds //FIX!
-        // unsigned long localTime = millis();
-        // while(Particle.syncTimePending() && (millis() - localTime) < 10000) Particle.process(); //Process command while waiting for sync to finish or timeout 
-        // waitFor(Particle.syncTimePending, 10000); //Wait until sync is done, at most 10 seconds
-        waitFor(Particle.syncTimePending, 500); //Wait up to 0.5 seconds for system to assert a syncTime
-        waitFor(Particle.syncTimeDone, 10000); //Wait until sync is done, at most 10 seconds //FIX!
+        syncCellRequested = millis();
+        syncCellLeg = CELL_WAIT_PENDING; //Wait up to 0.5 seconds for system to assert a syncTime
+        syncCellStart = millis();
+    }
+    else {
+        sourceAvailable[TimeSource::CELLULAR] = false;
+        times[TimeSource::CELLULAR] = 0; //Clear if not updated
+        throwError(CLOCK_UNAVAILABLE | 0x06); //OR with Cell indicator 
+        syncCellLeg = LEG_DONE;
+    }
+
+    ////////// GPS TIME ///////////////////
+    //Perform wakeup in case switched off already
+    gpsWakeStart(); 
+    syncGpsLeg = GPS_WAKING;
+    return true;
+}
+
+uint8_t Kestrel::pollTimeSync()
+{
+    if(syncStatus != SyncStatus::IN_PROGRESS) return syncStatus; //Nothing to advance
+    if(syncCellLeg != LEG_DONE) pollCellSync();
+    if(syncGpsLeg == GPS_ANCHOR) pollGpsAnchor();
+    else if(syncGpsLeg != LEG_DONE) pollGpsSync();
+    if(syncCellLeg == LEG_DONE && syncGpsLeg == LEG_DONE && syncStatus == SyncStatus::IN_PROGRESS) { //Once all remote sources are in, evaluate consensus
+        syncSource = finishTimeSync();
+        syncStatus = SyncStatus::DONE;
+    }
+    return syncStatus;
+}
+
+void Kestrel::pollCellSync()
+{
+    if(syncCellLeg == CELL_WAIT_PENDING) {
+        if(Particle.syncTimePending() || (millis() - syncCellStart) >= 500) { //Move on once sync asserted, or after 0.5 seconds
+            syncCellLeg = CELL_WAIT_DONE;
+            syncCellStart = millis();
+        }
+        return;
+    }
+    if(syncCellLeg == CELL_WAIT_DONE) {
+        if(!Particle.syncTimeDone() && (millis() - syncCellStart) < 10000) return; //Wait until sync is done, at most 10 seconds //FIX!
         if(Particle.syncTimeDone()) { //Make sure sync time was actually completed 
             Time.zone(0); //Set to UTC 
-            cellTime = Time.now();
+            time_t cellTime = Time.now();
             // timeSyncRequested = false; //Release control of time sync override 
             Serial.print("Cell Time: "); 
             Serial.println(cellTime);
             sourceAvailable[TimeSource::CELLULAR] = true; 
             times[TimeSource::CELLULAR] = Time.now(); //Grab last time
+            sourceCaptured[TimeSource::CELLULAR] = millis();
+            unsigned long latency = millis() - syncCellRequested; //Server stamped the time somewhere between the request and now, Device OS set it on arrival so it runs behind by up to this
+            setAnchor(times[TimeSource::CELLULAR], CELL_ANCHOR_ERROR + latency/2, millis(), CELL_ANCHOR_ERROR + (latency + 1)/2, TimeSource::CELLULAR); //Phase within the second and the latency are unknown, take the middle
         }
         else {
             sourceAvailable[TimeSource::CELLULAR] = false;
             times[TimeSource::CELLULAR] = 0;
             throwError(CLOCK_UNAVAILABLE | 0x106); //OR with Cell indicator 
         }
-        // timeSyncRequested = false; //Release control of time sync override 
-        
-    }
-    else {
-        sourceAvailable[TimeSource::CELLULAR] = false;
-        times[TimeSource::CELLULAR] = 0; //Clear if not updated
-        throwError(CLOCK_UNAVAILABLE | 0x06); //OR with Cell indicator 
+        syncCellLeg = LEG_DONE;
     }
+}
 
-    ////////// GPS TIME ///////////////////
-    uint8_t customPayload[MAX_PAYLOAD_SIZE]; // This array holds the payload data bytes. MAX_PAYLOAD_SIZE defaults to 256. The CFG_RATE payload is only 6 bytes!
-    // bool currentAux = enableAuxPower(true);
-    // bool currentGlob = enableI2C_Global(false);
-    // bool currentOB = enableI2C_OB(true);
-    //Perform wakeup in case switched off already
-    Serial.println("Wake GPS"); //DEBUG!
-    ioOB.pinMode(PinsOB::GPS_INT, OUTPUT); //Turn GPS back on by toggling int pin
-    ioOB.digitalWrite(PinsOB::GPS_INT, LOW);
-    delay(1000);
-    ioOB.digitalWrite(PinsOB::GPS_INT, HIGH);
-    delay(1000);
-    ioOB.digitalWrite(PinsOB::GPS_INT, LOW);
-    delay(1000);
+void Kestrel::pollGpsSync()
+{
+    if(gpsPollWake() == GpsPower::WAKING) return; //Wake pulse still in progress
+    I2CRoute route(*this); //Turn off external I2C and turn on internal I2C until return
+    syncGpsLeg = LEG_DONE; //Mark done before reading, the read is only attempted once
+    time_t gpsTime = 0;
+    unsigned long gpsCaptured = millis();
+    unsigned long timePollStart = millis();
+    const uint8_t *customPayload = ubxEmptyPayload; //Points into UBX cache once polled, all zero until then
+    const uint8_t *statusPayload = ubxEmptyPayload;
     // gps.begin();
     if(gps.begin() == false) {
         // throwError(GPS_INIT_FAIL); //DEBUG!
@@ -985,19 +1829,13 @@ uint8_t Kestrel::syncTime(bool force)
     // else {
         sourceRequested[TimeSource::GPS] = true;
         gps.setI2COutput(COM_TYPE_UBX); //Set the I2C port to output UBX only (turn off NMEA noise)
-        
-        gps.setPacketCfgPayloadSize(MAX_PAYLOAD_SIZE);
-        ubxPacket customCfg = {0, 0, 0, 0, 0, customPayload, 0, 0, SFE_UBLOX_PACKET_VALIDITY_NOT_DEFINED, SFE_UBLOX_PACKET_VALIDITY_NOT_DEFINED};
-        customCfg.cls = UBX_CLASS_NAV; // This is the message Class
-        // customCfg.id = UBX_NAV_TIMELS; // This is the message ID
-        customCfg.id = UBX_NAV_TIMEUTC; // This is the message ID
-        customCfg.len = 0; // Setting the len (length) to zero let's us poll the current settings
-        customCfg.startingSpot = 0; // Always set the startingSpot to zero (unless you really know what you are doing)
-        uint16_t maxWait = 1500; // Wait for up to 250ms (Serial may need a lot longer e.g. 1100)
-        if (gps.sendCommand(&customCfg, maxWait) != SFE_UBLOX_STATUS_DATA_RECEIVED) {
+        timePollStart = millis();
+        if (!pollUbx(UBX_CLASS_NAV, UBX_NAV_TIMEUTC, customPayload, 0)) { //Never reuse a time payload, a cached one is late by its age
             Serial.println("GPS READ FAIL"); //DEBUG!
             throwError(GPS_READ_FAIL); // We are expecting data and an ACK, throw error otherwise
         }
+        gpsCaptured = millis();
+        if (!pollUbx(UBX_CLASS_NAV, UBX_NAV_STATUS, statusPayload, 0)) throwError(GPS_READ_FAIL); //Fix state must be current to qualify GPS time, the diagnostic reuses it for TTFF
         // Serial.print("GPS UTC Seconds: "); //DEBUG!
         // Serial.println(customPayload[18]);
         Serial.print("GPS UTC Validity: "); //DEBUG!
@@ -1036,8 +1874,8 @@ uint8_t Kestrel::syncTime(bool force)
         // Serial.println(gps.getSecond());
     }
     // if(gps.getDateValid() && gps.getTimeValid() && gps.getTimeFullyResolved()) {
-    uint8_t fixType = gps.getFixType();
-    bool gnssFix = gps.getGnssFixOk();
+    uint8_t fixType = statusPayload[4]; //NAV-STATUS gpsFix
+    bool gnssFix = statusPayload[5] & 0x01; //gpsFixOk
     if((customPayload[19] & 0x0F) == 0x07 && (fixType >= 2 && fixType <= 4 && gnssFix)) { //Check if all times are valid AND fix is valid
         // struct tm timeinfo = {0}; //Create struct in C++ time land
 
@@ -1055,6 +1893,8 @@ uint8_t Kestrel::syncTime(bool force)
         sourceAvailable[TimeSource::GPS_RTC] = true; //By default
         times[TimeSource::GPS] = gpsTime; //Grab last time
         times[TimeSource::GPS_RTC] = gpsTime; //Grab last time
+        sourceCaptured[TimeSource::GPS] = sourceCaptured[TimeSource::GPS_RTC] = gpsCaptured;
+        if(getPreciseTime().error > ANCHOR_REFRESH_ERROR) startGpsAnchor(customPayload, timePollStart); //Waits up to one navigation period over the next steps, only when needed
     }
     else if((customPayload[19] & 0x0F) == 0x07 && !(fixType >= 2 && fixType <= 4 && gnssFix)) { //RTC is good, but not active fix
         gpsTime = cstToUnix((customPayload[12] | (customPayload[13] << 8)), customPayload[14], customPayload[15], customPayload[16], customPayload[17], customPayload[18]); //Convert current time to Unix time
@@ -1063,6 +1903,7 @@ uint8_t Kestrel::syncTime(bool force)
         sourceAvailable[TimeSource::GPS] = false;
         sourceAvailable[TimeSource::GPS_RTC] = true;
         times[TimeSource::GPS_RTC] = gpsTime; //Grab last time
+        sourceCaptured[TimeSource::GPS_RTC] = gpsCaptured;
     }
     else {
         sourceAvailable[TimeSource::GPS] = false;
@@ -1071,18 +1912,30 @@ uint8_t Kestrel::syncTime(bool force)
         times[TimeSource::GPS_RTC]  = 0;
         throwError(CLOCK_UNAVAILABLE | 0x08 | (customPayload[19] << 8)); //OR with GPS indicator, OR with validity payload 
     }
+}
+
+uint8_t Kestrel::finishTimeSync()
+{
+    I2CRoute route(*this); //Turn off external I2C and turn on internal I2C until return
+    ////////////////////////////////// BRING SOURCES TO ONE INSTANT ////////////////////////////////////////////
+    unsigned long finishMillis = millis();
+    for(int i = 0; i < numClockSources; i++) { //Local clocks are read at start, remote results arrive up to seconds later, age each to now
+        if(times[i] != 0) times[i] += (finishMillis - sourceCaptured[i] + 500)/1000;
+    }
+    if(syncParticleTime != 0) syncParticleTime = times[numClockSources - 1]; //What the local clock would read now, the cell sync may already have set it
 
     ////////////////////////////////// TEST VALIDITY OF CURRENT TIME ////////////////////////////////////////////
+    bool syncTimeGood = true; //Assume good and clear if any deviation, only committed to timeGood below
     for(int i = 0; i < numClockSources; i++) {
-        if(sourceAvailable[i] == true && abs(particleTime - times[i]) > maxTimeError) {
+        if(sourceAvailable[i] == true && abs(syncParticleTime - times[i]) > maxTimeError) {
             throwError(TIME_DISAGREE);
-            timeGood = false; //Clear flag if any of the available times disagree with the current time
+            syncTimeGood = false; //Clear flag if any of the available times disagree with the current time
         }
     }
 
     /////////////////////////// EVALUATE TIME FIX FROM TIME SET ////////////////////////////////
     uint8_t newTimeFix = 0;
-    if(timeGood) { //Only do if time is alredy valid
+    if(syncTimeGood) { //Only do if time is alredy valid
         if(sourceAvailable[TimeSource::GPS] == true && sourceAvailable[TimeSource::CELLULAR] == true) newTimeFix = 4; //If both remote time sources are present, best fix
         else if(sourceAvailable[TimeSource::GPS] == true || sourceAvailable[TimeSource::CELLULAR] == true) newTimeFix = 3; //If only ONE of the remote sources is present, level 3 fix
         else if(sourceAvailable[TimeSource::GPS_RTC] == true || sourceAvailable[TimeSource::RTC] == true) newTimeFix = 2; //If only local source present, level 2 fix
@@ -1097,50 +1950,50 @@ uint8_t Kestrel::syncTime(bool force)
 
     //////////////////////////// SET TIME ////////////////////////////
     uint8_t source = 0; 
-    if(timeGood == false || force == true || newTimeFix > timeFix) { //If there is an error in time, go to set time, or if the new time availability is better than the last sync time 
+    ClockConsensus consensus;
+    for(int i = 0; i < (numClockSources - 1); i++) { //Set options do not include current time itself
+        if(sourceAvailable[i] == true) consensus.add(i, times[i], maxTimeError/2, sourceWeight[i]); //Two sources agree when less than maxTimeError apart
+    }
+    uint8_t loneRemote = TimeSource::NONE; //Only one remote source answered, it is trusted over any number of local clocks and only looks to them for confirmation
+    if(sourceAvailable[TimeSource::GPS] ^ sourceAvailable[TimeSource::CELLULAR]) loneRemote = sourceAvailable[TimeSource::GPS] ? TimeSource::GPS : TimeSource::CELLULAR;
+    ClockConsensusResult agreement = consensus.resolve(loneRemote == TimeSource::NONE ? ClockConsensusResult::NONE : loneRemote);
+    bool driftReset = false; //Local clock has used up its share of the error budget, set it even though it is still within maxTimeError
+    if(agreement.members > 1 && agreement.primary <= TimeSource::CELLULAR) { //Remote time confirmed by another source, measure local clocks against it
+        if(syncParticleTime != 0) recordDrift(DriftClock::PARTICLE, syncParticleTime, agreement.time);
+        if(sourceAvailable[TimeSource::RTC]) recordDrift(DriftClock::RTC, times[TimeSource::RTC], agreement.time);
+        if(syncParticleTime != 0 && budgetUsed(DriftClock::PARTICLE, syncParticleTime - agreement.time, agreement.time)) driftReset = true; //Invalid Particle time is already a set through syncTimeGood
+        if(sourceAvailable[TimeSource::RTC] && budgetUsed(DriftClock::RTC, times[TimeSource::RTC] - agreement.time, agreement.time)) driftReset = true;
+    }
+    if(sourceAvailable[TimeSource::GPS] && sourceAvailable[TimeSource::RTC]) { //Only an active GPS fix is a good enough reference for trim
+        bool cellAgrees = !sourceAvailable[TimeSource::CELLULAR] || abs(times[TimeSource::GPS] - times[TimeSource::CELLULAR]) <= TRIM_REFERENCE_AGREE;
+        if(cellAgrees) trackRtcTrim(times[TimeSource::RTC], times[TimeSource::GPS]); //Skip samples where GPS is contradicted, without losing the window
+    }
+    if(syncTimeGood == false || syncForce == true || newTimeFix > timeFix || driftReset) { //If there is an error in time, go to set time, or if the new time availability is better than the last sync time 
         timeGood = false; //Clear flag once the timeset begins 
         // int8_t sourceA = TimeSource::NONE; //Keep track of which sources are used
         // int8_t sourceB = TimeSource::NONE;
-        if(sourceAvailable[TimeSource::GPS] ^ sourceAvailable[TimeSource::CELLULAR]) { //If only ONE of the external sources is avilible 
-            uint8_t remoteSource = sourceAvailable[TimeSource::GPS] ? TimeSource::GPS : TimeSource::CELLULAR; //Check which remote source is availible 
-            timeSourceA = remoteSource;
-            for(int t = 0; t < (numClockSources - 1); t++) {
-                if(abs(times[remoteSource] - times[t]) < maxTimeError && t != remoteSource) { //If available time matches with another time (2 times agree) that is not iself, proceed with the time set
-                    timeSourceB = t; //Record secondary source
-                    Serial.println("SET PARTICLE RTC"); //DEBUG!
-                    Time.setTime(times[remoteSource]);  //Set 
-                    rtc.setTime(Time.year(times[remoteSource]), Time.month(times[remoteSource]), Time.day(times[remoteSource]), Time.hour(times[remoteSource]), Time.minute(times[remoteSource]), Time.second(times[remoteSource]));
-                    timeGood = true; //Assert flag after time set
-                    break; //Exit after the highest tier is used
+        syncConsensus = agreement;
+        timeSourceA = syncConsensus.valid ? syncConsensus.primary : TimeSource::NONE; //Record highest priority agreeing source
+        timeSourceB = (syncConsensus.members > 1) ? syncConsensus.secondary : TimeSource::NONE; //Record secondary source
+        if(syncConsensus.members > 1 || (syncConsensus.valid && timeSourceA <= TimeSource::CELLULAR)) { //Set if 2 times agree, or if a remote source stands alone
+            time_t setTime = syncConsensus.time;
+            Serial.println("SET PARTICLE RTC"); //DEBUG!
+            Time.setTime(setTime);  //Set 
+            markClockSet(DriftClock::PARTICLE, setTime, 0); //Drift is measured from here on
+            if(timeSourceA <= TimeSource::CELLULAR) { //If a tier 1 or 2 value is used, also update the kestrel RTC
+                dateTimeStruct setDate;
+                CivilTime::fromUnix(setTime, setDate);
+                rtc.setTime(setDate.year, setDate.month, setDate.day, setDate.hour, setDate.minute, setDate.second);
+                markClockSet(DriftClock::RTC, setTime, 0);
+                if(sourceAvailable[TimeSource::RTC]) { //Carry what the set removed so the trim window continues
+                    trimSetCorrection += times[TimeSource::RTC] - setTime;
+                    if(trimSets < 0xFF) trimSets++;
+                    if(trimSetsSinceSample < 0xFF) trimSetsSinceSample++;
                 }
+                else trimWindowOpen = false; //Offset before the set is unknown, start over
             }
-            if(!timeGood) { //If no matching time found, set to none and set time anyway
-                timeSourceB = TimeSource::NONE; //Set even if find no agreeing time
-                Serial.println("SET PARTICLE RTC"); //DEBUG!
-                Time.setTime(times[remoteSource]);  //Set
-                rtc.setTime(Time.year(times[remoteSource]), Time.month(times[remoteSource]), Time.day(times[remoteSource]), Time.hour(times[remoteSource]), Time.minute(times[remoteSource]), Time.second(times[remoteSource]));
-            }
-
+            timeGood = (syncConsensus.members > 1); //Assert flag after time set, only if agreed
         }
-        else {
-            for(int i = 0; i < (numClockSources - 1); i++) { //Set options do not include current time itself, start with most legit result and go from there
-                if(sourceAvailable[i] == true && timeGood == false) { //If source is available and sync not finished
-                    timeSourceA = i; //Record highest priority source
-                    for(int t = 0; t < (numClockSources - 1); t++) {
-                        if(abs(times[i] - times[t]) < maxTimeError && t != i) { //If available time matches with another time (2 times agree) that is not iself, proceed with the time set
-                            timeSourceB = t; //Record secondary source
-                            Serial.println("SET PARTICLE RTC"); //DEBUG!
-                            Time.setTime(times[i]);  //Set 
-                            if(timeSourceA <= TimeSource::CELLULAR) { //If a tier 1 or 2 value is used, also update the kestrel RTC
-                                rtc.setTime(Time.year(times[i]), Time.month(times[i]), Time.day(times[i]), Time.hour(times[i]), Time.minute(times[i]), Time.second(times[i]));
-                            }
-                            timeGood = true; //Assert flag after time set
-                            break; //Exit after the highest tier is used
-                        }
-                    }
-                }
-            }
-        } 
         //Evaluate new time set
         if(timeSourceA == TimeSource::GPS && timeSourceB == TimeSource::CELLULAR) timeFix = 4; //If both remote time sources are present, best fix
         else if(timeSourceA == TimeSource::GPS || timeSourceA == TimeSource::CELLULAR) timeFix = 3; //If only ONE of the remote sources is present, level 3 fix
@@ -1153,11 +2006,12 @@ uint8_t Kestrel::syncTime(bool force)
         }
         if(timeFix > 0 && timeGood == true) { //Update for increment
             lastTimeSync = Time.now(); //Update time of last sync
-            previousTime = Time.now(); //Grab updated time before exiting
-            previousMillis = millis(); //Grab millis before exiting
+            syncPreviousTime = Time.now(); //Grab updated time before exiting
+            syncPreviousMillis = millis(); //Grab millis before exiting
         }
         else lastTimeSync = 0; //Otherwise indiciate sync failed
     }
+    else timeGood = true; //Every available source agreed with the local clock, nothing to set
     source = timeSourceA; //Use highest value as source
 
     
@@ -1233,9 +2087,7 @@ uint8_t Kestrel::syncTime(bool force)
     // else lastTimeSync = 0; //Otherwise, set back to unknown time
     // timeSource = source; //Grab the time source used 
     // // return false; //DEBUG!
-    enableAuxPower(currentAux); //Return all to previous states
-    enableI2C_Global(currentGlob);
-    enableI2C_OB(currentOB);
+    enableAuxPower(syncAuxState); //Return all to previous states
     Serial.print("Timebase End: "); //DEBUG!
     Serial.println(millis());
     // if(timeGood == true) {
@@ -1245,6 +2097,203 @@ uint8_t Kestrel::syncTime(bool force)
     return source;
 }
 
+
+uint8_t Kestrel::syncTime(bool force)
+{
+    ProfileScope profile(*this, ProfileOp::SYNC_TIME);
+    startTimeSync(force); //If a sync is already in flight this just joins it
+    while(pollTimeSync() == SyncStatus::IN_PROGRESS) { //Block until all sources have reported or timed out
+        delay(1);
+        Particle.process(); //Keep cloud connection serviced while waiting, as waitFor would
+    }
+    return syncSource;
+}
+
+void Kestrel::markClockSet(uint8_t clock, time_t reference, float offset)
+{
+    driftBaseTime[clock] = reference;
+    driftBaseOffset[clock] = offset;
+}
+
+void Kestrel::recordDrift(uint8_t clock, time_t clockTime, time_t reference)
+{
+    float offset = clockTime - reference; //[s] Positive if clock is fast
+    if(driftBaseTime[clock] == 0) { //First look at this clock, offset so far has unknown history
+        markClockSet(clock, reference, offset);
+        return;
+    }
+    float elapsed = reference - driftBaseTime[clock];
+    if(elapsed < DRIFT_MIN_ELAPSED) return; //Too short to see anything past the 1s resolution
+    driftOffset[clock][driftHead[clock]] = offset - driftBaseOffset[clock];
+    driftElapsed[clock][driftHead[clock]] = elapsed;
+    driftHead[clock] = (driftHead[clock] + 1) % DRIFT_HISTORY;
+    if(driftCount[clock] < DRIFT_HISTORY) driftCount[clock]++;
+    float sumProduct = 0;
+    float sumSquare = 0;
+    float sumElapsed = 0;
+    driftSpan[clock] = 0;
+    for(int i = 0; i < driftCount[clock]; i++) { //Least squares slope through the origin, long intervals dominate as they resolve drift best
+        sumProduct += driftOffset[clock][i]*driftElapsed[clock][i];
+        sumSquare += driftElapsed[clock][i]*driftElapsed[clock][i];
+        sumElapsed += driftElapsed[clock][i];
+        if(driftElapsed[clock][i] > driftSpan[clock]) driftSpan[clock] = driftElapsed[clock][i];
+    }
+    driftPpm[clock] = (sumProduct/sumSquare)*1e6;
+    driftUncertainty[clock] = (DRIFT_RESOLUTION*sumElapsed/sumSquare)*1e6; //Every offset off by the full resolution in the same direction, 1s/elapsed for one measurement
+}
+
+float Kestrel::driftRate(uint8_t clock)
+{
+    if(driftCount[clock] == 0) return -1;
+    return fabs(driftPpm[clock]) + driftUncertainty[clock];
+}
+
+bool Kestrel::driftKnown(uint8_t clock)
+{
+    return driftCount[clock] >= DRIFT_MIN_SAMPLES && driftSpan[clock] >= DRIFT_MIN_SPAN;
+}
+
+float Kestrel::setError()
+{
+    if(syncConsensus.primary <= TimeSource::CELLULAR) return SYNC_SET_ERROR;
+    return maxTimeError; //Set from local clocks which only agreed with each other to within maxTimeError
+}
+
+void Kestrel::loadRtcTrim()
+{
+    if(trimStore.magic != RtcTrimStore::MAGIC || trimStore.crc != rtcTrimCrc(trimStore)) { //Cold boot, adopt whatever trim the RTC holds
+        uint8_t reg = rtc.readByte(RTC_OSCTRIM);
+        trimStore.magic = RtcTrimStore::MAGIC;
+        trimStore.trim = (reg & 0x80) ? (reg & 0x7F) : -(reg & 0x7F); //Sign bit set adds clocks
+        trimStore.updates = 0;
+        trimStore.ppm = 0;
+        trimStore.calibrated = 0;
+        trimStore.crc = rtcTrimCrc(trimStore);
+        return;
+    }
+    writeRtcTrim(trimStore.trim); //RTC loses trim with its backup supply, retained copy is the reference
+}
+
+uint16_t Kestrel::rtcTrimCrc(const RtcTrimStore &store)
+{
+    uint16_t crc = crc16((const uint8_t*)&store.magic, sizeof(store.magic));
+    crc = crc16((const uint8_t*)&store.trim, sizeof(store.trim), crc);
+    crc = crc16(&store.updates, sizeof(store.updates), crc);
+    crc = crc16((const uint8_t*)&store.ppm, sizeof(store.ppm), crc);
+    return crc16((const uint8_t*)&store.calibrated, sizeof(store.calibrated), crc);
+}
+
+bool Kestrel::writeRtcTrim(int8_t trim)
+{
+    if(trim < -127) trim = -127;
+    uint8_t reg = (trim > 0) ? (0x80 | trim) : -trim; //Sign bit set adds clocks
+    if(rtc.readByte(RTC_OSCTRIM) == reg) return true;
+    Wire.beginTransmission(RTC_ADR);
+    Wire.write(RTC_OSCTRIM);
+    Wire.write(reg);
+    if(Wire.endTransmission() != 0 || rtc.readByte(RTC_OSCTRIM) != reg) {
+        throwError(RTC_READ_FAIL | 0x800); //OR with trim indicator
+        return false;
+    }
+    return true;
+}
+
+void Kestrel::trackRtcTrim(time_t rtcTime, time_t gpsTime)
+{
+    float gained = (rtcTime - gpsTime) + trimSetCorrection; //[s] Total RTC gain, as if it had never been set
+    if(trimWindowOpen && trimLastTime < gpsTime) {
+        float step = gained - trimLastGained;
+        float limit = TRIM_MAX_PPM*1e-6*(gpsTime - trimLastTime) + 2.0 + trimSetsSinceSample; //Allow for 1s resolution on both ends, and for each set between
+        if(fabs(step) > limit) trimWindowOpen = false; //GPS glitch, or RTC stopped/jumped, measurement is not usable
+    }
+    else trimWindowOpen = false;
+    if(!trimWindowOpen) {
+        trimWindowOpen = true;
+        trimWindowStart = gpsTime;
+        trimStartGained = gained;
+        trimLastGained = gained;
+        trimLastTime = gpsTime;
+        trimSets = 0;
+        trimSetsSinceSample = 0;
+        return;
+    }
+    trimLastGained = gained;
+    trimLastTime = gpsTime;
+    trimSetsSinceSample = 0;
+    time_t elapsed = gpsTime - trimWindowStart;
+    if(elapsed < TRIM_WINDOW) return;
+
+    float ppm = (gained - trimStartGained)/elapsed*1e6;
+    float uncertainty = (2.0 + trimSets)/elapsed*1e6; //[ppm] 1s resolution at each end and at each set
+    trimWindowOpen = false; //Next sample starts a new window, measuring the trim as applied
+    if(fabs(ppm) > TRIM_MAX_PPM) return;
+    if(fabs(ppm) <= uncertainty) return; //Could be all resolution, nothing to correct yet
+    int steps = lround((ppm - copysignf(uncertainty, ppm))/TRIM_PPM_PER_STEP); //Correct only the part the window has resolved, what is left is measured by the next one
+    if(steps == 0) return; //Within a step, nothing to do
+    int trim = trimStore.trim - steps; //Fast RTC needs clocks removed
+    if(trim > 127) trim = 127;
+    if(trim < -127) trim = -127;
+    if(!writeRtcTrim(trim)) return;
+    trimStore.trim = trim;
+    if(trimStore.updates < 0xFF) trimStore.updates++;
+    trimStore.ppm = ppm;
+    trimStore.calibrated = gpsTime;
+    trimStore.crc = rtcTrimCrc(trimStore);
+    driftCount[DriftClock::RTC] = 0; //Drift model history no longer describes the RTC
+    driftHead[DriftClock::RTC] = 0;
+    markClockSet(DriftClock::RTC, gpsTime, rtcTime - gpsTime); //Measure the new rate from here, keeping the offset it has now
+}
+
+float Kestrel::getDriftPpm(uint8_t clock)
+{
+    if(clock >= DriftClock::COUNT || !driftKnown(clock)) return 0;
+    return driftPpm[clock];
+}
+
+float Kestrel::getTimeErrorBound()
+{
+    if(!timeGood || lastTimeSync == 0) return maxTimeError; //No good sync to predict from
+    float base = setError();
+    float bound = 0;
+    time_t now = Time.now(); //Particle time is close enough to age both clocks
+    for(int c = 0; c < DriftClock::COUNT; c++) {
+        if(driftBaseTime[c] == 0 && c != DriftClock::PARTICLE) continue; //RTC never seen, nothing to predict
+        float rate = driftRate(c);
+        if(rate < 0) return maxTimeError; //Never measured
+        float clockBound = base + fabs(driftBaseOffset[c]) + rate*1e-6*(now - driftBaseTime[c]);
+        if(clockBound > bound) bound = clockBound;
+    }
+    return bound;
+}
+
+unsigned long Kestrel::getSyncInterval()
+{
+    if(!timeGood || lastTimeSync == 0) return SYNC_MIN_INTERVAL;
+    float remaining = SYNC_MAX_INTERVAL; //[s]
+    for(int c = 0; c < DriftClock::COUNT; c++) {
+        if(driftBaseTime[c] == 0 && c != DriftClock::PARTICLE) continue; //RTC never seen, schedule on Particle clock alone
+        float clockRemaining = budgetRemaining(c, Time.now());
+        if(clockRemaining < remaining) remaining = clockRemaining;
+    }
+    if(remaining < SYNC_MIN_INTERVAL) return SYNC_MIN_INTERVAL;
+    return remaining;
+}
+
+bool Kestrel::budgetUsed(uint8_t clock, time_t offset, time_t now)
+{
+    if(abs(offset) >= maxTimeError*SYNC_ERROR_MARGIN) return true; //Already out by its share, measured or not
+    return driftCount[clock] > 0 && budgetRemaining(clock, now) < SYNC_MAX_INTERVAL; //Worst case could use it up within the longest interval, set now so the schedule is not cut short
+}
+
+float Kestrel::budgetRemaining(uint8_t clock, time_t now)
+{
+    float rate = driftRate(clock); //Uncertainty keeps this above 0, a short measurement schedules a short interval
+    if(rate < 0) return 0; //Keep syncing often until drift is first measured
+    float budget = maxTimeError*SYNC_ERROR_MARGIN - setError() - fabs(driftBaseOffset[clock]); //[s] Error allowed to build up before a resync
+    if(budget <= 0) return 0;
+    return budget/(rate*1e-6) - (now - driftBaseTime[clock]); //Time until worst case error uses up budget
+}
+
 time_t Kestrel::getTime()
 {
     if(!Time.isValid() || !timeGood) { //If time has not been synced, do so now
@@ -1267,6 +2316,89 @@ String Kestrel::getTimeString()
     // else return String(currentTime); //Otherwise return normal string val
 }
 
+void Kestrel::setAnchor(time_t seconds, long ms, unsigned long atMillis, unsigned long error, uint8_t source)
+{
+    if(anchorValid && getPreciseTime().error < error) return; //Existing anchor is still better
+    seconds += ms/1000; //Normalize, GPS nano field may be negative
+    ms = ms % 1000;
+    if(ms < 0) {
+        ms += 1000;
+        seconds--;
+    }
+    anchorSeconds = seconds;
+    anchorMs = ms;
+    anchorMillis = atMillis;
+    anchorError = error;
+    anchorSource = source;
+    anchorValid = true;
+}
+
+void Kestrel::startGpsAnchor(const uint8_t *timePayload, unsigned long pollStart)
+{
+    //NAV-TIMEUTC gives the UTC of the last navigation epoch, not of the poll. Poll until the epoch changes, the new solution appeared between the
+    //start of the previous poll and the end of this one. One poll per pollTimeSync step, the gaps between steps only widen the window
+    anchorEpoch = timePayload[0] | (timePayload[1] << 8) | (timePayload[2] << 16) | ((uint32_t)timePayload[3] << 24); //iTOW [ms]
+    anchorPollStart = pollStart;
+    anchorWindowStart = pollStart;
+    syncGpsLeg = GPS_ANCHOR;
+}
+
+void Kestrel::pollGpsAnchor()
+{
+    if((millis() - anchorWindowStart) >= GPS_ANCHOR_WINDOW) { //No new epoch, receiver is not navigating
+        syncGpsLeg = LEG_DONE;
+        return;
+    }
+    const uint8_t *payload = nullptr;
+    unsigned long pollStart = millis();
+    if(!pollUbx(UBX_CLASS_NAV, UBX_NAV_TIMEUTC, payload, 0, GPS_ANCHOR_POLL_WAIT)) {
+        syncGpsLeg = LEG_DONE;
+        return;
+    }
+    unsigned long pollEnd = millis();
+    uint32_t iTow = payload[0] | (payload[1] << 8) | (payload[2] << 16) | ((uint32_t)payload[3] << 24);
+    if(iTow == anchorEpoch) {
+        anchorPollStart = pollStart;
+        return;
+    }
+    syncGpsLeg = LEG_DONE;
+    if((payload[19] & 0x0F) != 0x07) return; //New epoch lost validity
+    uint32_t tAcc = payload[4] | (payload[5] << 8) | (payload[6] << 16) | ((uint32_t)payload[7] << 24); //[ns]
+    int32_t nano = payload[8] | (payload[9] << 8) | (payload[10] << 16) | ((uint32_t)payload[11] << 24); //[ns] -1e9 to 1e9, adds to the second fields
+    time_t seconds = cstToUnix((payload[12] | (payload[13] << 8)), payload[14], payload[15], payload[16], payload[17], payload[18]);
+    unsigned long edge = anchorPollStart + (pollEnd - anchorPollStart)/2; //Middle of the window the epoch appeared in
+    unsigned long error = (pollEnd - anchorPollStart + 1)/2 + tAcc/1000000 + 1 + GPS_LATENCY_ERROR; //Window, receiver accuracy and 1ms millis() resolution
+    setAnchor(seconds, lround(nano/1e6), edge - GPS_SOLUTION_LATENCY, error, TimeSource::GPS);
+}
+
+PreciseTime Kestrel::getPreciseTime()
+{
+    PreciseTime result;
+    if(!anchorValid) {
+        result.error = 0xFFFFFFFF;
+        return result;
+    }
+    unsigned long elapsed = millis() - anchorMillis; //Unsigned difference survives one millis() rollover (~49 days)
+    unsigned long total = anchorMs + elapsed;
+    result.valid = true;
+    result.seconds = anchorSeconds + total/1000;
+    result.milliseconds = total % 1000;
+    float ppm = MILLIS_DRIFT_PPM;
+    if(driftKnown(DriftClock::PARTICLE)) ppm = driftRate(DriftClock::PARTICLE); //Particle clock and millis() share the system crystal
+    result.error = anchorError + (unsigned long)(elapsed*ppm*1e-6) + 1;
+    result.source = anchorSource;
+    return result;
+}
+
+String Kestrel::getPreciseTimeString()
+{
+    PreciseTime now = getPreciseTime();
+    if(!now.valid) return "null";
+    char text[24];
+    snprintf(text, sizeof(text), "%lu.%03u", (unsigned long)now.seconds, (unsigned)now.milliseconds);
+    return String(text);
+}
+
 String Kestrel::getPosLat()
 {
     if(updateGPS) updateLocation(); //Check if pending update, if so call it
@@ -1304,15 +2436,12 @@ String Kestrel::getPosTimeString()
 bool Kestrel::startTimer(time_t period)
 {
     if(period == 0) period = defaultPeriod; //If no period is specified, assign default period 
-    bool currentOB = enableI2C_OB(true);
-    bool currentGlob = enableI2C_Global(false);
+    I2CRoute route(*this); //Turn off external I2C and turn on internal I2C until return
     rtc.setAlarm(period); //Set alarm from current time
     timerStart = millis(); 
     Serial.print("Time Start: "); //DEBUG!
     Serial.println(timerStart);
     logPeriod = period;
-    enableI2C_Global(currentGlob);
-    enableI2C_OB(currentOB);
     return false; //DEBUG!
 }
 
@@ -1353,8 +2482,7 @@ bool Kestrel::statLED(bool state)
 
 bool Kestrel::setIndicatorState(uint8_t ledBank, uint8_t mode)
 {
-    bool currentGlob = enableI2C_Global(false);
-	bool currentOB = enableI2C_OB(true);
+    I2CRoute route(*this); //Turn off external I2C and turn on internal I2C until return
 
     led.setBrightnessArray(ledBrightness); //Set all LEDs to 50% max brightness
 	led.setGroupBlinkPeriod(ledPeriod); //Set blink period to specified number of ms
@@ -1490,8 +2618,6 @@ bool Kestrel::setIndicatorState(uint8_t ledBank, uint8_t mode)
             }
             break;
     }
-    enableI2C_Global(currentGlob); //Reset to previous state
-    enableI2C_OB(currentOB); 
     return 0; //DEBUG!
 }
 
@@ -1503,34 +2629,135 @@ unsigned long Kestrel::getMessageID()
     else return HAL_RNG_GetRandomNumber(); //Else return cryptographic 32 bit random 
 }
 
+unsigned long Kestrel::currentMessageID()
+{
+    unsigned long uptime = millis()/1000;
+    if(Time.isValid() && timeGood && uptime > 0) return Time.now() % uptime; //Same hash as getMessageID, without the sync getTime would start
+    else return HAL_RNG_GetRandomNumber();
+}
+
+uint16_t Kestrel::publishReport(const char *eventName, const char *report, size_t length)
+{
+    ReportFramer framer = frameReport(report, length);
+    for(uint16_t i = 0; i < framer.count(); i++) {
+        if(i > 0) delay(1000); //Stay inside the cloud publish rate limit of one per second
+        size_t frameLength = framer.frame(i, frameBuffer, sizeof(frameBuffer));
+        if(frameLength == 0 || !Particle.publish(eventName, frameBuffer)) return i; //Backend discards incomplete sets by ID, stop here
+    }
+    return framer.count();
+}
+
 bool Kestrel::testForBat()
 {
-    bool currentGlob = enableI2C_Global(false);
-	bool currentOB = enableI2C_OB(true);
-    ioOB.pinMode(PinsOB::CE, OUTPUT);
-    ioOB.pinMode(PinsOB::CSA_EN, OUTPUT);
-    ioOB.digitalWrite(PinsOB::CE, HIGH); //Disable charging
-    ioOB.digitalWrite(PinsOB::CSA_EN, HIGH); //Enable voltage sense
-    csaAlpha.enableChannel(CH1, true);
-    csaAlpha.update(); //Force new readings 
-    delay(5000); //Wait for cap to discharge 
-    // csaAlpha.SetCurrentDirection(CH1, BIDIRECTIONAL);
-    float vBat = csaAlpha.getBusVoltage(CH1);
-    ioOB.digitalWrite(PinsOB::CE, LOW); //Turn charging back on
-    bool result = false;
-    if(vBat < 2.0) { //If less than 2V (min bat voltage) give error 
-        //THROW ERROR???
-        result = false;
-    }
-    else result = true;
-    enableI2C_Global(currentGlob); //Reset to previous state
-    enableI2C_OB(currentOB); 
+    uint8_t state = getBatteryState();
+    while(state == BatteryState::UNKNOWN && batTestState == BatteryTest::DISCHARGING) { //Only blocks when history was not conclusive
+        delay(10);
+        state = getBatteryState();
+    }
     Serial.print("BATTERY STATE: "); //DEBUG!
-    Serial.print(vBat);
+    Serial.print(state);
     Serial.print("\t");
-    Serial.println(result);
-    return result;
-    // enableI2C_External(true);
+    Serial.println(batterySoc);
+    return (state == BatteryState::PRESENT);
+}
+
+void Kestrel::addBatterySample(float voltage, float current)
+{
+    if(batTestState == BatteryTest::DISCHARGING) return; //Charger is off, not representative
+    batHistory[batHead].voltage = voltage;
+    batHistory[batHead].current = current;
+    batHistory[batHead].time = (Time.isValid() && timeGood) ? Time.now() : 0; //0 = unknown, getTime would start a sync from inside the diagnostic
+    batHead = (batHead + 1) % BAT_HISTORY;
+    if(batCount < BAT_HISTORY) batCount++;
+}
+
+float Kestrel::socFromVoltage(float voltage)
+{
+    static constexpr float OCV[11] = {3.27, 3.61, 3.69, 3.71, 3.73, 3.75, 3.79, 3.85, 3.92, 4.00, 4.10}; //[V] Typical Li-ion rest voltage at 0, 10 ... 100%
+    if(voltage <= OCV[0]) return 0;
+    for(int i = 1; i < 11; i++) {
+        if(voltage < OCV[i]) return 10.0*(i - 1) + 10.0*(voltage - OCV[i - 1])/(OCV[i] - OCV[i - 1]); //Linear between table points
+    }
+    return 100;
+}
+
+uint8_t Kestrel::estimateBattery()
+{
+    if(batCount == 0) return BatteryState::UNKNOWN;
+    time_t now = (Time.isValid() && timeGood) ? Time.now() : 0;
+    const BatterySample &newest = batHistory[(batHead + BAT_HISTORY - 1) % BAT_HISTORY];
+    if(newest.voltage < BAT_MIN_VOLTAGE) { //Nothing holds the rail up now, whatever the history says
+        batterySoc = -1;
+        return BatteryState::ABSENT;
+    }
+    bool moving = false; //Current flowing in or out, only possible with a cell
+    float restVoltage = 0;
+    uint8_t restCount = 0;
+    for(int i = 0; i < batCount; i++) { //Newest first, stop at the first sample too old to count
+        const BatterySample &sample = batHistory[(batHead + BAT_HISTORY - 1 - i) % BAT_HISTORY];
+        bool fresh = (sample.time == 0 || now == 0) ? (i == 0) : (now - sample.time <= BAT_SAMPLE_MAX_AGE); //Age unknown, only the newest is trusted
+        if(!fresh) break;
+        if(fabs(sample.current) > BAT_MIN_CURRENT) moving = true;
+        restVoltage += sample.voltage - sample.current*BAT_RESISTANCE; //Remove IR drop, current positive when charging
+        restCount++;
+    }
+    if(restCount == 0) return BatteryState::UNKNOWN; //History is all stale
+    if(moving) {
+        batterySoc = socFromVoltage(restVoltage/restCount); //Averaged over history, smooths load steps
+        return BatteryState::PRESENT;
+    }
+    return BatteryState::AMBIGUOUS; //No current, a bare charger output can sit anywhere from min voltage up to its set point, so voltage alone cannot tell a cell from no cell
+}
+
+uint8_t Kestrel::getBatteryState()
+{
+    if(batTestState == BatteryTest::DISCHARGING) return (batTestPoll() == BatteryTest::DONE) ? batTestResult : BatteryState::UNKNOWN;
+    uint8_t estimate = estimateBattery();
+    if(estimate != BatteryState::AMBIGUOUS && estimate != BatteryState::UNKNOWN) return estimate;
+    time_t now = (Time.isValid() && timeGood) ? Time.now() : 0; //getTime would start a sync, this runs from sleep and the diagnostic
+    if(batTestResult != BatteryState::UNKNOWN && batTestTime != 0 && now != 0 && (now - batTestTime) < BAT_TEST_VALID) return batTestResult; //Recent test still stands
+    batTestStart();
+    return BatteryState::UNKNOWN;
+}
+
+uint8_t Kestrel::batTestStart()
+{
+    if(batTestState == BatteryTest::DISCHARGING) return batTestState;
+    I2CRoute route(*this); //Turn off external I2C and turn on internal I2C until return
+    writeOBBus((1 << PinsOB::CE) | (1 << PinsOB::CSA_EN), (1 << PinsOB::CE) | (1 << PinsOB::CSA_EN)); //Disable charging and enable voltage sense in one write
+    batTestStartTime = millis();
+    batTestState = BatteryTest::DISCHARGING;
+    return batTestState;
+}
+
+void Kestrel::batTestCancel()
+{
+    if(batTestState != BatteryTest::DISCHARGING) return;
+    I2CRoute route(*this); //Turn off external I2C and turn on internal I2C until return
+    writeExpanderPin(obShadow, PinsOB::CE, LOW); //Turn charging back on, no result
+    batTestState = BatteryTest::IDLE;
+}
+
+uint8_t Kestrel::batTestPoll()
+{
+    if(batTestState != BatteryTest::DISCHARGING) return batTestState;
+    if((millis() - batTestStartTime) < BAT_TEST_DURATION) return batTestState; //Wait for cap to discharge
+    I2CRoute route(*this); //Turn off external I2C and turn on internal I2C until return
+    CsaReading reading;
+    bool ok = sensorReady(OnboardSensor::CSA_ALPHA) && readCsaBulk(csaAlphaAdr, CSA_ALPHA_BIDIR, CSA_ALPHA_SENSE, reading);
+    writeExpanderPin(obShadow, PinsOB::CE, LOW); //Turn charging back on
+    batTestState = BatteryTest::DONE;
+    if(!ok) {
+        throwError(CSA_OB_READ_FAIL | 0xA00);
+        sensorFailed(OnboardSensor::CSA_ALPHA);
+        batTestResult = BatteryState::UNKNOWN;
+        return batTestState;
+    }
+    float vBat = reading.voltage[0];
+    batTestResult = (vBat < BAT_MIN_VOLTAGE) ? BatteryState::ABSENT : BatteryState::PRESENT; //If less than 2V (min bat voltage) nothing is holding the rail up
+    batterySoc = (batTestResult == BatteryState::PRESENT) ? socFromVoltage(vBat) : -1; //No charge current, bus voltage is rest voltage
+    batTestTime = (Time.isValid() && timeGood) ? Time.now() : 0; //0 = unknown, retested on next ask
+    return batTestState;
 }
 
 bool Kestrel::releaseWDT()
@@ -1602,22 +2829,23 @@ bool Kestrel::zeroAccel(bool reset)
 bool Kestrel::configTalonSense()
 {
     Serial.println("CONFIG TALON SENSE"); //DEBUG!
-    bool currentGlob = enableI2C_Global(false);
-	bool currentOB = enableI2C_OB(true);
+    I2CRoute route(*this); //Turn off external I2C and turn on internal I2C until return
     csaBeta.setCurrentDirection(CH4, UNIDIRECTIONAL); //Bulk voltage, unidirectional
 	csaBeta.enableChannel(CH1, false); //Disable all channels but 4
 	csaBeta.enableChannel(CH2, false);
 	csaBeta.enableChannel(CH3, false);
 	csaBeta.enableChannel(CH4, true);
-    enableI2C_Global(currentGlob); //Reset to previous state
-    enableI2C_OB(currentOB); 
+    csaBetaEnabled = 0x08;
     // enableI2C_Global(true); //Connect all together 
     return false; //DEBUG!
 }
 
 int Kestrel::sleep()
 {
+    ProfileScope profile(*this, ProfileOp::SLEEP); //Time inside System.sleep is excluded, only the work around it is profiled
     if((millis() - timerStart) > sysCollectMax) throwError(EXCEED_COLLECT_TIME | portErrorCode); //Throw error for whole logging system taking too long
+    batTestPoll(); //Finish a discharge test which has run its time
+    batTestCancel(); //Never sleep with charging disabled, an unfinished test starts over next time
     SystemSleepConfiguration config;
     // SystemSleepResult result;
     switch(powerSaveMode) {
@@ -1632,9 +2860,9 @@ int Kestrel::sleep()
                 .duration(20min) //DEBUG!
                 .gpio(Pins::Clock_INT, FALLING); //Trigger on falling clock pulse
             // enableSD(false); //Turn off SD power
-            ioOB.digitalWrite(PinsOB::LED_EN, HIGH); //Disable LEDs (if not done already) 
+            writeExpanderPin(obShadow, PinsOB::LED_EN, HIGH); //Disable LEDs (if not done already) 
             led.sleep(true); //Put LED driver into low power mode 
-            if(!gps.powerOffWithInterrupt(3600000, VAL_RXM_PMREQ_WAKEUPSOURCE_EXTINT0)) throwError(GPS_READ_FAIL); //Shutdown for an hour unless woken up via pin trip
+            gpsSleep(); //Shutdown for an hour unless woken up via pin trip
 
             // result = System.sleep(config);
             // System.sleep(config); //DEBUG!
@@ -1649,7 +2877,7 @@ int Kestrel::sleep()
                 .gpio(Pins::Clock_INT, FALLING); //Trigger on falling clock pulse
             // enableSD(false); //Turn off SD power
             enableAuxPower(false); //Turn all aux power off
-            ioOB.digitalWrite(PinsOB::LED_EN, HIGH); //Disable LEDs (if not done already)
+            writeExpanderPin(obShadow, PinsOB::LED_EN, HIGH); //Disable LEDs (if not done already)
             led.sleep(true); //Put LED driver into low power mode  
             // gps.powerOffWithInterrupt(3600000, VAL_RXM_PMREQ_WAKEUPSOURCE_EXTINT0); //Shutdown for an hour unless woken up via pin trip
 
@@ -1666,7 +2894,7 @@ int Kestrel::sleep()
                 // .duration(5min); //DEBUG!
                 .gpio(Pins::Clock_INT, FALLING); //Trigger on falling clock pulse
             enableAuxPower(false); //Turn all aux power off
-            ioOB.digitalWrite(PinsOB::LED_EN, HIGH); //Disable LEDs (if not done already) 
+            writeExpanderPin(obShadow, PinsOB::LED_EN, HIGH); //Disable LEDs (if not done already) 
             led.sleep(true); //Put LED driver into low power mode 
             // ioOB.digitalWrite(PinsOB::CSA_EN, LOW); //Disable CSAs //DEBUG! //FIX!
 
@@ -1705,7 +2933,9 @@ int Kestrel::sleep()
     delay(5000); //DEBUG!
     __set_FPSCR(fpscr & ~0x7); //Clear error bits to prevent assertion failure 
     if(digitalRead(Pins::Clock_INT) != LOW) {
+        unsigned long sleepStart = millis();
         SystemSleepResult result = System.sleep(config); //If clock not triggered already, go to sleep
+        profile.exclude(millis() - sleepStart);
         if(powerSaveMode == PowerSaveModes::LOW_POWER) { //Deal with extended sleep periods in low power mode
             delay(5000); //DEBUG!
             Serial.print("WAKE! - "); //DEBUG!
@@ -1726,7 +2956,9 @@ int Kestrel::sleep()
                 Serial.println("Wakeup Attemp Done - return to sleep"); //DEBUG!
                 Serial.flush(); //DEBUG!
                 waitFor(Particle.connected, 5000);
+                sleepStart = millis();
                 result = System.sleep(config); //Go back to sleep after re-connecting
+                profile.exclude(millis() - sleepStart);
             }
         }
         if(powerSaveMode == PowerSaveModes::BALANCED) {
@@ -1742,6 +2974,8 @@ int Kestrel::sleep()
 
 int Kestrel::wake()
 {
+    ProfileScope profile(*this, ProfileOp::WAKE);
+    ubxTransactions = 0; //New cycle
     switch(powerSaveMode) {
         case PowerSaveModes::PERFORMANCE:
             return 0; //Nothing to do for performance mode 
@@ -1749,13 +2983,7 @@ int Kestrel::wake()
         case PowerSaveModes::BALANCED:
             if((getTime() - posTime) > 3600) { //If it has been more than an hour since last GPS point reading
                 Serial.println("Wake GPS"); //DEBUG!
-                ioOB.pinMode(PinsOB::GPS_INT, OUTPUT); //Turn GPS back on by toggling int pin
-                ioOB.digitalWrite(PinsOB::GPS_INT, LOW);
-                delay(1000);
-                ioOB.digitalWrite(PinsOB::GPS_INT, HIGH);
-                delay(1000);
-                ioOB.digitalWrite(PinsOB::GPS_INT, LOW);
-                delay(1000);
+                gpsEnsureAwake(); //Only pulses GPS_INT if receiver is not already responding
                 if(gps.begin() == false) {
                     criticalFault = true; //DEBUG! ??
                     throwError(GPS_INIT_FAIL);
@@ -1764,9 +2992,8 @@ int Kestrel::wake()
                 else {
                     gps.setI2COutput(COM_TYPE_UBX);
                     // gps.setAutoPVT(true); //DEBUG!
-                    unsigned long localTime = millis();
-                    while((gps.getFixType() < 2 || gps.getFixType() > 4) && !gps.getGnssFixOk() && (localTime - millis()) < 30000); //Wait up to 30 seconds to get a GPS fix, if not, move on
-                    if(!(gps.getFixType() >= 2 && gps.getFixType() <= 4)) { //If GPS failed to connect after that period, throw error
+                    updatePvt(true); //Single PVT poll, wait loop here never ran since (localTime - millis()) underflowed
+                    if(!(pvt.fixType >= 2 && pvt.fixType <= 4)) { //If GPS failed to connect after that period, throw error
                         throwError(GPS_UNAVAILABLE | 0x100); //Set subtype to timeout
                     }
                     updateGPS = true; //Set flag so position is updated at next update call
@@ -1779,13 +3006,7 @@ int Kestrel::wake()
             enableAuxPower(true); //Turn aux power back on
             if((getTime() - posTime) > 14400) { //If it has been more than 4 hours since last GPS point reading
                 Serial.println("Power Up GPS"); //DEBUG!
-                ioOB.pinMode(PinsOB::GPS_INT, OUTPUT); //Turn GPS back on by toggling int pin
-                ioOB.digitalWrite(PinsOB::GPS_INT, LOW);
-                delay(1000);
-                ioOB.digitalWrite(PinsOB::GPS_INT, HIGH);
-                delay(1000);
-                ioOB.digitalWrite(PinsOB::GPS_INT, LOW);
-                delay(1000);
+                gpsEnsureAwake(); //Only pulses GPS_INT if receiver is not already responding
                 if(gps.begin() == false) {
                     criticalFault = true; //DEBUG! ??
                     throwError(GPS_INIT_FAIL);
@@ -1794,9 +3015,8 @@ int Kestrel::wake()
                 else {
                     gps.setI2COutput(COM_TYPE_UBX);
                     // gps.setAutoPVT(true); //DEBUG!
-                    unsigned long localTime = millis();
-                    while((gps.getFixType() < 2 || gps.getFixType() > 4) && !gps.getGnssFixOk() && (localTime - millis()) < 60000); //Wait up to 60 seconds to get a GPS fix, if not, move on
-                    if(!(gps.getFixType() >= 2 && gps.getFixType() <= 4)) { //If GPS failed to connect after that period, throw error
+                    updatePvt(true); //Single PVT poll, wait loop here never ran since (localTime - millis()) underflowed
+                    if(!(pvt.fixType >= 2 && pvt.fixType <= 4)) { //If GPS failed to connect after that period, throw error
                         throwError(GPS_UNAVAILABLE | 0x100); //Set subtype to timeout
                     }
                     updateGPS = true; //Set flag so position is updated at next update call
@@ -1879,24 +3099,11 @@ void Kestrel::outOfMemoryHandler(system_event_t event, int param) {
 
 time_t Kestrel::timegm(struct tm *tm)
 {
-    time_t ret;
-    char *tz;
-
-   tz = getenv("TZ");
-    setenv("TZ", "", 1);
-    tzset();
-    ret = mktime(tm);
-    if (tz)
-        setenv("TZ", tz, 1);
-    else
-        unsetenv("TZ");
-    tzset();
-    return ret;
-}
-
-time_t Kestrel::cstToUnix(int year, int month, int day, int hour, int minute, int second)
-{
-    unsigned long unixDate = day - 32075 + 1461*(year + 4800 + (month - 14)/12)/4 + 367*(month - 2 - (month - 14)/12*12)/12 - 3*((year + 4900 + (month - 14)/12)/100)/4 - 2440588; //Stolen from Communications of the ACM in October 1968 (Volume 11, Number 10), Henry F. Fliegel and Thomas C. Van Flandern - offset from Julian Date. Why mess with success? 
-    return unixDate*86400 + hour*3600 + minute*60 + second; //Convert unixDate to seconds, sum partial seconds from the current day
-
+    int month = tm->tm_mon % 12; //Normalize month into the year as mktime would, days/hours/etc carry through the linear sum
+    int year = tm->tm_year + 1900 + tm->tm_mon/12;
+    if(month < 0) {
+        month += 12;
+        year--;
+    }
+    return CivilTime::toUnix(year, month + 1, tm->tm_mday, tm->tm_hour, tm->tm_min, tm->tm_sec);
 }
@@ -57,6 +57,10 @@ Distributed as-is; no warranty is given.
 #include <Adafruit_SHT4x.h>
 #include <MXC6655.h>
 #include <arduino_bma456.h>
+#include "JsonWriter.h"
+#include "ReportFramer.h"
+#include "ClockConsensus.h"
+#include "CivilTime.h"
 // #include <GlobalPins.h>
 
 
@@ -118,6 +122,38 @@ namespace TimeSource { //FIX!
 	constexpr uint8_t NONE = 5;
 }
 
+namespace GpsPower {
+	constexpr uint8_t OFF = 0; ///<No power, or state unknown
+	constexpr uint8_t BACKUP = 1; ///<Put into backup by driver, needs GPS_INT pulse to wake
+	constexpr uint8_t WAKING = 2; ///<GPS_INT wake pulse in progress
+	constexpr uint8_t READY = 3; ///<Receiver is responding on I2C
+}
+
+namespace BatteryState {
+	constexpr uint8_t UNKNOWN = 0; ///<Not enough history, or discharge test still running
+	constexpr uint8_t PRESENT = 1;
+	constexpr uint8_t ABSENT = 2;
+	constexpr uint8_t AMBIGUOUS = 3; ///<No current in history, fits both a battery and a bare charger, needs discharge test
+}
+
+namespace BatteryTest {
+	constexpr uint8_t IDLE = 0;
+	constexpr uint8_t DISCHARGING = 1; ///<Charging disabled, waiting for the charger output cap to drain
+	constexpr uint8_t DONE = 2; ///<Result available from getBatteryState()
+}
+
+namespace DriftClock { //Local clocks tracked by the drift model
+	constexpr uint8_t PARTICLE = 0;
+	constexpr uint8_t RTC = 1; ///<MCP79412
+	constexpr uint8_t COUNT = 2;
+}
+
+namespace SyncStatus {
+	constexpr uint8_t IDLE = 0; ///<No sync has been started
+	constexpr uint8_t IN_PROGRESS = 1; ///<Sync started, waiting on remote sources
+	constexpr uint8_t DONE = 2; ///<Last sync complete, result available from lastSyncSource()
+}
+
 namespace IndicatorLight {
 	constexpr uint8_t SENSORS = 1;
 	constexpr uint8_t GPS = 2;
@@ -159,9 +195,209 @@ struct dateTimeStruct {
 			uint8_t source = TimeSource::NONE;
 		};
 
+struct ExpanderShadow {
+	ExpanderShadow(uint8_t address) : adr(address) {}
+	uint8_t adr; ///<I2C address of the PCAL9535A being shadowed
+	uint16_t output = 0xFFFF; ///<Copy of output port registers, pin n is bit n (power on default is all high)
+	uint16_t config = 0xFFFF; ///<Copy of configuration registers, 1 = input (power on default is all inputs)
+	uint16_t pullEnable = 0x0000; ///<Copy of pull resistor enable registers (power on default is none)
+	uint16_t pullSelect = 0xFFFF; ///<Copy of pull resistor selection registers, 1 = pull-up (power on default is all pull-ups)
+	bool valid = false; ///<Cleared when registers may have changed outside of the shadow, forces a reload before next write
+};
+
+namespace ReportType { //Subtype of REPORT_OVERFLOW
+	constexpr uint8_t DATA = 1;
+	constexpr uint8_t DIAGNOSTIC = 2;
+	constexpr uint8_t METADATA = 3;
+	constexpr uint8_t ERRORS = 4;
+}
+
+namespace ProfileOp {
+	constexpr uint8_t BEGIN = 0;
+	constexpr uint8_t SYNC_TIME = 1;
+	constexpr uint8_t SLEEP = 2;
+	constexpr uint8_t WAKE = 3;
+	constexpr uint8_t DIAGNOSTIC = 4;
+	constexpr uint8_t ALS_READ = 5; ///<Range check plus channel reads of the VEML3328
+	constexpr uint8_t COUNT = 6; ///<Number of profiled operations
+}
+
+namespace DiagnosticField { //Slowly changing diagnostic fields tracked for delta reporting
+	constexpr uint8_t RTC_CONFIG = 0;
+	constexpr uint8_t ACCEL_OFFSET = 1;
+	constexpr uint8_t OB_BUS = 2;
+	constexpr uint8_t TALON_BUS = 3;
+	constexpr uint8_t I2C = 4;
+	constexpr uint8_t TIME_SOURCE = 5;
+	constexpr uint8_t COUNT = 6;
+};
+
+namespace OnboardSensor { //Sensors on the Kestrel board kept initialized between reads
+	constexpr uint8_t ALS = 0;
+	constexpr uint8_t ATMOS = 1;
+	constexpr uint8_t ACCEL = 2; //MXC6655 or BMA456, whichever was detected
+	constexpr uint8_t CSA_ALPHA = 3;
+	constexpr uint8_t CSA_BETA = 4;
+	constexpr uint8_t COUNT = 5;
+};
+
+struct SensorHandle {
+	bool ready = false; ///<Probed and configured, cleared on a failed read or when its rail is switched off
+	unsigned long inits = 0; ///<Number of begin() and configure sequences run
+	unsigned long reads = 0; ///<Number of reads made without re-initializing
+	unsigned long failures = 0; ///<Failed inits plus failed reads
+};
+
+namespace Conversion { //Onboard sensor results gathered by startConversions/collectConversions
+	constexpr uint8_t ALS_CHANNELS = 0x01;
+	constexpr uint8_t ALS_LUX = 0x02;
+	constexpr uint8_t ATMOS = 0x04;
+	constexpr uint8_t ACCEL = 0x08;
+};
+
+struct OnboardSample {
+	uint8_t requested = 0; ///<Conversion bits asked for in startConversions
+	bool alsValid = false;
+	float alsChannels[5] = {0}; ///<Clear, Red, Green, Blue, IR
+	bool alsChannelValid[5] = {false};
+	float lux = 0;
+	bool atmosValid = false;
+	float humidity = 0; ///<[%]
+	float atmosTemp = 0; ///<[°C]
+	bool accelValid = false;
+	float accel[3] = {0}; ///<[g]
+	float accelTemp = 0; ///<[°C]
+	uint8_t accelTempDecimals = 4;
+};
+
+struct CsaReading { //All four channels of one PAC1934 from a single refresh
+	bool valid = false;
+	float voltage[4] = {0}; ///<[V] Averaged bus voltage
+	float current[4] = {0}; ///<[A] Averaged sense current
+	float power[4] = {0}; ///<[W] Average power since accumulator clear
+	uint64_t accumulator[4] = {0}; ///<Raw VPOWERn_ACC, 48 bit
+	uint32_t count = 0; ///<Raw ACC_COUNT, 24 bit
+};
+
+struct EnergyBaseline { //Accumulator state of one PAC1934 at the last energy update
+	bool valid = false;
+	uint64_t accumulator[4] = {0};
+	uint32_t count = 0;
+	unsigned long updated = 0; ///<millis() of the read
+};
+
+struct InrushSummary { //Port current during the capture window after enablePower, measured on the shared bulk rail and net of the ports already on
+	bool valid = false;
+	float peak = 0; ///<[A] Highest sampled current
+	unsigned long peakTime = 0; ///<[us] From rail enable to peak
+	unsigned long settleTime = 0; ///<[us] From rail enable until current stays within the settle band of the final value
+	bool settled = false; ///<False if current was still moving at the end of the window
+	float before = 0; ///<[A] Bulk rail current before the port was enabled, other ports' load. Subtracted from peak and final
+	float final = 0; ///<[A] Mean of the last samples in the window
+	float energy = 0; ///<[J] Integrated over the window, using bus voltage at the end of it
+	uint16_t samples = 0; ///<Total taken, may be more than the ring buffer holds
+};
+
+struct PreciseTime { //Timestamp extrapolated from the last GPS or cellular anchor
+	bool valid = false; ///<False until a sync has anchored the time
+	time_t seconds = 0; ///<Unix time, UTC
+	uint16_t milliseconds = 0; ///<[ms] 0-999 past seconds
+	unsigned long error = 0; ///<[ms] Bound on the error of seconds + milliseconds
+	uint8_t source = TimeSource::NONE; ///<Source of the anchor
+};
+
+struct BatterySample { //Battery channel (csaAlpha CH1) from a diagnostic read
+	float voltage = 0; ///<[V]
+	float current = 0; ///<[A] Positive into the battery
+	time_t time = 0;
+};
+
+struct OperationProfile {
+	unsigned long calls = 0; ///<Number of times operation has run since reset
+	unsigned long lastDuration = 0; ///<Duration of the most recent call [ms]
+	unsigned long maxDuration = 0; ///<Longest call seen since reset [ms]
+	unsigned long lastBusOps = 0; ///<Expander register transactions and I2C routing pin writes made by the most recent call, driver side only - sibling library traffic is not seen (the host simulation counts every transaction)
+};
+
+struct PvtSnapshot {
+	bool valid = false; ///<Last NAV-PVT poll succeeded
+	unsigned long updated = 0; ///<millis() of last poll
+	uint8_t fixType = 0;
+	bool gnssFixOk = false;
+	uint8_t siv = 0; ///<Satellites in view
+	int32_t latitude = 0; ///<[deg * 10^-7]
+	int32_t longitude = 0; ///<[deg * 10^-7]
+	int32_t altitude = 0; ///<[mm]
+};
+
+struct UbxCacheEntry {
+	uint8_t cls = 0; ///<UBX message class, 0 if slot is unused
+	uint8_t id = 0; ///<UBX message ID
+	uint16_t len = 0; ///<Number of valid payload bytes held
+	bool valid = false; ///<Last poll of this message succeeded
+	unsigned long updated = 0; ///<millis() of last poll
+	uint8_t payload[32] = {0}; ///<Start of message payload, enough for NAV-TIMEUTC (20) and NAV-STATUS (16)
+};
+
+struct ErrorRecord { //No initializers, lives in retained memory and must not be cleared on reset
+	uint32_t code;
+	uint16_t count; ///<Times thrown since last report, saturates at 0xFFFF
+	uint16_t crc; ///<CRC16 of the other fields, checked after reset
+	uint32_t firstSeen; ///<Particle time of first occurrence since last report
+	uint32_t lastSeen; ///<Particle time of most recent occurrence
+};
+
+struct ErrorLogStore { //Error log kept in retained memory so it survives a reset until reported
+	static constexpr uint8_t SIZE = 32; ///<Maximum number of distinct error codes held between reports, later new codes are dropped
+	static constexpr uint32_t MAGIC = 0x4B455231; ///<"KER1", change if layout changes
+	uint32_t magic; 
+	uint8_t used;
+	uint8_t resets; ///<Number of resets the current contents have survived
+	uint16_t crc; ///<CRC16 of the other header fields
+	uint32_t thrown; ///<Total throws since last report, including repeats
+	uint32_t dropped; ///<New codes lost because the log was full or failed CRC after reset
+	ErrorRecord records[SIZE]; ///<Distinct error codes in order first thrown
+};
+
+struct RtcTrimStore { //MCP79412 trim calibration kept in retained memory, rewritten to the RTC if it loses it
+	static constexpr uint32_t MAGIC = 0x4B545231; ///<"KTR1", change if layout changes
+	uint32_t magic;
+	int8_t trim; ///<Trim steps, positive adds clocks (speeds the RTC up), about 1.017ppm each
+	uint8_t updates; ///<Trim writes made by calibration, saturates at 0xFF
+	uint16_t crc; ///<CRC16 of the other fields
+	float ppm; ///<[ppm] Drift measured by the window that last changed trim, positive if RTC was fast
+	uint32_t calibrated; ///<GPS time of last trim write
+};
+
+class Kestrel;
+
+class ProfileScope { //Records duration and bus traffic of a Kestrel operation from construction to destruction 
+	public:
+		ProfileScope(Kestrel &logger, uint8_t op);
+		~ProfileScope();
+		void exclude(unsigned long duration); //Remove time the operation did not spend running, such as time asleep [ms]
+	private:
+		Kestrel &kestrel;
+		uint8_t operation;
+		unsigned long startTime;
+		unsigned long startBusOps;
+		unsigned long excluded = 0; ///<[ms]
+};
+
+class I2CRoute { //Scoped routing of the I2C bus - connect internal bus, disconnect external bus, restore on destruction 
+	public:
+		I2CRoute(Kestrel &logger, bool ob = true, bool global = false);
+		~I2CRoute();
+	private:
+		Kestrel &kestrel;
+		bool prevOB;
+		bool prevGlobal;
+};
+
 class Kestrel: public Sensor
 {
-    constexpr static int MAX_NUM_ERRORS = 10; ///<Maximum number of errors to log before overwriting previous errors in buffer
+	friend class I2CRoute;
+	friend class ProfileScope;
 	const String FIRMWARE_VERSION = "1.7.5"; //FIX! Read from system??
 	
     const uint32_t KESTREL_PORT_RANGE_FAIL = 0x90010300; ///<Kestrel port assignment is out of range
@@ -190,6 +426,7 @@ class Kestrel: public Sensor
 	const uint32_t TIME_DISAGREE = 0x70030000; ///<At least one time source disagrees with the others
 	const uint32_t ALS_INIT_FAIL = 0x101400F7; ///<Failure to initialize the ALS on the Kestrel board
 	const uint32_t ALS_DATA_FAIL = 0x101500F7; ///<Failure to read data from the ALS on the Kestrel board
+	const uint32_t REPORT_OVERFLOW = 0xF00D0000; ///<Report did not fit its buffer, OR'd with ReportType << 8. Dropped, or for errors split across reports
 
 	const time_t CELL_TIMEOUT = 300000; ///<Amount of time [ms] to wait while trying to connect to cell
     public:
@@ -201,6 +438,8 @@ class Kestrel: public Sensor
         bool enablePower(uint8_t port, bool state = true);
         bool enableData(uint8_t port, bool state = true);
 		bool setDirection(uint8_t port, bool sel);
+		bool writeTalonBus(uint16_t mask, uint16_t state);
+		bool writeOBBus(uint16_t mask, uint16_t state);
         bool disablePowerAll();
         bool disableDataAll();
 		bool getFault(uint8_t pin);
@@ -212,6 +451,25 @@ class Kestrel: public Sensor
 		bool enableAuxPower(bool state);
 		time_t getTime();
 		uint8_t syncTime(bool force = false);
+		PreciseTime getPreciseTime(); //Millisecond timestamp without a sync, may differ from getTime() within its error bound
+		String getPreciseTimeString(); //"<seconds>.<ms>", or "null" if not anchored
+		float getDriftPpm(uint8_t clock); //DriftClock, positive if running fast. 0 until measured over at least an hour
+		int8_t getRtcTrim() { //Trim steps currently applied to the MCP79412
+			return trimStore.trim;
+		}
+		const RtcTrimStore& getRtcTrimStore() {
+			return trimStore;
+		}
+		float getTimeErrorBound(); //[s] Predicted worst error of the local clocks right now
+		unsigned long getSyncInterval(); //[s] Time from now until the next sync is needed, 60s until drift is first measured
+		const ClockConsensusResult& getTimeConsensus() { //Agreeing sources and confidence interval from the last time set
+			return syncConsensus;
+		}
+		bool startTimeSync(bool force = false);
+		uint8_t pollTimeSync();
+		uint8_t lastSyncSource() {
+			return syncSource;
+		}
 		bool startTimer(time_t period = 0); //Default to 0, if 0, use default timer period
 		bool waitUntilTimerDone();
 		// time_t getTime();
@@ -220,11 +478,71 @@ class Kestrel: public Sensor
 		String getErrors();
 		String getMetadata();
 		String selfDiagnostic(uint8_t diagnosticLevel, time_t time);
+		size_t getData(char *buffer, size_t size, time_t time, uint8_t format = ReportFormat::JSON); //Write reports directly into caller buffer, return length written
+		size_t getErrors(char *buffer, size_t size); //FIRST/LAST in seconds before the report. Codes which do not fit follow in the next report
+		size_t getMetadata(char *buffer, size_t size);
+		size_t selfDiagnostic(char *buffer, size_t size, uint8_t diagnosticLevel, time_t time, uint8_t format = ReportFormat::JSON); //CBOR_BASE64 for compact cellular reports which can still be published as text, see JsonWriter
+		ReportFramer frameReport(const char *report, size_t length) { //Split a JSON or CBOR_BASE64 report into publishes no longer than MAX_MESSAGE_LENGTH
+			return ReportFramer(report, length, currentMessageID(), MAX_MESSAGE_LENGTH);
+		}
+		uint16_t publishReport(const char *eventName, const char *report, size_t length); //Publish a report in as many frames as it needs, returns frames sent
+		int throwError(uint32_t error); //Merges repeats of a code into a count instead of filling the log
 		uint8_t totalErrors() {
-			return numErrors + rtc.numErrors; 
+			return errorStore.used + rtc.numErrors; 
+		}
+		unsigned long i2cRouteWrites() { //Number of writes actually made to the I2C routing pins
+			return routeWrites; 
+		}
+		unsigned long i2cRouteWritesSaved() { //Number of routing pin writes skipped because the pin was already in the requested state, counted once at the skip (a guard's setup and restore are separate writes)
+			return routeWritesSaved; 
+		}
+		const OperationProfile& getProfile(uint8_t op) {
+			static const OperationProfile none; //Out of range operations read as never run
+			return op < ProfileOp::COUNT ? profiles[op] : none; 
+		}
+		uint8_t gpsWakeStart();
+		uint8_t gpsPollWake();
+		bool gpsEnsureAwake();
+		bool gpsSleep();
+		uint8_t getGpsPowerState() {
+			return gpsPowerState;
+		}
+		unsigned long getGpsAwakeTime();
+		unsigned long getGpsWakeCount() { //Number of GPS_INT wake pulses issued since reset
+			return gpsWakeCount;
+		}
+		unsigned long getGpsPulsesSkipped() { //Number of wake requests satisfied without a pulse because receiver was already running
+			return gpsPulsesSkipped;
+		}
+		bool updatePvt(bool force = false);
+		const PvtSnapshot& getPvt() {
+			return pvt;
+		}
+		unsigned long getUbxTransactions() { //Number of UBX polls made since start of current wake cycle
+			return ubxTransactions;
 		}
 		bool updateLocation(bool forceUpdate = false);
 		bool connectToCell();
+		unsigned long getAlsRangeSearches() { //Number of full AutoRange searches run, compare against ALS reads in getSensorStats
+			return alsRangeSearches;
+		}
+		float getEnergyHour(uint8_t channel, uint8_t hoursAgo = 0); //[Wh] Channel 0-7 in PORT_V order, 0 = current hour
+		float getEnergyDay(uint8_t channel, uint8_t daysAgo = 0); //[Wh] 0 = current UTC day
+		float getEnergyPortHour(uint8_t port, uint8_t hoursAgo = 0); //[Wh] Talon port 1-4, share of the bulk rail while it was powered
+		float getEnergyPortDay(uint8_t port, uint8_t daysAgo = 0);
+		bool readCsa(uint8_t device, CsaReading &reading); //All four channels of csaAlpha (0) or csaBeta (1) from one refresh, accumulators are kept
+		void setInrushCapture(uint16_t duration); //[ms] Sample port current after each enablePower(port, true), 0 disables
+		const InrushSummary& getInrush(uint8_t port) { //Result of the last capture on Talon port 1-4
+			return inrush[(port >= 1 && port <= INRUSH_PORTS) ? port - 1 : 0];
+		}
+		const SensorHandle& getSensorStats(uint8_t sensor) {
+			return sensors[sensor < OnboardSensor::COUNT ? sensor : 0];
+		}
+		void setDiagnosticDelta(uint16_t keyframeInterval); //Leave unchanged fields out of selfDiagnostic, with a full keyframe every keyframeInterval reports. 0 disables
+		void forceDiagnosticKeyframe() { //Next diagnostic at every level reports every field, ie after a failed transmission
+			for(int i = 0; i < DIAG_LEVELS; i++) diagSinceKeyframe[i] = 0;
+		}
+		void confirmDiagnostic(); //Last diagnostic was delivered, deltas from here on are against the values it carried
 
         static constexpr uint8_t numTalonPorts = 5; 
 		static constexpr int MAX_MESSAGE_LENGTH = 1024; ///<Maximum number of characters allowed for single transmission 
@@ -244,7 +562,16 @@ class Kestrel: public Sensor
 		String getPosTimeString();
 		bool configTalonSense();
 		unsigned long getMessageID();
-		bool testForBat();
+		unsigned long currentMessageID(); //Same as getMessageID, but from the time already held, never starts a sync
+		bool testForBat(); //Uses CSA history when it is conclusive, otherwise runs the discharge test to completion
+		uint8_t estimateBattery(); //BatteryState from CSA history only, never blocks
+		uint8_t getBatteryState(); //Estimate, starting or polling the discharge test when ambiguous. UNKNOWN while test runs
+		uint8_t batTestStart();
+		uint8_t batTestPoll();
+		void batTestCancel(); //Restore charging if a discharge test is running, called from sleep() so CE is never left high
+		float getStateOfCharge() { //[%] Approximate, from rest voltage. Negative if no estimate
+			return batterySoc;
+		}
 		bool zeroAccel(bool reset = false);
 
 
@@ -257,7 +584,129 @@ class Kestrel: public Sensor
 		VEML3328 als;
 		Adafruit_SHT4x atmos;
 		MXC6655 accel; 
-
+		ExpanderShadow obShadow; ///<Software copy of ioOB registers, used to skip redundant writes
+		ExpanderShadow talonShadow; ///<Software copy of ioTalon registers, used to skip redundant writes
+		static constexpr uint8_t EXPANDER_OUTPUT_REG = 0x02; ///<PCAL9535A output port 0 register, port 1 follows by auto increment
+		static constexpr uint8_t EXPANDER_CONFIG_REG = 0x06; ///<PCAL9535A configuration port 0 register, port 1 follows by auto increment
+		static constexpr uint8_t EXPANDER_PULL_ENABLE_REG = 0x46; ///<PCAL9535A pull resistor enable port 0 register, port 1 follows by auto increment
+		static constexpr uint8_t EXPANDER_PULL_SELECT_REG = 0x48; ///<PCAL9535A pull resistor selection port 0 register, port 1 follows by auto increment
+		bool loadExpander(ExpanderShadow &io);
+		bool writeExpander(ExpanderShadow &io, uint16_t mask, uint16_t state);
+		bool writeExpanderPin(ExpanderShadow &io, uint8_t pin, bool state);
+		bool inputExpander(ExpanderShadow &io, uint16_t mask, bool pullup);
+		bool writeExpanderReg(ExpanderShadow &io, uint8_t reg, uint16_t &shadow, uint16_t val);
+		int readExpanderPin(ExpanderShadow &io, PCAL9535A &dev, uint8_t pin);
+		bool routeOB = false; ///<Software copy of I2C_OB_EN pin state
+		bool routeGlobal = false; ///<Software copy of I2C_GLOBAL_EN pin state
+		bool routeOBKnown = false; ///<Set once I2C_OB_EN has been driven by this driver, until then the pin is read back
+		bool routeGlobalKnown = false; ///<Set once I2C_GLOBAL_EN has been driven by this driver, until then the pin is read back
+		unsigned long routeWrites = 0;
+		unsigned long routeWritesSaved = 0;
+		unsigned long expanderOps = 0; ///<Number of register transactions made to the IO expanders through the shadow
+		OperationProfile profiles[ProfileOp::COUNT]; ///<Timing and bus cost of the major logger operations
+		static ErrorLogStore errorStore; ///<Retained, see loadErrorLog
+		SensorHandle sensors[OnboardSensor::COUNT]; ///<Lifecycle of the onboard sensors, see sensorReady
+		bool sensorReady(uint8_t sensor);
+		static constexpr uint8_t ALS_ADR = 0x10; ///<VEML3328
+		static constexpr uint8_t ALS_CLEAR_REG = 0x04; ///<Clear channel data, 16 bit little endian
+		static constexpr uint16_t ALS_SATURATED = 0xF000; ///<Clear counts above this need a less sensitive range
+		static constexpr uint16_t ALS_UNDERRANGE = 0x0800; ///<Clear counts below this (1/32 of full scale) would benefit from a more sensitive range
+		bool alsRanged = false; ///<Range from a previous AutoRange is still configured in the sensor
+		bool alsAtMinSensitivity = false; ///<Last search still saturated, don't repeat until reading drops
+		bool alsAtMaxSensitivity = false; ///<Last search still under range, don't repeat until reading rises
+		unsigned long alsRangeSearches = 0;
+		bool alsReadRaw(uint16_t &raw);
+		static constexpr float CSA_ALPHA_SENSE[4] = {2, 2, 2, 2}; ///<[mOhm] Sense resistors on csaAlpha channels
+		static constexpr float CSA_BETA_SENSE[4] = {2, 10, 10, 10}; ///<[mOhm] Sense resistors on csaBeta channels
+		static constexpr uint8_t CSA_ALPHA_BIDIR = 0x01; ///<Channels of csaAlpha set BIDIRECTIONAL in sensorReady (CH1, battery)
+		static constexpr uint8_t CSA_BETA_BIDIR = 0x00;
+		static constexpr uint8_t CSA_BETA_ADR = 0x14;
+		static constexpr uint8_t CSA_REFRESH_V = 0x1F; ///<Refresh readings without resetting accumulators
+		static constexpr uint8_t CSA_ACC_COUNT = 0x02; ///<Start of ACC_COUNT + VPOWERn_ACC block
+		static constexpr uint8_t CSA_VBUS_AVG = 0x0F; ///<Start of VBUSn_AVG + VSENSEn_AVG block
+		static constexpr uint8_t CSA_ACC_BLOCK = 3 + 4*6; ///<24 bit count and four 48 bit accumulators
+		static constexpr uint8_t CSA_AVG_BLOCK = 4*2 + 4*2; ///<Four 16 bit bus and four 16 bit sense averages
+		static constexpr uint8_t CSA_VBUS = 0x07; ///<VBUS1, instantaneous, VBUSn follow
+		static constexpr uint8_t CSA_VSENSE = 0x0B; ///<VSENSE1, instantaneous, VSENSEn follow
+		uint8_t csaAlphaAdr = 0x18; ///<0x19 on v1.9 boards, found in begin
+		static constexpr uint16_t CSA_ALPHA_SPS = 64; ///<Set in begin
+		static constexpr uint16_t CSA_BETA_SPS = 1024; ///<PAC1934 default
+		static constexpr float CSA_COUNT_TOLERANCE = 0.1; ///<ACC_COUNT may differ from elapsed time times sample rate by this fraction (internal oscillator)...
+		static constexpr float CSA_COUNT_SLACK = 0.1; ///<[s] ...plus this many seconds of samples, read latency on short intervals
+		static constexpr uint8_t ENERGY_CHANNELS = 8; ///<csaAlpha CH1-4 then csaBeta CH1-4
+		static constexpr uint8_t ENERGY_HOURS = 24;
+		static constexpr uint8_t ENERGY_DAYS = 7;
+		static constexpr uint8_t ENERGY_PORTS = 4; ///<Talon ports 1-4
+		static constexpr uint8_t TALON_BULK_CHANNEL = 3; ///<csaBeta CH4 measures the bulk rail feeding every Talon port (see configTalonSense), ports have no channel of their own
+		EnergyBaseline energyBase[2]; ///<csaAlpha, csaBeta
+		float energyHour[ENERGY_HOURS][ENERGY_CHANNELS] = {{0}}; ///<[Wh] Ring buffer, one row per UTC hour
+		float energyDay[ENERGY_DAYS][ENERGY_CHANNELS] = {{0}}; ///<[Wh] Ring buffer, one row per UTC day
+		float energyPortHour[ENERGY_HOURS][ENERGY_PORTS] = {{0}}; ///<[Wh] Bulk rail energy split across the ports powered at the time, rows as energyHour
+		float energyPortDay[ENERGY_DAYS][ENERGY_PORTS] = {{0}};
+		uint8_t energyHourIndex = 0;
+		uint8_t energyDayIndex = 0;
+		uint32_t energyHourNumber = 0; ///<Hours since epoch of row at energyHourIndex
+		uint32_t energyDayNumber = 0;
+		void accountEnergy(uint8_t device, const CsaReading &reading);
+		void accountPortEnergy(float wh);
+		bool updateBulkEnergy(float &current);
+		static constexpr uint8_t INRUSH_PORTS = 4;
+		static constexpr uint8_t INRUSH_CHANNEL[INRUSH_PORTS] = {TALON_BULK_CHANNEL, TALON_BULK_CHANNEL, TALON_BULK_CHANNEL, TALON_BULK_CHANNEL}; ///<csaBeta channel carrying each Talon port rail, all share the bulk rail (configTalonSense)
+		uint8_t csaBetaEnabled = 0x0F; ///<csaBeta channels converting, bit n = CHn+1. Power on default is all
+		static constexpr uint16_t INRUSH_SAMPLES = 256; ///<Ring buffer length, ~250ms at 1024 SPS
+		static constexpr uint16_t INRUSH_MAX_DURATION = 1000; ///<[ms]
+		static constexpr uint8_t INRUSH_FINAL_SAMPLES = 8; ///<Averaged to find the settled current
+		static constexpr float INRUSH_SETTLE_BAND = 0.1; ///<Settled within 10% of final current...
+		static constexpr float INRUSH_SETTLE_FLOOR = 0.005; ///<[A] ...or within 5mA, for ports with near zero load
+		uint16_t inrushDuration = 0; ///<[ms] 0 = capture off
+		InrushSummary inrush[INRUSH_PORTS];
+		uint16_t inrushRaw[INRUSH_SAMPLES]; ///<Raw VSENSE of the most recent capture, preallocated so capture never allocates
+		uint32_t inrushTime[INRUSH_SAMPLES]; ///<[us] Since rail enable
+		uint16_t inrushHead = 0; ///<Next slot to write
+		uint16_t inrushCount = 0; ///<Valid samples in ring
+		bool captureInrush(uint8_t port, unsigned long start, float before);
+		bool readCsaWord(uint8_t adr, uint8_t reg, uint16_t &val);
+		void binEnergy();
+		bool refreshCsa(uint8_t adr);
+		bool readCsaBulk(uint8_t adr, uint8_t bidirectional, const float sense[4], CsaReading &reading, bool refresh = true); //Without refresh, reads what the last refreshCsa latched
+		void startConversions(uint8_t conversions, OnboardSample &sample);
+		void collectConversions(OnboardSample &sample);
+		static uint8_t crc8(const uint8_t *data, size_t len);
+		static constexpr uint8_t ATMOS_ADR = 0x44; ///<SHT4x
+		static constexpr uint8_t ATMOS_MEASURE_MED = 0xF6; ///<Medium precision single shot measurement
+		static constexpr unsigned long ATMOS_CONVERSION_TIME = 5; ///<[ms] Max conversion time at medium precision
+		static constexpr unsigned long ACCEL_SETTLE_TIME = 50; ///<[ms] Time after BMA456 initialize before samples are valid
+		bool atmosPending = false; ///<SHT4x measurement triggered and not yet read
+		unsigned long atmosTriggered = 0;
+		unsigned long accelSettleStart = 0;
+		static constexpr unsigned long ACCEL_FLUSH_READS = 5; ///<BMA456 reads per sample, only the last is kept, as before the split
+		static constexpr unsigned long ACCEL_FLUSH_INTERVAL = 10; ///<[ms] Between BMA456 flush reads
+		uint8_t accelFlushed = 0; ///<BMA456 flush reads made for the current sample
+		unsigned long accelFlushLast = 0; ///<Time of last BMA456 flush read
+		static constexpr unsigned long CSA_REFRESH_TIME = 1000; ///<[us] PAC1934 registers valid this long after a refresh
+		unsigned long csaRefreshed = 0; ///<micros() of the last PAC1934 refresh
+		bool alsUpdateRange();
+		void sensorFailed(uint8_t sensor);
+		void loadErrorLog();
+		void clearErrorLog();
+		void releaseErrors(uint8_t count);
+		void writeErrorReport(JsonWriter &json, uint8_t count);
+		static void writeErrorAge(JsonWriter &json, uint32_t seen, uint32_t now);
+		size_t finishReport(JsonWriter &json, uint8_t report);
+		static void sealErrorRecord(ErrorRecord &record);
+		static uint16_t errorLogCrc(const ErrorLogStore &store);
+		static uint16_t crc16(const uint8_t *data, size_t len, uint16_t crc = 0xFFFF);
+		static constexpr size_t DIAG_BASELINE_SIZE = 16; ///<Largest tracked field, the I2C presence bitmap
+		uint8_t diagBaseline[DiagnosticField::COUNT][DIAG_BASELINE_SIZE] = {{0}}; ///<Last confirmed value of each tracked diagnostic field
+		uint16_t diagKeyframeInterval = 0; ///<Reports between full keyframes, 0 = delta mode off
+		static constexpr uint8_t DIAG_LEVELS = 6; ///<Diagnostic levels 0 to 5, each reports a different set of fields
+		uint8_t diagPending[DiagnosticField::COUNT][DIAG_BASELINE_SIZE] = {{0}}; ///<Values carried by the last diagnostic, baseline once confirmed
+		uint8_t diagPendingFields = 0; ///<Bit per DiagnosticField carried by the last diagnostic and not yet confirmed
+		uint8_t diagBaselineFields = 0; ///<Bit per DiagnosticField with a confirmed baseline, the others are always sent
+		uint16_t diagSinceKeyframe[DIAG_LEVELS] = {0}; ///<Reports at each level since its last keyframe, 0 forces the next one to be a keyframe
+		uint32_t diagSequence = 0; ///<Sequence number of delta mode diagnostics
+		bool diagKeyframe = true; ///<Current diagnostic is a keyframe
+		bool diagnosticChanged(uint8_t field, const void *data, size_t len);
 
 		
 		PCA9634 led;
@@ -281,14 +730,139 @@ class Kestrel: public Sensor
 		static void timechange_handler(system_event_t event, int param);
 		static void outOfMemoryHandler(system_event_t event, int param);
 		bool timeSyncRequested = false; ///<Used to indicate to the system that a time sync was requested from Particle and not to override
-		time_t timegm(struct tm *tm); //Portable implementation
+		time_t timegm(struct tm *tm); //UTC only, no TZ juggling, see CivilTime
+		static constexpr uint8_t GPS_ADR = 0x42; ///<Default u-blox I2C address
+		uint8_t gpsPowerState = GpsPower::OFF;
+		static constexpr uint8_t BAT_HISTORY = 16; ///<Battery samples kept for the estimator
+		static constexpr float BAT_MIN_VOLTAGE = 2.0; ///<[V] Below this nothing is connected
+		static constexpr float BAT_MIN_CURRENT = 0.005; ///<[A] Any more than this in or out needs a battery
+		static constexpr float BAT_RESISTANCE = 0.15; ///<[Ohm] Assumed cell plus wiring resistance for rest voltage
+		static constexpr unsigned long BAT_TEST_DURATION = 5000; ///<[ms] Charger cap discharge time
+		static constexpr time_t BAT_TEST_VALID = 86400; ///<[s] Discharge test result is trusted this long
+		static constexpr time_t BAT_SAMPLE_MAX_AGE = 3600; ///<[s] Older samples say nothing about the battery now, left out of the estimate
+		BatterySample batHistory[BAT_HISTORY];
+		uint8_t batHead = 0; ///<Next slot to write
+		uint8_t batCount = 0;
+		float batterySoc = -1; ///<[%]
+		uint8_t batTestState = BatteryTest::IDLE;
+		unsigned long batTestStartTime = 0; ///<millis() when charging was disabled
+		uint8_t batTestResult = BatteryState::UNKNOWN;
+		time_t batTestTime = 0; ///<When batTestResult was found
+		void addBatterySample(float voltage, float current);
+		float socFromVoltage(float voltage);
+		uint8_t gpsWakeStep = 0; ///<Step of the GPS_INT wake pulse in progress
+		unsigned long gpsStepStart = 0; ///<millis() at start of current wake pulse step
+		unsigned long gpsAwakeSince = 0; ///<millis() when receiver last left OFF/BACKUP
+		unsigned long gpsAwakeTotal = 0; ///<Accumulated time [ms] receiver has been waking or ready
+		unsigned long gpsWakeCount = 0;
+		unsigned long gpsPulsesSkipped = 0;
+		void setGpsPowerState(uint8_t state);
+		PvtSnapshot pvt; ///<Result of last NAV-PVT poll, shared by position, fix and diagnostic reporting
+		static constexpr unsigned long PVT_MAX_AGE = 1000; ///<Reuse PVT snapshot for up to 1 navigation period [ms]
+		unsigned long ubxTransactions = 0;
+		static constexpr int UBX_CACHE_SIZE = 4; ///<Number of distinct UBX messages cached
+		static constexpr uint16_t UBX_CACHE_PAYLOAD = sizeof(UbxCacheEntry::payload); 
+		static constexpr unsigned long UBX_STATUS_MAX_AGE = 60000; ///<Receiver status is reused across a wake cycle, polled fresh by each time sync [ms]
+		static uint8_t ubxBuffer[MAX_PAYLOAD_SIZE]; ///<Single receive buffer shared by all UBX polls, kept off the stack
+		static const uint8_t ubxEmptyPayload[UBX_CACHE_PAYLOAD]; ///<All zero payload used before a message is polled
+		UbxCacheEntry ubxCache[UBX_CACHE_SIZE];
+		bool ubxCfgSized = false; ///<Set once library packet buffer has been sized
+		static constexpr uint16_t UBX_MAX_WAIT = 1500; ///<[ms] Longest a poll waits for the response by default
+		bool pollUbx(uint8_t cls, uint8_t id, const uint8_t *&payload, unsigned long maxAge, uint16_t maxWait = UBX_MAX_WAIT); //Time payloads used to set clocks are always polled with maxAge 0
+		void clearUbxCache();
+		bool gpsPresent();
+		void pollCellSync();
+		void pollGpsSync();
+		uint8_t finishTimeSync();
+		static constexpr uint8_t LEG_DONE = 0; ///<Sync leg has reported (or failed)
+		static constexpr uint8_t CELL_WAIT_PENDING = 1; ///<Waiting for Particle to assert a sync
+		static constexpr uint8_t CELL_WAIT_DONE = 2; ///<Waiting for Particle sync to complete
+		static constexpr uint8_t GPS_WAKING = 1; ///<Waiting on GPS power manager, then polls NAV-TIMEUTC
+		static constexpr uint8_t GPS_ANCHOR = 2; ///<Polling NAV-TIMEUTC once per step for the next navigation epoch
+		uint8_t syncStatus = SyncStatus::IDLE;
+		uint8_t syncCellLeg = LEG_DONE;
+		uint8_t syncGpsLeg = LEG_DONE;
+		unsigned long syncCellStart = 0; ///<millis() at start of current cell leg step
+		unsigned long syncCellRequested = 0; ///<millis() when Particle.syncTime was sent, bounds how stale the time it sets can be
+		bool syncForce = false; ///<Force time set at the end of the sync in flight
+		bool syncAuxState = false; ///<Aux power state before sync began, restored at the end
+		time_t syncParticleTime = 0; ///<Particle RTC time captured at start of sync, all sources are compared to this
+		unsigned long sourceCaptured[6] = {0}; ///<millis() each entry of times was read at, finishTimeSync ages them all to one instant
+		uint8_t syncSource = TimeSource::NONE; ///<Source selected by the last completed sync
+		time_t syncPreviousTime = 0; ///<Time of last good sync, used for increment source
+		unsigned long syncPreviousMillis = 0; ///<millis() at last good sync, used for increment source
 		time_t maxTimeError = 30; //Max time error allowed between clock sources [seconds]
 		bool timeGood = false; ///<Keep track of the legitimacy of the time based on the last sync attempt
 		const uint8_t numClockSources = 6; 
     	bool sourceRequested[6] = {true, true, true, true, true, true}; ///<Keep track of which clock sources were asked for at each interval
 		bool sourceAvailable[6] = {false, false, false, false, false, false}; ///<Keep track of which sources are available for testing against
-    	String sourceNames[6] = {"GPS","CELL","GPS_RTC","RTC","INC","LOCAL"}; 
+    	const char *sourceNames[6] = {"GPS","CELL","GPS_RTC","RTC","INC","LOCAL"}; 
 		time_t times[6] = {0}; ///<Actual time storage from last time check: gpsSatTime, cellTime, gpsTime, rtcTime, incrementTime, particleTime  
+		const uint8_t sourceWeight[6] = {2, 2, 1, 1, 1, 0}; ///<Remote sources count double, so GPS and cell agreeing outweigh every local clock together. A lone remote source is not left to weight, finishTimeSync requires it in the result
+		ClockConsensusResult syncConsensus; ///<Result of the last consensus run
+		static constexpr uint8_t DRIFT_HISTORY = 8; ///<Offset measurements kept per clock
+		static constexpr uint8_t DRIFT_MIN_SAMPLES = 2; ///<Needed before the measured drift is reported or used for millis()
+		static constexpr float DRIFT_MIN_ELAPSED = 600; ///<[s] Shortest interval worth a measurement
+		static constexpr float DRIFT_MIN_SPAN = 3600; ///<[s] Longest measurement must cover this before the drift is reported, resolution is then 278ppm or better
+		static constexpr float DRIFT_RESOLUTION = 1.0; ///<[s] Offsets are differences of whole second readings
+		static constexpr float SYNC_SET_ERROR = 2.0; ///<[s] Clock set from a remote source and read back, whole second resolution at each end
+		static constexpr unsigned long SYNC_MIN_INTERVAL = 60; ///<[s]
+		static constexpr unsigned long SYNC_MAX_INTERVAL = 21600; ///<[s] Sync at least 4 times a day regardless of model
+		static constexpr float SYNC_ERROR_MARGIN = 0.5; ///<Resync when predicted error reaches this fraction of maxTimeError
+		float driftOffset[DriftClock::COUNT][DRIFT_HISTORY] = {{0}}; ///<[s] Offset from reference, relative to offset at base time
+		float driftElapsed[DriftClock::COUNT][DRIFT_HISTORY] = {{0}}; ///<[s] Reference time since base time
+		uint8_t driftHead[DriftClock::COUNT] = {0};
+		uint8_t driftCount[DriftClock::COUNT] = {0};
+		float driftPpm[DriftClock::COUNT] = {0};
+		float driftUncertainty[DriftClock::COUNT] = {0}; ///<[ppm] Worst slope error from DRIFT_RESOLUTION on every measurement
+		float driftSpan[DriftClock::COUNT] = {0}; ///<[s] Longest measurement held
+		time_t driftBaseTime[DriftClock::COUNT] = {0}; ///<Reference time the clock was last set, or first measured
+		float driftBaseOffset[DriftClock::COUNT] = {0}; ///<[s] Offset at base time, 0 after a set
+		void markClockSet(uint8_t clock, time_t reference, float offset);
+		float driftRate(uint8_t clock); //[ppm] Worst rate the clock can be drifting at, measured drift plus its uncertainty. -1 until measured
+		bool driftKnown(uint8_t clock);
+		float setError(); //[s] Error of the clocks right after the last set
+		float budgetRemaining(uint8_t clock, time_t now); //[s] Until the clock's worst case error reaches its share of maxTimeError, 0 if drift is unknown
+		bool budgetUsed(uint8_t clock, time_t offset, time_t now); //Clock measured offset from the reference must be set now
+		static constexpr unsigned long GPS_ANCHOR_WINDOW = 1200; ///<[ms] No anchor poll starts after this, 1Hz nav rate plus margin
+		static constexpr uint16_t GPS_ANCHOR_POLL_WAIT = 500; ///<[ms] maxWait of each anchor poll, two library checks at 1Hz nav rate. Capture ends within GPS_ANCHOR_WINDOW plus this
+		static constexpr unsigned long GPS_SOLUTION_LATENCY = 50; ///<[ms] Typical delay from epoch to solution being available...
+		static constexpr unsigned long GPS_LATENCY_ERROR = 50; ///<[ms] ...and allowance for how far it varies
+		static constexpr unsigned long CELL_ANCHOR_ERROR = 1000; ///<[ms] Whole second server stamp read back as whole seconds, before the sync latency is added
+		static constexpr unsigned long ANCHOR_REFRESH_ERROR = 100; ///<[ms] Only spend time on a new GPS anchor once the error bound grows past this
+		static constexpr float MILLIS_DRIFT_PPM = 50; ///<Assumed millis() drift until the drift model has measured it
+		bool anchorValid = false;
+		time_t anchorSeconds = 0; ///<UTC at anchorMillis
+		uint16_t anchorMs = 0; ///<[ms] Sub-second part of anchor
+		unsigned long anchorMillis = 0; ///<millis() at the anchor
+		unsigned long anchorError = 0; ///<[ms] Error bound at the anchor
+		uint8_t anchorSource = TimeSource::NONE;
+		void setAnchor(time_t seconds, long ms, unsigned long atMillis, unsigned long error, uint8_t source);
+		uint32_t anchorEpoch = 0; ///<[ms] iTOW of the epoch the GPS anchor capture is waiting to see change
+		unsigned long anchorPollStart = 0; ///<millis() at start of the last poll that still saw anchorEpoch
+		unsigned long anchorWindowStart = 0; ///<millis() the anchor capture started, no poll starts GPS_ANCHOR_WINDOW after it
+		void startGpsAnchor(const uint8_t *timePayload, unsigned long pollStart);
+		void pollGpsAnchor();
+		static RtcTrimStore trimStore; ///<Retained, see loadRtcTrim
+		static constexpr uint8_t RTC_ADR = 0x6F;
+		static constexpr uint8_t RTC_OSCTRIM = 0x08;
+		static constexpr float TRIM_PPM_PER_STEP = 1.017; ///<2 clocks per minute at 32.768kHz
+		static constexpr time_t TRIM_WINDOW = 259200; ///<[s] 3 days, 1s resolution is ~3.9ppm, each set during the window adds as much again
+		static constexpr time_t TRIM_REFERENCE_AGREE = 7; ///<[s] GPS is only a trim reference when cell time, if present, is this close to it
+		static constexpr float TRIM_MAX_PPM = 200; ///<Larger drift or jumps mean a bad reference or a failing RTC, not something to trim out
+		bool trimWindowOpen = false;
+		time_t trimWindowStart = 0; ///<GPS time at start of the measurement window
+		float trimStartGained = 0; ///<[s] RTC gain at window start
+		float trimLastGained = 0; ///<[s] RTC gain at last accepted sample
+		time_t trimLastTime = 0; ///<GPS time of last accepted sample
+		float trimSetCorrection = 0; ///<[s] Offset removed from the RTC by setTime during the window
+		uint8_t trimSets = 0; ///<Sets carried in trimSetCorrection this window, each is whole seconds and adds 1s of uncertainty
+		uint8_t trimSetsSinceSample = 0; ///<Sets since the last accepted sample
+		void loadRtcTrim();
+		static uint16_t rtcTrimCrc(const RtcTrimStore &store);
+		bool writeRtcTrim(int8_t trim);
+		void trackRtcTrim(time_t rtcTime, time_t gpsTime);
+		void recordDrift(uint8_t clock, time_t clockTime, time_t reference);
 		int8_t timeSourceA = 5;
 		int8_t timeSourceB = 5;
 		// uint8_t timeSource = 0; ///<Keep track of where the time is coming from
@@ -300,10 +874,15 @@ class Kestrel: public Sensor
 		time_t posTime = 0; ///<Time last postition measurment was taken
 		bool initDone = false; //Used to keep track if the initaliztion has run - used by hasReset() 
 		struct tm timeinfo = {0}; //Create struct in C++ time land
-		time_t cstToUnix(int year, int month, int day, int hour, int minute, int second);
+		time_t cstToUnix(int year, int month, int day, int hour, int minute, int second) {
+			return CivilTime::toUnix(year, month, day, hour, minute, second);
+		}
 		uint8_t accelUsed = AccelType::MXC6655; //Default to MXC6655, only change is BMA456 is detected 
 		uint8_t boardVersion = HardwareVersion::PRE_1v9; //Assume pre v1.8 to start
 		bool reportSensors = false; //Default to sensor report being false
+		static constexpr size_t REPORT_BUFFER_SIZE = 2*MAX_MESSAGE_LENGTH; ///<Room for the largest (level 0 diagnostic) report
+		static char frameBuffer[MAX_MESSAGE_LENGTH + 1]; ///<One publish worth of framed report
+		static char reportBuffer[REPORT_BUFFER_SIZE]; ///<Shared output buffer for String report functions, keeps reports off the heap until the final copy
 };		
 
 // constexpr uint8_t Kestrel::numTalonPorts; 
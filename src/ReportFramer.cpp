@@ -0,0 +1,59 @@
+/******************************************************************************
+ReportFramer
+Splits Kestrel reports to fit the maximum transmission length
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#include "ReportFramer.h"
+#include <stdio.h>
+#include <string.h>
+
+ReportFramer::ReportFramer(const char *report, size_t length, unsigned long messageID, size_t maxLength) : report(report), length(length), id(messageID), maxLength(maxLength)
+{
+    if(memchr(report, '\0', length) != nullptr) return; //Binary, would be cut at the first NUL when published. Leave parts at 0
+    if(length <= maxLength) { //Fits as is, no header needed
+        parts = 1;
+        payloadLength = length;
+        return;
+    }
+    uint16_t estimate = 1;
+    while(true) { //Header grows with the digits of the part count, iterate until count is stable
+        size_t header = headerLength(estimate);
+        if(header >= maxLength) return; //No room for payload, leave parts at 0
+        size_t payload = maxLength - header;
+        size_t needed = (length + payload - 1)/payload;
+        if(needed > 0xFFFF) return;
+        if(needed <= estimate) {
+            parts = needed;
+            payloadLength = payload;
+            return;
+        }
+        estimate = needed;
+    }
+}
+
+size_t ReportFramer::headerLength(uint16_t part)
+{
+    return snprintf(nullptr, 0, "{\"ID\":%lu,\"Part\":%u,\"Parts\":%u}", id, (unsigned)part, (unsigned)part); //Worst case, part number as wide as the count
+}
+
+size_t ReportFramer::frame(uint16_t index, char *buffer, size_t size)
+{
+    if(index >= parts) return 0;
+    size_t start = index*payloadLength;
+    size_t payload = min(payloadLength, length - start);
+    size_t header = 0;
+    if(parts > 1) {
+        int written = snprintf(buffer, size, "{\"ID\":%lu,\"Part\":%u,\"Parts\":%u}", id, (unsigned)(index + 1), (unsigned)parts);
+        if(written < 0 || (size_t)written >= size) return 0;
+        header = written;
+    }
+    if(header + payload >= size) return 0; //Leave room for terminator
+    memcpy(&buffer[header], &report[start], payload);
+    buffer[header + payload] = '\0';
+    return header + payload;
+}
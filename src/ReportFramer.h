@@ -0,0 +1,43 @@
+/******************************************************************************
+ReportFramer
+Splits Kestrel reports to fit the maximum transmission length
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+A report that already fits is passed through unchanged. Longer reports are cut
+into frames of the form {"ID":<id>,"Part":<n>,"Parts":<total>}<payload>, where
+the payloads concatenated in part order give back the original report. Every
+frame is filled to the limit except the last, so the number of publishes is
+the minimum possible. Frames are published as C strings, so reports must be
+text: JSON or CBOR_BASE64. Raw CBOR carries NUL bytes and is refused, count()
+is 0 for it.
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#ifndef ReportFramer_h
+#define ReportFramer_h
+
+#include <Particle.h>
+
+class ReportFramer
+{
+    public:
+        ReportFramer(const char *report, size_t length, unsigned long messageID, size_t maxLength);
+        uint16_t count() { //Number of frames needed, 0 if limit is too small to carry any payload
+            return parts;
+        }
+        size_t frame(uint16_t index, char *buffer, size_t size); //Write frame 0 to count() - 1 into buffer, returns frame length or 0 on failure
+
+    private:
+        const char *report;
+        size_t length;
+        unsigned long id;
+        size_t maxLength;
+        uint16_t parts = 0;
+        size_t payloadLength = 0; ///<Bytes of report carried in every frame but the last
+        size_t headerLength(uint16_t part);
+};
+
+#endif
@@ -0,0 +1,40 @@
+/******************************************************************************
+Check
+Minimal assertions for the host tests
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#ifndef Check_h
+#define Check_h
+
+#include <stdio.h>
+
+static int checkFailures = 0;
+
+#define CHECK(condition) do { \
+	if(!(condition)) { \
+		printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+		checkFailures++; \
+	} \
+} while(0)
+
+#define CHECK_NEAR(a, b, tolerance) do { \
+	double checkA = (a); \
+	double checkB = (b); \
+	if(checkA - checkB > (tolerance) || checkB - checkA > (tolerance)) { \
+		printf("%s:%d: CHECK_NEAR(%s, %s) failed: %g vs %g\n", __FILE__, __LINE__, #a, #b, checkA, checkB); \
+		checkFailures++; \
+	} \
+} while(0)
+
+static int checkResult(const char *name)
+{
+	printf("%s: %s\n", name, checkFailures == 0 ? "PASS" : "FAIL");
+	return checkFailures == 0 ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,85 @@
+/******************************************************************************
+anchor_test
+Precise time anchors from GPS and cell, stepped without blocking the caller
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#include <Kestrel.h>
+#include <Sim.h>
+#include <math.h>
+#include "Check.h"
+
+static unsigned long longestStep = 0; ///<[ms]
+
+static void sync(Kestrel &logger)
+{
+	//Step the sync as a caller doing other work between steps would
+	longestStep = 0;
+	logger.startTimeSync(true);
+	for(int i = 0; i < 20000 && logger.pollTimeSync() == SyncStatus::IN_PROGRESS; i++) {
+		uint64_t stepStart = Sim::now();
+		delay(1);
+		logger.pollTimeSync();
+		unsigned long step = (Sim::now() - stepStart)/1000;
+		if(step > longestStep) longestStep = step;
+	}
+}
+
+static double anchorError(Kestrel &logger, PreciseTime &precise)
+{
+	precise = logger.getPreciseTime();
+	return fabs(precise.seconds + precise.milliseconds/1000.0 - Sim::utc())*1000.0; //[ms]
+}
+
+int main()
+{
+	bool criticalFault = false;
+	bool fault = false;
+	PreciseTime precise;
+
+	//GPS anchor, one short poll per step and the edge inside its error
+	{
+		Sim::reset();
+		Kestrel logger(true);
+		logger.begin(Time.now(), criticalFault, fault);
+		sync(logger);
+		double error = anchorError(logger, precise);
+		printf("GPS: %.0fms off, bound %lums, longest step %lums\n", error, precise.error, longestStep);
+		CHECK(precise.valid && precise.source == TimeSource::GPS);
+		CHECK(error <= precise.error);
+		CHECK(longestStep <= 510); //One anchor poll, not the whole window
+	}
+
+	//Slow receiver, anchor polls still give up within their own short wait
+	{
+		Sim::reset();
+		Kestrel logger(true);
+		logger.begin(Time.now(), criticalFault, fault);
+		Sim::board.gnss.responseTime = 400;
+		sync(logger);
+		printf("Slow GPS: longest step %lums\n", longestStep);
+		CHECK(longestStep <= 1010); //Fix read is two polls, each seen on a library check
+	}
+
+	//Cell only with a slow round trip, the latency is inside the bound
+	const unsigned long latencies[3] = {200, 800, 3000};
+	for(unsigned long latency : latencies) {
+		Sim::reset();
+		Sim::board.gnss.fixType = 0;
+		Sim::board.gnss.gnssFixOk = false;
+		Sim::board.gnss.timeValid = false;
+		Sim::particle.syncLatency = latency;
+		Kestrel logger(true);
+		logger.begin(Time.now(), criticalFault, fault);
+		sync(logger);
+		double error = anchorError(logger, precise);
+		printf("Cell, %lums latency: %.0fms off, bound %lums\n", latency, error, precise.error);
+		CHECK(precise.valid && precise.source == TimeSource::CELLULAR);
+		CHECK(error <= precise.error);
+	}
+	return checkResult("anchor_test");
+}
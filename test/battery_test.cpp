@@ -0,0 +1,107 @@
+/******************************************************************************
+battery_test
+Battery presence from CSA history, and the discharge test it falls back on
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#include <Kestrel.h>
+#include <Sim.h>
+#include "Check.h"
+
+static char report[2048];
+
+static bool chargeDisabled()
+{
+	return Sim::board.ioOB.levels() & (1 << Sim::BoardPins::OB_CE);
+}
+
+static uint8_t estimate(float voltage, float current)
+{
+	//Fresh logger with one CSA sample of history
+	Sim::reset();
+	Kestrel logger(true);
+	bool criticalFault = false;
+	bool fault = false;
+	logger.begin(Time.now(), criticalFault, fault);
+	Sim::board.csaAlpha.vbus[0] = voltage;
+	Sim::board.csaAlpha.current[0] = current;
+	logger.selfDiagnostic(report, sizeof(report), 4, Time.now());
+	return logger.estimateBattery();
+}
+
+int main()
+{
+	//Only current proves a cell, a bare charger can sit anywhere between min voltage and its set point
+	CHECK(estimate(3.7, 0.05) == BatteryState::PRESENT);
+	CHECK(estimate(3.7, 0) == BatteryState::AMBIGUOUS);
+	CHECK(estimate(4.2, 0) == BatteryState::AMBIGUOUS);
+	CHECK(estimate(2.5, 0) == BatteryState::AMBIGUOUS);
+	CHECK(estimate(1.0, 0) == BatteryState::ABSENT);
+
+	Sim::reset();
+	Kestrel logger(true);
+	bool criticalFault = false;
+	bool fault = false;
+	logger.begin(Time.now(), criticalFault, fault);
+	Sim::board.csaAlpha.vbus[0] = 3.9;
+	Sim::board.csaAlpha.current[0] = 0;
+	logger.selfDiagnostic(report, sizeof(report), 4, Time.now());
+
+	//Ambiguous history starts the discharge test, sleeping before it is done restores charging
+	CHECK(logger.getBatteryState() == BatteryState::UNKNOWN);
+	CHECK(chargeDisabled());
+	logger.sleep();
+	CHECK(!chargeDisabled());
+
+	//Left to run its time, the test finishes and charging comes back on
+	CHECK(logger.getBatteryState() == BatteryState::UNKNOWN);
+	CHECK(chargeDisabled());
+	delay(5000);
+	CHECK(logger.getBatteryState() == BatteryState::PRESENT);
+	CHECK(!chargeDisabled());
+	CHECK(logger.getBatteryState() == BatteryState::PRESENT); //Result stands without another test
+	CHECK(!chargeDisabled());
+
+	//PRESENT history does not outlive the cell, once current stops and the rail collapses it is gone
+	Sim::reset();
+	Kestrel history(true);
+	history.begin(Time.now(), criticalFault, fault);
+	Sim::board.csaAlpha.vbus[0] = 3.9;
+	Sim::board.csaAlpha.current[0] = 0.05;
+	for(int i = 0; i < 4; i++) {
+		history.selfDiagnostic(report, sizeof(report), 4, Time.now());
+		delay(600000);
+	}
+	CHECK(history.estimateBattery() == BatteryState::PRESENT);
+	Sim::board.csaAlpha.vbus[0] = 0.5;
+	Sim::board.csaAlpha.current[0] = 0;
+	history.selfDiagnostic(report, sizeof(report), 4, Time.now());
+	CHECK(history.estimateBattery() == BatteryState::ABSENT);
+
+	//Nor does it once it is older than the cutoff, a bare charger at rest is ambiguous again
+	Sim::board.csaAlpha.vbus[0] = 3.9;
+	Sim::board.csaAlpha.current[0] = 0.05;
+	history.selfDiagnostic(report, sizeof(report), 4, Time.now());
+	CHECK(history.estimateBattery() == BatteryState::PRESENT);
+	delay(2UL*3600000UL);
+	Sim::board.csaAlpha.current[0] = 0;
+	history.selfDiagnostic(report, sizeof(report), 4, Time.now());
+	CHECK(history.estimateBattery() == BatteryState::AMBIGUOUS);
+
+	//Test that has run its time when sleep comes is finished there rather than thrown away
+	Sim::reset();
+	Kestrel sleeper(true);
+	sleeper.begin(Time.now(), criticalFault, fault);
+	Sim::board.csaAlpha.vbus[0] = 0.5;
+	Sim::board.csaAlpha.current[0] = 0;
+	CHECK(sleeper.batTestStart() == BatteryTest::DISCHARGING);
+	delay(5000);
+	sleeper.sleep();
+	CHECK(!chargeDisabled());
+	CHECK(sleeper.getBatteryState() == BatteryState::ABSENT);
+	return checkResult("battery_test");
+}
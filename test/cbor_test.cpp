@@ -0,0 +1,113 @@
+/******************************************************************************
+cbor_test
+Size of CBOR reports against JSON, and the base64 armor used to publish them
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#include <Kestrel.h>
+#include <Sim.h>
+#include <string.h>
+#include "Check.h"
+
+static char json[2048];
+static char cbor[2048];
+static char armored[2048];
+static uint8_t unarmored[2048];
+static char decoded[2048];
+
+static void compare(const char *name, size_t jsonLength, size_t cborLength, size_t armoredLength)
+{
+	//Armored report is text, publishable as is, and still smaller than the JSON
+	printf("%s: JSON %u bytes, CBOR %u bytes (%.0f%%), base64 %u bytes (%.0f%%)\n", name, (unsigned)jsonLength, (unsigned)cborLength, 100.0*cborLength/jsonLength, (unsigned)armoredLength, 100.0*armoredLength/jsonLength);
+	CHECK(jsonLength > 0);
+	CHECK(cborLength > 0);
+	CHECK(armoredLength == 4*((cborLength + 2)/3));
+	CHECK(strlen(armored) == armoredLength);
+	CHECK(armoredLength < jsonLength);
+
+	size_t length = JsonWriter::fromBase64(armored, armoredLength, unarmored, sizeof(unarmored));
+	CHECK(length == cborLength);
+	CHECK(JsonWriter::decode(unarmored, length, decoded, sizeof(decoded)) > 0);
+	CHECK(strncmp(decoded, json, 11) == 0); //Same "Kestrel":{ blob, energy fields move on between the calls so compare structure only
+}
+
+int main()
+{
+	Sim::reset();
+	Kestrel logger(true);
+	bool criticalFault = false;
+	bool fault = false;
+	logger.begin(Time.now(), criticalFault, fault);
+	time_t now = Time.now();
+
+	//One report of each format, taken back to back
+	size_t jsonLength = logger.getData(json, sizeof(json), now);
+	size_t cborLength = logger.getData(cbor, sizeof(cbor), now, ReportFormat::CBOR);
+	size_t armoredLength = logger.getData(armored, sizeof(armored), now, ReportFormat::CBOR_BASE64);
+	compare("getData", jsonLength, cborLength, armoredLength);
+
+	jsonLength = logger.selfDiagnostic(json, sizeof(json), 2, now);
+	cborLength = logger.selfDiagnostic(cbor, sizeof(cbor), 2, now, ReportFormat::CBOR);
+	armoredLength = logger.selfDiagnostic(armored, sizeof(armored), 2, now, ReportFormat::CBOR_BASE64);
+	compare("selfDiagnostic", jsonLength, cborLength, armoredLength);
+
+	//Exact round trip of a fixed report, JSON -> CBOR_BASE64 -> CBOR -> JSON
+	{
+		const uint8_t present[16] = {0x00, 0x00, 0x11};
+		for(int format = ReportFormat::JSON; format <= ReportFormat::CBOR_BASE64; format++) {
+			JsonWriter writer(format == ReportFormat::JSON ? json : armored, sizeof(json), format);
+			writer.beginObject("Kestrel");
+			writer.beginArray("PORT_V").value(3.899902f, 6).value(0.0f, 6).endArray();
+			writer.key("RH").value(44.9995f, 4).key("SIV").value(9).key("I2C").bitmap(present, 128);
+			writer.beginArray("CODES").hex(0xF00D0300).endArray();
+			writer.key("Time Fix").value(true).key("INC").null().key("Unlisted").value("text");
+			writer.endObject();
+			writer.finish();
+			CHECK(!writer.overflow());
+		}
+		size_t length = JsonWriter::fromBase64(armored, strlen(armored), unarmored, sizeof(unarmored));
+		CHECK(JsonWriter::decode(unarmored, length, decoded, sizeof(decoded)) == strlen(json));
+		CHECK(strcmp(decoded, json) == 0);
+	}
+
+	//Armor that does not fit is an overflow like any other, never a cut report
+	char small[64];
+	CHECK(logger.selfDiagnostic(small, sizeof(small), 2, now, ReportFormat::CBOR_BASE64) == 0);
+	CHECK(small[0] == '\0');
+
+	//Every tail length of the armor round trips, CBOR length 1 + n covers each remainder of 3
+	for(int n = 0; n < 6; n++) {
+		char plain[16];
+		char text[16];
+		uint8_t back[16];
+		JsonWriter raw(plain, sizeof(plain), ReportFormat::CBOR);
+		JsonWriter armor(text, sizeof(text), ReportFormat::CBOR_BASE64);
+		for(int i = 0; i < n; i++) {
+			raw.value(i);
+			armor.value(i);
+		}
+		armor.finish();
+		CHECK(!armor.overflow());
+		CHECK(JsonWriter::fromBase64(text, armor.length(), back, sizeof(back)) == raw.length());
+		CHECK(memcmp(back, plain, raw.length()) == 0);
+	}
+	uint8_t back[8];
+	CHECK(JsonWriter::fromBase64("AP8QAH+AAAE=", 12, back, sizeof(back)) == 8);
+	CHECK(back[0] == 0x00 && back[1] == 0xFF && back[7] == 0x01);
+	CHECK(JsonWriter::fromBase64("QQ=", 3, back, sizeof(back)) == 0); //Not a whole group
+	CHECK(JsonWriter::fromBase64("A=A=", 4, back, sizeof(back)) == 0); //Data after padding
+
+	//Values which round to zero are unsigned in JSON, the same as the CBOR decodes to
+	JsonWriter text(json, sizeof(json));
+	text.beginArray().value(-0.001f).value(-0.0f).value(-0.005f, 3).endArray();
+	CHECK(strcmp(json, "[0.00,0.00,-0.005]") == 0);
+	JsonWriter binary(cbor, sizeof(cbor), ReportFormat::CBOR);
+	binary.key("Temperature").beginArray().value(-0.001f).value(-0.0f).value(-0.005f, 3).endArray();
+	CHECK(JsonWriter::decode((const uint8_t*)cbor, binary.length(), decoded, sizeof(decoded)) > 0);
+	CHECK(strcmp(decoded, "\"Temperature\":[0.00,0.00,-0.005]") == 0);
+	return checkResult("cbor_test");
+}
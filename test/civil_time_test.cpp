@@ -0,0 +1,92 @@
+/******************************************************************************
+civil_time_test
+CivilTime against the C library over every day of a 1000 year span, and the cost of each
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#include <CivilTime.h>
+#include <chrono>
+#include <stdio.h>
+#include <time.h>
+#include "Check.h"
+
+struct DateTime {
+	int year;
+	int month;
+	int day;
+	int hour;
+	int minute;
+	int second;
+};
+
+static time_t libcToUnix(int year, int month, int day, int hour, int minute, int second)
+{
+	struct tm timeinfo = {0};
+	timeinfo.tm_year = year - 1900;
+	timeinfo.tm_mon = month - 1;
+	timeinfo.tm_mday = day;
+	timeinfo.tm_hour = hour;
+	timeinfo.tm_min = minute;
+	timeinfo.tm_sec = second;
+	return timegm(&timeinfo);
+}
+
+int main()
+{
+	//Every day from 1600 to 2600, both directions, with a time of day that moves through every hour, minute and second
+	const time_t start = libcToUnix(1600, 1, 1, 0, 0, 0);
+	const time_t end = libcToUnix(2600, 1, 1, 0, 0, 0);
+	unsigned long days = 0;
+	unsigned long mismatches = 0;
+	for(time_t day = start; day < end; day += 86400) {
+		time_t time = day + (days*3607) % 86400;
+		struct tm expected;
+		gmtime_r(&time, &expected);
+		DateTime date;
+		CivilTime::fromUnix(time, date);
+		if(date.year != expected.tm_year + 1900 || date.month != expected.tm_mon + 1 || date.day != expected.tm_mday || date.hour != expected.tm_hour || date.minute != expected.tm_min || date.second != expected.tm_sec) mismatches++;
+		if(CivilTime::toUnix(date) != time) mismatches++;
+		if(CivilTime::daysFromCivil(date.year, date.month, date.day) != (day - libcToUnix(1970, 1, 1, 0, 0, 0))/86400) mismatches++;
+		days++;
+	}
+	printf("%lu days checked, %lu mismatches\n", days, mismatches);
+	CHECK(days == 365243);
+	CHECK(mismatches == 0);
+
+	//Second before and after midnight either side of the epoch
+	DateTime date;
+	CivilTime::fromUnix(-1, date);
+	CHECK(date.year == 1969 && date.month == 12 && date.day == 31 && date.hour == 23 && date.minute == 59 && date.second == 59);
+	CivilTime::fromUnix(86400, date);
+	CHECK(date.year == 1970 && date.month == 1 && date.day == 2 && date.hour == 0 && date.second == 0);
+	CHECK(CivilTime::toUnix(2024, 2, 29, 12, 0, 0) == libcToUnix(2024, 2, 29, 12, 0, 0));
+	CHECK(CivilTime::toUnix(2100, 3, 1, 0, 0, 0) - CivilTime::toUnix(2100, 2, 28, 0, 0, 0) == 86400); //2100 is not a leap year
+
+	//Cost against the C library it replaced, per conversion
+	const int runs = 1000000;
+	volatile time_t sink = 0;
+	auto t0 = std::chrono::steady_clock::now();
+	for(int i = 0; i < runs; i++) sink = sink + CivilTime::toUnix(2000 + (i & 63), 1 + (i % 12), 1 + (i % 28), i % 24, i % 60, i % 60);
+	auto t1 = std::chrono::steady_clock::now();
+	for(int i = 0; i < runs; i++) sink = sink + libcToUnix(2000 + (i & 63), 1 + (i % 12), 1 + (i % 28), i % 24, i % 60, i % 60);
+	auto t2 = std::chrono::steady_clock::now();
+	for(int i = 0; i < runs; i++) {
+		CivilTime::fromUnix((time_t)1700000000 + i*7919L, date);
+		sink = sink + date.second;
+	}
+	auto t3 = std::chrono::steady_clock::now();
+	for(int i = 0; i < runs; i++) {
+		time_t time = (time_t)1700000000 + i*7919L;
+		struct tm result;
+		gmtime_r(&time, &result);
+		sink = sink + result.tm_sec;
+	}
+	auto t4 = std::chrono::steady_clock::now();
+	printf("toUnix: %.1f ns, timegm: %.1f ns\n", std::chrono::duration<double, std::nano>(t1 - t0).count()/runs, std::chrono::duration<double, std::nano>(t2 - t1).count()/runs);
+	printf("fromUnix: %.1f ns, gmtime_r: %.1f ns\n", std::chrono::duration<double, std::nano>(t3 - t2).count()/runs, std::chrono::duration<double, std::nano>(t4 - t3).count()/runs);
+	return checkResult("civil_time_test");
+}
@@ -0,0 +1,97 @@
+/******************************************************************************
+consensus_test
+Time source consensus, on its own and as finishTimeSync uses it
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#include <Kestrel.h>
+#include <Sim.h>
+#include "Check.h"
+
+static const uint8_t weights[5] = {2, 2, 1, 1, 1}; //GPS, CELL, GPS_RTC, RTC, INC as finishTimeSync registers them
+static const time_t halfWidth = 15; //maxTimeError/2
+
+static ClockConsensusResult run(const time_t *offsets, uint8_t available, uint8_t required = ClockConsensusResult::NONE)
+{
+	ClockConsensus consensus;
+	for(uint8_t i = 0; i < 5; i++) {
+		if(available & (1 << i)) consensus.add(i, 1700000000 + offsets[i], halfWidth, weights[i]);
+	}
+	return consensus.resolve(required);
+}
+
+int main()
+{
+	//Pairwise window is maxTimeError, strictly less than, as the checks it replaced
+	{
+		const time_t offsets[5] = {0, 29, 0, 0, 0};
+		ClockConsensusResult result = run(offsets, 0x03);
+		CHECK(result.members == 2);
+		CHECK(result.primary == TimeSource::GPS && result.secondary == TimeSource::CELLULAR);
+		CHECK(result.time == 1700000000);
+		const time_t apart[5] = {0, 30, 0, 0, 0};
+		CHECK(run(apart, 0x03).members == 1);
+	}
+
+	//Set time is the primary's own reading, never moved toward the others
+	{
+		const time_t offsets[5] = {0, 0, 0, 20, 0};
+		ClockConsensusResult result = run(offsets, 0x09); //GPS and RTC
+		CHECK(result.members == 2);
+		CHECK(result.time == 1700000000);
+		CHECK(result.low == 1700000000 + 20 - 15 && result.high == 1700000000 + 15);
+	}
+
+	//Lone cell against GPS_RTC, RTC and INC agreeing elsewhere, weight alone picks the local clocks
+	{
+		const time_t offsets[5] = {0, 0, 100, 100, 100};
+		CHECK(run(offsets, 0x1E).primary == TimeSource::GPS_RTC);
+		ClockConsensusResult result = run(offsets, 0x1E, TimeSource::CELLULAR); //As finishTimeSync runs it, the lone remote is required
+		CHECK(result.valid);
+		CHECK(result.members == 1);
+		CHECK(result.primary == TimeSource::CELLULAR);
+		CHECK(result.time == 1700000000);
+	}
+
+	//Lone remote still picks up the local clocks that do agree with it
+	{
+		const time_t offsets[5] = {0, 0, 100, 10, 100};
+		ClockConsensusResult result = run(offsets, 0x1E, TimeSource::CELLULAR);
+		CHECK(result.members == 2);
+		CHECK(result.primary == TimeSource::CELLULAR && result.secondary == TimeSource::RTC);
+	}
+
+	//GPS and cell agreeing outweigh every local clock together
+	{
+		const time_t offsets[5] = {0, 5, 100, 100, 100};
+		ClockConsensusResult result = run(offsets, 0x1F);
+		CHECK(result.primary == TimeSource::GPS && result.secondary == TimeSource::CELLULAR);
+		CHECK(result.weight == 4);
+	}
+
+	//Required source that is not registered gives no result
+	{
+		const time_t offsets[5] = {0};
+		CHECK(!run(offsets, 0x1C, TimeSource::GPS).valid);
+	}
+
+	//On the logger, lone GPS with the RTC 20s out, both agree and GPS time is set as read
+	Sim::reset();
+	Kestrel logger(true);
+	bool criticalFault = false;
+	bool fault = false;
+	logger.begin(Time.now(), criticalFault, fault);
+	Sim::particle.connected = false;
+	Sim::board.rtc.clock.set(Sim::utc() + 20);
+	logger.syncTime(true);
+	const ClockConsensusResult &agreement = logger.getTimeConsensus();
+	CHECK(agreement.primary == TimeSource::GPS);
+	CHECK(agreement.memberMask & (1 << TimeSource::RTC));
+	CHECK(abs(Time.now() - (time_t)Sim::utc()) <= 1);
+	CHECK(abs((time_t)Sim::board.rtc.clock.read() - (time_t)Sim::utc()) <= 1);
+	return checkResult("consensus_test");
+}
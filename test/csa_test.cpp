@@ -0,0 +1,75 @@
+/******************************************************************************
+csa_test
+PAC1934 bulk read against the library's per-channel reads, values and bus cost
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#include <Kestrel.h>
+#include <Sim.h>
+#include <math.h>
+#include "Check.h"
+
+static char report[2048];
+
+static void compare(Kestrel &logger, uint8_t device, PAC1934 &csa, Sim::Csa &sim)
+{
+	//Bulk first, then the 12 library reads the diagnostic used to make
+	unsigned long start = Sim::bus.transactions;
+	CsaReading reading;
+	CHECK(logger.readCsa(device, reading));
+	CHECK(reading.valid);
+	unsigned long bulk = Sim::bus.transactions - start;
+
+	logger.enableI2C_OB(true); //Library calls do not route the bus themselves
+	logger.enableI2C_Global(false);
+	start = Sim::bus.transactions;
+	for(uint8_t ch = 0; ch < 4; ch++) {
+		bool err = false;
+		float voltage = csa.getBusVoltage(ch, true, err);
+		CHECK(!err);
+		float current = csa.getCurrent(ch, true, err);
+		CHECK(!err);
+		float power = csa.getPowerAvg(ch, err);
+		CHECK(!err);
+		CHECK_NEAR(reading.voltage[ch], voltage, 0.001);
+		CHECK_NEAR(reading.current[ch], current, 0.0005);
+		CHECK_NEAR(reading.power[ch], power, 0.001 + 0.001*fabs(power)); //Averaged since the clear, moves slightly between refreshes
+		CHECK_NEAR(reading.voltage[ch], sim.vbus[ch], 0.001);
+		CHECK_NEAR(reading.current[ch], sim.current[ch], 0.0005);
+	}
+	unsigned long perChannel = Sim::bus.transactions - start;
+	printf("%s: bulk %lu transactions, per channel %lu\n", device == 0 ? "csaAlpha" : "csaBeta", bulk, perChannel);
+	CHECK(bulk <= 5); //Refresh and two block reads, each pointer write and read
+	CHECK(bulk*10 <= perChannel);
+}
+
+int main()
+{
+	Sim::reset();
+	Kestrel logger(true);
+	bool criticalFault = false;
+	bool fault = false;
+	logger.begin(Time.now(), criticalFault, fault);
+	logger.selfDiagnostic(report, sizeof(report), 4, Time.now()); //Configures both CSAs, CH1 of csaAlpha bidirectional
+	const double alphaV[4] = {3.9, 5.1, 3.3, 12.0};
+	const double alphaI[4] = {-0.15, 0.08, 0.02, 0.3};
+	const double betaV[4] = {3.3, 3.3, 5.0, 12.0};
+	const double betaI[4] = {0.4, 0.01, 0.05, 0.12};
+	for(int ch = 0; ch < 4; ch++) {
+		Sim::board.csaAlpha.vbus[ch] = alphaV[ch];
+		Sim::board.csaAlpha.current[ch] = alphaI[ch];
+		Sim::board.csaBeta.vbus[ch] = betaV[ch];
+		Sim::board.csaBeta.current[ch] = betaI[ch];
+	}
+	delay(600000); //Accumulators carry mostly the new values
+
+	PAC1934 alpha(2, 2, 2, 2, Sim::board.csaAlpha.address);
+	PAC1934 beta(2, 10, 10, 10, Sim::board.csaBeta.address);
+	compare(logger, 0, alpha, Sim::board.csaAlpha);
+	compare(logger, 1, beta, Sim::board.csaBeta);
+	return checkResult("csa_test");
+}
@@ -0,0 +1,67 @@
+/******************************************************************************
+diag_delta_test
+Keyframes and baselines of delta mode selfDiagnostic reports
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#include <Kestrel.h>
+#include <Sim.h>
+#include <string.h>
+#include "Check.h"
+
+static char report[2048];
+
+static bool has(const char *key)
+{
+	return strstr(report, key) != nullptr;
+}
+
+int main()
+{
+	Sim::reset();
+	Kestrel logger(true);
+	bool criticalFault = false;
+	bool fault = false;
+	logger.begin(Time.now(), criticalFault, fault);
+	logger.setDiagnosticDelta(3);
+
+	//First report at a level is a keyframe
+	logger.selfDiagnostic(report, sizeof(report), 5, Time.now());
+	CHECK(has("\"Keyframe\":1"));
+	CHECK(has("\"OB\":"));
+
+	//Not confirmed, so the backend may not have it. Fields are sent again until a report carrying them is confirmed
+	logger.selfDiagnostic(report, sizeof(report), 5, Time.now());
+	CHECK(has("\"Keyframe\":0"));
+	CHECK(has("\"OB\":"));
+	logger.confirmDiagnostic();
+	logger.selfDiagnostic(report, sizeof(report), 5, Time.now());
+	CHECK(has("\"Keyframe\":0"));
+	CHECK(!has("\"OB\":"));
+	CHECK(!has("\"I2C\":"));
+
+	//Level 5 keyframes do not stand in for level 2, which carries fields level 5 never reports
+	logger.selfDiagnostic(report, sizeof(report), 5, Time.now());
+	CHECK(has("\"Keyframe\":1"));
+	CHECK(!has("\"RTC_Config\":"));
+	logger.confirmDiagnostic();
+	logger.selfDiagnostic(report, sizeof(report), 2, Time.now());
+	CHECK(has("\"Keyframe\":1"));
+	CHECK(has("\"RTC_Config\":"));
+	CHECK(has("\"OB\":"));
+
+	//A dropped report leaves nothing to confirm, its values are sent again
+	logger.confirmDiagnostic();
+	char small[64];
+	CHECK(logger.selfDiagnostic(small, sizeof(small), 2, Time.now()) == 0);
+	logger.confirmDiagnostic();
+	logger.selfDiagnostic(report, sizeof(report), 2, Time.now());
+	CHECK(has("\"Keyframe\":0"));
+	CHECK(!has("\"RTC_Config\":"));
+	CHECK(!has("\"OB\":"));
+	return checkResult("diag_delta_test");
+}
@@ -0,0 +1,60 @@
+/******************************************************************************
+drift_test
+Drift model and sync scheduling, the predicted error bound must hold between syncs
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#include <Kestrel.h>
+#include <Sim.h>
+#include <math.h>
+#include "Check.h"
+
+static void run(double particlePpm, double rtcPpm)
+{
+	Sim::reset();
+	Kestrel logger(true);
+	bool criticalFault = false;
+	bool fault = false;
+	logger.begin(Time.now(), criticalFault, fault);
+	Sim::particle.clock.setRate(particlePpm);
+	Sim::board.rtc.setDrift(rtcPpm);
+
+	int syncs = 0;
+	unsigned long firstStretch = 0;
+	double worstExcess = 0;
+	bool reportedEarly = false;
+	while(Sim::now() < 2*86400ULL*1000000ULL) {
+		unsigned long interval = logger.getSyncInterval();
+		if(interval > 60 && firstStretch == 0) firstStretch = interval;
+		if(Sim::now() < 3600ULL*1000000ULL && logger.getDriftPpm(DriftClock::PARTICLE) != 0) reportedEarly = true;
+		for(unsigned long s = 0; s < interval; s += 60) {
+			delay(60000);
+			double truth = floor(Sim::utc()); //Clocks are read as whole seconds
+			double error = fabs(Time.now() - truth);
+			double rtcError = fabs(Sim::board.rtc.clock.read() - truth);
+			if(rtcError > error) error = rtcError;
+			double excess = error - logger.getTimeErrorBound();
+			if(excess > worstExcess) worstExcess = excess;
+		}
+		logger.syncTime();
+		syncs++;
+	}
+	printf("Particle %+.0fppm, RTC %+.0fppm: %d syncs, first stretched interval %lus\n", particlePpm, rtcPpm, syncs, firstStretch);
+	CHECK(worstExcess == 0); //Both clocks stay inside the bound the schedule is built on
+	CHECK(firstStretch > 60 && firstStretch < 21600); //A 600s measurement is only good to ~1600ppm, it does not earn the longest interval
+	CHECK(!reportedEarly); //Drift is not reported until the measurement spans an hour
+	CHECK(syncs < 40);
+}
+
+int main()
+{
+	run(0, 0); //No drift measures as 0ppm, the schedule still comes from the resolution
+	run(150, 80);
+	run(-400, -150);
+	run(20, -190);
+	return checkResult("drift_test");
+}
@@ -0,0 +1,125 @@
+/******************************************************************************
+energy_test
+Energy accounting from the PAC1934 accumulators, per channel and per Talon port
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#include <Kestrel.h>
+#include <Sim.h>
+#include "Check.h"
+
+static char report[2048];
+
+static float portTotal(Kestrel &logger, uint8_t port) //[Wh] Whole day ring, so day boundaries do not matter
+{
+	float total = 0;
+	for(uint8_t d = 0; d < 7; d++) total += logger.getEnergyPortDay(port, d);
+	return total;
+}
+
+static float channelTotal(Kestrel &logger, uint8_t channel)
+{
+	float total = 0;
+	for(uint8_t d = 0; d < 7; d++) total += logger.getEnergyDay(channel, d);
+	return total;
+}
+
+int main()
+{
+	Sim::reset();
+	Kestrel logger(true);
+	bool criticalFault = false;
+	bool fault = false;
+	logger.begin(Time.now(), criticalFault, fault);
+	logger.selfDiagnostic(report, sizeof(report), 4, Time.now()); //Configures both CSAs and takes the first baseline
+	const uint8_t bulk = 4 + 3; //csaBeta CH4 in PORT_V order
+	Sim::board.csaBeta.vbus[3] = 12.0;
+
+	//One port on, all of the bulk rail is its energy
+	logger.enablePower(1, true);
+	Sim::board.csaBeta.current[3] = 0.1;
+	delay(1800000);
+	logger.enablePower(2, true); //Closes port 1's interval before port 2 comes on
+	CHECK_NEAR(logger.getEnergyPortDay(1), 0.6, 0.01); //12V * 0.1A * 0.5h
+	CHECK_NEAR(logger.getEnergyPortDay(2), 0, 1e-6);
+
+	//Two ports on with nothing known about either, split evenly
+	Sim::board.csaBeta.current[3] = 0.3;
+	delay(1800000);
+	logger.enablePower(1, false);
+	Sim::board.csaBeta.current[3] = 0;
+	logger.enablePower(2, false);
+	CHECK_NEAR(logger.getEnergyPortDay(1), 0.6 + 0.9, 0.02);
+	CHECK_NEAR(logger.getEnergyPortDay(2), 0.9, 0.02);
+	CHECK_NEAR(logger.getEnergyDay(bulk), 2.4, 0.03);
+	CHECK_NEAR(logger.getEnergyPortDay(3), 0, 1e-6);
+	CHECK(logger.getEnergyPortDay(0) == 0); //Out of range
+	CHECK(logger.getEnergyPortDay(5) == 0);
+
+	//Longer than ACC_COUNT can cover at 1024 SPS, the interval is dropped rather than scaled by an aliased count
+	float before = logger.getEnergyDay(bulk) + logger.getEnergyDay(bulk, 1);
+	logger.enablePower(3, true);
+	Sim::board.csaBeta.current[3] = 0.1;
+	delay(5UL*3600000UL);
+	logger.enablePower(3, false);
+	CHECK_NEAR(logger.getEnergyPortDay(3) + logger.getEnergyPortDay(3, 1), 0, 1e-6);
+	CHECK_NEAR(logger.getEnergyDay(bulk) + logger.getEnergyDay(bulk, 1), before, 1e-6);
+
+	//Accounting picks up again from the new baseline
+	logger.enablePower(3, true);
+	delay(1800000);
+	logger.enablePower(3, false);
+	CHECK_NEAR(logger.getEnergyPortDay(3), 0.6, 0.01);
+
+	//One ACC_COUNT wrap inside the 4.55h limit is a normal rollover, the interval is kept
+	Sim::board.csaBeta.current[3] = 0;
+	delay((0x1000000UL - Sim::board.csaBeta.count)/1024*1000UL - 600000UL); //Up to 10 minutes before the wrap
+	float portBefore = portTotal(logger, 1);
+	float bulkBefore = channelTotal(logger, bulk);
+	logger.enablePower(1, true);
+	uint32_t countBefore = Sim::board.csaBeta.count;
+	Sim::board.csaBeta.current[3] = 0.1;
+	delay(1800000);
+	logger.enablePower(1, false);
+	CHECK(Sim::board.csaBeta.count < countBefore); //Wrapped
+	CHECK_NEAR(portTotal(logger, 1) - portBefore, 0.6, 0.01);
+	CHECK_NEAR(channelTotal(logger, bulk) - bulkBefore, 0.6, 0.01);
+
+	//Switching every port off in one write still closes the interval of the ports that were on
+	portBefore = portTotal(logger, 1);
+	logger.enablePower(1, true);
+	delay(1800000);
+	logger.disablePowerAll();
+	CHECK_NEAR(portTotal(logger, 1) - portBefore, 0.6, 0.01);
+	Sim::board.csaBeta.current[3] = 0;
+
+	//Inrush is captured on the bulk rail, net of the ports already on
+	logger.setInrushCapture(20);
+	static bool port1On = false;
+	static bool port2On = false;
+	Sim::board.onTalonPower = [](uint8_t port, bool on) {
+		if(port == 1) port1On = on;
+		if(port == 2 && on) {
+			port2On = true;
+			Sim::board.csaBeta.profileStart = Sim::now();
+		}
+	};
+	Sim::board.csaBeta.currentProfile[3] = [](double t) {return (port1On ? 0.1 : 0) + (!port2On ? 0 : t < 0.005 ? 0.5 : 0.05);};
+	logger.enablePower(1, true);
+	CHECK(logger.getInrush(1).valid);
+	CHECK_NEAR(logger.getInrush(1).before, 0, 0.005);
+	logger.enablePower(2, true);
+	const InrushSummary &port2 = logger.getInrush(2);
+	CHECK(port2.valid);
+	CHECK_NEAR(port2.before, 0.1, 0.005);
+	CHECK_NEAR(port2.peak, 0.5, 0.01);
+	CHECK_NEAR(port2.final, 0.05, 0.005);
+	CHECK(port2.settled);
+	Sim::board.csaBeta.currentProfile[3] = nullptr;
+	Sim::board.onTalonPower = nullptr;
+	return checkResult("energy_test");
+}
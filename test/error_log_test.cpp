@@ -0,0 +1,70 @@
+/******************************************************************************
+error_log_test
+Size, timing and retention of the deduplicating error log
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#include <Kestrel.h>
+#include <Sim.h>
+#include <string.h>
+#include "Check.h"
+
+int main()
+{
+	Sim::reset();
+	Kestrel logger(true);
+	bool criticalFault = false;
+	bool fault = false;
+	logger.begin(Time.now(), criticalFault, fault);
+	logger.getErrors(); //Start from an empty log
+
+	//A full log of wide codes, thrown over a day, still goes out one transmission at a time
+	for(uint32_t i = 0; i < ErrorLogStore::SIZE; i++) {
+		logger.throwError(0xF0000000 | (i << 8) | 0xFF);
+		logger.throwError(0xF0000000 | (i << 8) | 0xFF);
+		delay(2700000); //45 minutes
+	}
+	String report = logger.getErrors();
+	printf("Full log: %u characters, %u codes left for the next report\n", report.length(), logger.totalErrors());
+	CHECK(report.length() <= 1024);
+	CHECK(report.length() > 0);
+	CHECK(strstr(report.c_str(), "\"FIRST\":[86400,") != nullptr); //Seconds before the report, not UNIX times
+	int reports = 1;
+	while(logger.totalErrors() > 0 && reports < 4) {
+		report = logger.getErrors();
+		CHECK(report.length() <= 1024);
+		reports++;
+	}
+	CHECK(logger.totalErrors() == 0);
+	CHECK(strstr(report.c_str(), "\"0xf0001fff\"") != nullptr); //Last code made it out
+
+	//Codes thrown while time was not valid have no age
+	Sim::particle.valid = false;
+	logger.throwError(0x10000000);
+	Sim::particle.valid = true;
+	report = logger.getErrors();
+	CHECK(strstr(report.c_str(), "\"FIRST\":[null]") != nullptr);
+
+	//Resets are only reported with the codes which lived through them, and only once
+	{
+		Kestrel restarted(true); //Retained log is loaded again, as after a reset
+	}
+	CHECK(strstr(logger.getErrors().c_str(), "\"RST\"") == nullptr);
+	logger.throwError(0x10000000);
+	{
+		Kestrel restarted(true);
+	}
+	report = logger.getErrors();
+	CHECK(strstr(report.c_str(), "\"CODES\":[\"0x10000000\"]") != nullptr);
+	CHECK(strstr(report.c_str(), "\"RST\":1") != nullptr);
+	CHECK(strstr(logger.getErrors().c_str(), "\"RST\"") == nullptr);
+	{
+		Kestrel restarted(true); //Reported codes do not come back
+	}
+	CHECK(strstr(logger.getErrors().c_str(), "\"CODES\":[]") != nullptr);
+	return checkResult("error_log_test");
+}
@@ -0,0 +1,67 @@
+/******************************************************************************
+framer_test
+Reports split across publishes, and the message ID they carry
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#include <Kestrel.h>
+#include <Sim.h>
+#include <string.h>
+#include "Check.h"
+
+static char report[2048];
+static char rebuilt[2048];
+
+int main()
+{
+	Sim::reset();
+	Kestrel logger(true);
+	bool criticalFault = false;
+	bool fault = false;
+	logger.begin(Time.now(), criticalFault, fault);
+
+	//Framing never starts a time sync, even with time lost (getMessageID would sync here)
+	Sim::particle.valid = false;
+	unsigned long syncs = Sim::particle.syncs;
+	uint64_t start = Sim::now();
+	logger.frameReport("{}", 2);
+	CHECK(Sim::particle.syncs == syncs);
+	CHECK(Sim::now() - start < 1000);
+	Sim::particle.valid = true;
+
+	//Raw CBOR is binary and can not be published as a string
+	size_t length = logger.selfDiagnostic(report, sizeof(report), 2, Time.now(), ReportFormat::CBOR);
+	CHECK(length > 0);
+	CHECK(logger.frameReport(report, length).count() == 0);
+	CHECK(logger.publishReport("diagnostic", report, length) == 0);
+
+	//A report longer than one publish goes out in frames which rebuild the original
+	length = logger.selfDiagnostic(report, sizeof(report), 2, Time.now());
+	memset(&report[length - 1], ' ', 1500); //Pad past MAX_MESSAGE_LENGTH, keep it text
+	length += 1500;
+	report[length - 1] = '}';
+	report[length] = '\0';
+	ReportFramer framer = logger.frameReport(report, length);
+	CHECK(framer.count() == (length + 999)/1000); //Header takes a little of each 1024
+	size_t rebuiltLength = 0;
+	unsigned long publishes = Sim::particle.publishes;
+	CHECK(logger.publishReport("diagnostic", report, length) == framer.count());
+	CHECK(Sim::particle.publishes - publishes == framer.count());
+	CHECK(Sim::particle.lastEvent == "diagnostic");
+	CHECK(Sim::particle.lastPublish.length() <= 1024);
+	for(uint16_t i = 0; i < framer.count(); i++) {
+		char frame[1025];
+		size_t frameLength = framer.frame(i, frame, sizeof(frame));
+		CHECK(frameLength > 0 && frameLength <= 1024);
+		const char *payload = strchr(frame, '}') + 1; //Past the {"ID":..,"Part":..,"Parts":..} header
+		memcpy(&rebuilt[rebuiltLength], payload, frameLength - (payload - frame));
+		rebuiltLength += frameLength - (payload - frame);
+	}
+	CHECK(rebuiltLength == length);
+	CHECK(memcmp(rebuilt, report, length) == 0);
+	return checkResult("framer_test");
+}
@@ -0,0 +1,45 @@
+/******************************************************************************
+Adafruit_SHT4x (host simulation)
+SHT4x humidity and temperature library, the parts the Kestrel driver uses
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#include "Adafruit_SHT4x.h"
+
+static constexpr uint8_t SHT4X_ADR = 0x44;
+
+bool Adafruit_SHT4x::command(uint8_t cmd, unsigned long wait, uint8_t *reply)
+{
+	Wire.beginTransmission(SHT4X_ADR);
+	Wire.write(cmd);
+	if(Wire.endTransmission() != 0) return false;
+	delay(wait);
+	if(reply == nullptr) return true;
+	if(Wire.requestFrom(SHT4X_ADR, (uint8_t)6) != 6) return false;
+	for(int i = 0; i < 6; i++) reply[i] = Wire.read();
+	return true;
+}
+
+bool Adafruit_SHT4x::begin(TwoWire *wire)
+{
+	uint8_t serial[6] = {0};
+	if(!command(0x94, 1, nullptr)) return false; //Soft reset
+	return command(0x89, 10, serial);
+}
+
+bool Adafruit_SHT4x::getEvent(sensors_event_t *humidity, sensors_event_t *temp)
+{
+	const uint8_t commands[3] = {0xFD, 0xF6, 0xE0};
+	const unsigned long waits[3] = {10, 5, 2};
+	uint8_t reply[6] = {0};
+	if(!command(commands[precision], waits[precision], reply)) return false;
+	float t = -45.0 + 175.0*((reply[0] << 8) | reply[1])/65535.0;
+	float rh = -6.0 + 125.0*((reply[3] << 8) | reply[4])/65535.0;
+	if(temp != nullptr) temp->temperature = t;
+	if(humidity != nullptr) humidity->relative_humidity = min(max(rh, 0.0f), 100.0f);
+	return true;
+}
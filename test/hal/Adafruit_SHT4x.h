@@ -0,0 +1,36 @@
+/******************************************************************************
+Adafruit_SHT4x (host simulation)
+SHT4x humidity and temperature library, the parts the Kestrel driver uses
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#ifndef Adafruit_SHT4x_h
+#define Adafruit_SHT4x_h
+
+#include <Particle.h>
+
+typedef enum {SHT4X_HIGH_PRECISION, SHT4X_MED_PRECISION, SHT4X_LOW_PRECISION} sht4x_precision_t;
+
+struct sensors_event_t {
+	float temperature = 0;
+	float relative_humidity = 0;
+};
+
+class Adafruit_SHT4x
+{
+	public:
+		bool begin(TwoWire *wire = &Wire);
+		void setPrecision(sht4x_precision_t prec) {
+			precision = prec;
+		}
+		bool getEvent(sensors_event_t *humidity, sensors_event_t *temp);
+	private:
+		sht4x_precision_t precision = SHT4X_HIGH_PRECISION;
+		bool command(uint8_t cmd, unsigned long wait, uint8_t *reply);
+};
+
+#endif
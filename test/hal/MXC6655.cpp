@@ -0,0 +1,56 @@
+/******************************************************************************
+MXC6655 (host simulation)
+Accelerometer library, the parts the Kestrel driver uses
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#include "MXC6655.h"
+
+int MXC6655::readRegs(uint8_t reg, uint8_t *vals, uint8_t len)
+{
+	Wire.beginTransmission(ADR);
+	Wire.write(reg);
+	int error = Wire.endTransmission(false);
+	if(error != 0) return error;
+	if(Wire.requestFrom(ADR, len) != len) return 4;
+	for(int i = 0; i < len; i++) vals[i] = Wire.read();
+	return 0;
+}
+
+int MXC6655::begin()
+{
+	uint8_t id = 0;
+	if(readRegs(0x0F, &id, 1) != 0) return -1;
+	if(id != 0x05) return -1;
+	Wire.beginTransmission(ADR);
+	Wire.write(0x0D); //Control, power on at 2g
+	Wire.write(0x00);
+	return Wire.endTransmission();
+}
+
+int MXC6655::updateAccelAll()
+{
+	uint8_t vals[6] = {0};
+	int error = readRegs(0x03, vals, 6);
+	if(error != 0) return error;
+	for(int i = 0; i < 3; i++) data[i] = ((int16_t)((vals[2*i] << 8) | vals[2*i + 1]) >> 4)/1024.0 + offset[i];
+	return 0;
+}
+
+float MXC6655::getAccel(int axis)
+{
+	uint8_t vals[2] = {0};
+	if(axis < 0 || axis > 2 || readRegs(0x03 + 2*axis, vals, 2) != 0) return 0;
+	return ((int16_t)((vals[0] << 8) | vals[1]) >> 4)/1024.0 + offset[axis];
+}
+
+float MXC6655::getTemp()
+{
+	uint8_t val = 0;
+	if(readRegs(0x09, &val, 1) != 0) return 0;
+	return 25.0 + 0.586*(int8_t)val;
+}
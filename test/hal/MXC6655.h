@@ -0,0 +1,30 @@
+/******************************************************************************
+MXC6655 (host simulation)
+Accelerometer library, the parts the Kestrel driver uses
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#ifndef MXC6655_h
+#define MXC6655_h
+
+#include <Particle.h>
+
+class MXC6655
+{
+	public:
+		int begin(); //0 on success, -1 if not detected, else Wire error
+		int updateAccelAll();
+		float getAccel(int axis);
+		float getTemp();
+		float data[3] = {0}; ///<[g] Offset applied
+		float offset[3] = {0}; ///<[g]
+	private:
+		static constexpr uint8_t ADR = 0x15;
+		int readRegs(uint8_t reg, uint8_t *vals, uint8_t len);
+};
+
+#endif
@@ -0,0 +1,90 @@
+/******************************************************************************
+PCAL9535A (host simulation)
+16 bit IO expander library, talks to the simulated expander over Wire
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Every call is a full read-modify-write, as the target library does, so the
+driver's shadow registers are measured against the real cost.
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#include "PCAL9535A.h"
+
+int PCAL9535A::begin()
+{
+	if(!Wire.isEnabled()) Wire.begin();
+	Wire.beginTransmission(adr);
+	return Wire.endTransmission();
+}
+
+int PCAL9535A::readWord(uint8_t reg, uint16_t &val)
+{
+	Wire.beginTransmission(adr);
+	Wire.write(reg);
+	int error = Wire.endTransmission(false);
+	if(error != 0) return error;
+	if(Wire.requestFrom(adr, (uint8_t)2) != 2) return 4;
+	val = Wire.read();
+	val = val | (Wire.read() << 8);
+	return 0;
+}
+
+int PCAL9535A::writeWord(uint8_t reg, uint16_t val)
+{
+	Wire.beginTransmission(adr);
+	Wire.write(reg);
+	Wire.write(val & 0xFF);
+	Wire.write(val >> 8);
+	return Wire.endTransmission();
+}
+
+int PCAL9535A::setBit(uint8_t reg, int pin, bool state)
+{
+	uint16_t val = 0;
+	int error = readWord(reg, val);
+	if(error != 0) return error;
+	val = state ? (val | (1 << pin)) : (val & ~(1 << pin));
+	return writeWord(reg, val);
+}
+
+int PCAL9535A::pinMode(int pin, PinMode mode)
+{
+	if(pin < 0 || pin > 15) return -1;
+	int error = setBit(0x06, pin, mode != OUTPUT); //Config, 1 = input
+	if(error != 0 || mode == OUTPUT) return error;
+	if(mode == INPUT) return setBit(0x46, pin, false); //Pull disabled
+	error = setBit(0x48, pin, mode == INPUT_PULLUP); //Pull select
+	if(error != 0) return error;
+	return setBit(0x46, pin, true); //Pull enable
+}
+
+int PCAL9535A::digitalWrite(int pin, bool state)
+{
+	if(pin < 0 || pin > 15) return -1;
+	return setBit(0x02, pin, state);
+}
+
+int PCAL9535A::digitalRead(int pin)
+{
+	uint16_t val = 0;
+	if(pin < 0 || pin > 15 || readWord(0x00, val) != 0) return -1;
+	return (val >> pin) & 0x01;
+}
+
+int PCAL9535A::safeMode(int state)
+{
+	Wire.beginTransmission(adr);
+	Wire.write(0x4F); //Output port configuration
+	Wire.write(state == SAFE ? 0x03 : 0x00);
+	return Wire.endTransmission();
+}
+
+uint16_t PCAL9535A::readBus()
+{
+	uint16_t val = 0;
+	readWord(0x00, val);
+	return val;
+}
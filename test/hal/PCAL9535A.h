@@ -0,0 +1,34 @@
+/******************************************************************************
+PCAL9535A (host simulation)
+16 bit IO expander library, talks to the simulated expander over Wire
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#ifndef PCAL9535A_h
+#define PCAL9535A_h
+
+#include <Particle.h>
+
+class PCAL9535A
+{
+	public:
+		enum SafeMode {SAFEOFF = 0, SAFE = 1}; ///<Output port configuration, push-pull or open drain
+		PCAL9535A(int address = 0x20) : adr(address) {}
+		int begin(); //0 on success, else Wire error
+		int pinMode(int pin, PinMode mode);
+		int digitalWrite(int pin, bool state);
+		int digitalRead(int pin);
+		int safeMode(int state);
+		uint16_t readBus();
+	private:
+		uint8_t adr;
+		int readWord(uint8_t reg, uint16_t &val);
+		int writeWord(uint8_t reg, uint16_t val);
+		int setBit(uint8_t reg, int pin, bool state);
+};
+
+#endif
@@ -0,0 +1,335 @@
+/******************************************************************************
+Particle (host simulation)
+Subset of the Particle Device OS API used by the Kestrel driver, for Linux
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Device OS calls backed by the models in Sim.h
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#include "Particle.h"
+#include "Sim.h"
+
+SerialC Serial;
+SerialC Serial1;
+TwoWire Wire;
+SystemC System;
+ParticleC Particle;
+TimeC Time;
+EEPROMC EEPROM;
+RGBC RGB;
+
+void delay(unsigned long ms)
+{
+    Sim::advance(ms*1000ULL);
+}
+
+unsigned long millis()
+{
+    Sim::advance(1); //Every call costs time, so loops polling millis() end
+    return Sim::now()/1000;
+}
+
+unsigned long micros()
+{
+    Sim::advance(1);
+    return Sim::now();
+}
+
+void pinMode(uint16_t pin, PinMode mode)
+{
+    if(pin >= TOTAL_PINS) return;
+    Sim::pins.modes[pin]++;
+    Sim::pins.output[pin] = (mode == OUTPUT);
+}
+
+void digitalWrite(uint16_t pin, uint8_t value)
+{
+    if(pin >= TOTAL_PINS) return;
+    Sim::pins.writes[pin]++;
+    Sim::pins.level[pin] = value ? HIGH : LOW;
+}
+
+int32_t digitalRead(uint16_t pin)
+{
+    if(pin >= TOTAL_PINS) return LOW;
+    if(Sim::pins.output[pin]) return Sim::pins.level[pin];
+    return Sim::board.inputLevel(pin);
+}
+
+uint32_t HAL_RNG_GetRandomNumber()
+{
+    static uint32_t state = 0x2545F491; //Repeatable runs
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+uint32_t __get_FPSCR()
+{
+    return 0;
+}
+
+void __set_FPSCR(uint32_t fpscr) {}
+
+//////////////////////////////// STRING ////////////////////////////////
+
+static std::string formatInteger(unsigned long long val, bool negative, int base)
+{
+    char buf[72];
+    if(base == HEX) snprintf(buf, sizeof(buf), "%llx", val); //Device OS uses utoa, lower case digits
+    else if(base == 2) {
+        int pos = 0;
+        char bits[65];
+        do {
+            bits[pos++] = '0' + (val & 1);
+            val >>= 1;
+        } while(val > 0);
+        for(int i = 0; i < pos; i++) buf[i] = bits[pos - 1 - i];
+        buf[pos] = '\0';
+    }
+    else snprintf(buf, sizeof(buf), "%s%llu", negative ? "-" : "", val);
+    return std::string(buf);
+}
+
+String::String(int val, int base) : String((long)val, base) {}
+
+String::String(unsigned int val, int base) : String((unsigned long)val, base) {}
+
+String::String(long val, int base)
+{
+    if(base == DEC) str = formatInteger(val < 0 ? -(unsigned long long)val : val, val < 0, base);
+    else str = formatInteger((unsigned long)val, false, base);
+}
+
+String::String(unsigned long val, int base) : str(formatInteger(val, false, base)) {}
+
+String::String(float val, int decimals) : String((double)val, decimals) {}
+
+String::String(double val, int decimals)
+{
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.*f", decimals, val);
+    str = buf;
+}
+
+size_t SerialC::emit(const String &text)
+{
+    if(Sim::echoSerial) fputs(text.c_str(), stdout);
+    return text.length();
+}
+
+//////////////////////////////// WIRE ////////////////////////////////
+
+static void busTime(uint8_t address, size_t bytes, uint32_t clock)
+{
+    uint64_t bits = 9*(1 + bytes) + 2; //Address and data with ACK bits, plus start and stop
+    uint64_t us = (bits*1000000ULL + clock - 1)/clock;
+    Sim::bus.transactions++;
+    Sim::bus.perAddress[address & 0x7F]++;
+    Sim::bus.busy += us;
+    Sim::advance(us);
+}
+
+void TwoWire::beginTransmission(uint8_t address)
+{
+    txAddress = address;
+    txLength = 0;
+}
+
+size_t TwoWire::write(uint8_t data)
+{
+    if(txLength >= BUFFER_LENGTH) return 0;
+    txBuffer[txLength++] = data;
+    return 1;
+}
+
+uint8_t TwoWire::endTransmission(bool stop)
+{
+    Sim::Device *device = Sim::device(txAddress);
+    Sim::bus.writes++;
+    if(device == nullptr || !device->present()) {
+        Sim::bus.nacks++;
+        busTime(txAddress, 0, clock);
+        return 2;
+    }
+    Sim::bus.bytes += txLength;
+    busTime(txAddress, txLength, clock);
+    device->receive(txBuffer, txLength);
+    return 0;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity, uint8_t stop)
+{
+    Sim::Device *device = Sim::device(address);
+    size_t length = quantity < BUFFER_LENGTH ? quantity : BUFFER_LENGTH;
+    Sim::bus.reads++;
+    rxPos = 0;
+    rxLength = 0;
+    if(device != nullptr && device->present()) rxLength = device->transmit(rxBuffer, length);
+    if(rxLength == 0) Sim::bus.nacks++;
+    Sim::bus.bytes += rxLength;
+    busTime(address, rxLength, clock);
+    return rxLength;
+}
+
+//////////////////////////////// SYSTEM ////////////////////////////////
+
+void SystemC::on(int event, void (*handler)(system_event_t, int))
+{
+    if(event == time_changed) Sim::particle.timeHandler = handler;
+    if(event == out_of_memory) Sim::particle.memoryHandler = handler;
+}
+
+int SystemC::resetReason()
+{
+    return Sim::particle.resetReason;
+}
+
+uint32_t SystemC::freeMemory()
+{
+    return Sim::particle.freeMemory;
+}
+
+SystemSleepResult SystemC::sleep(const SystemSleepConfiguration &config)
+{
+    //Time passes until the first wake source fires: the RTC alarm on the wake pin, the sleep duration, or any other GPIO after maxSleep
+    Sim::particle.sleeps++;
+    uint64_t start = Sim::now();
+    if(config.wakePin == Sim::BoardPins::CLOCK_INT && Sim::board.rtc.alarmFired()) return SystemSleepResult(SystemSleepWakeupReason::BY_GPIO);
+    uint64_t wake = start + Sim::particle.maxSleep*1000ULL;
+    SystemSleepWakeupReason reason = SystemSleepWakeupReason::BY_GPIO;
+    if(config.durationMs > 0 && start + config.durationMs*1000ULL < wake) {
+        wake = start + config.durationMs*1000ULL;
+        reason = SystemSleepWakeupReason::BY_RTC;
+    }
+    uint64_t alarm = (config.wakePin == Sim::BoardPins::CLOCK_INT) ? Sim::board.rtc.nextAlarm() : 0;
+    if(alarm != 0 && alarm > start && alarm <= wake) {
+        wake = alarm;
+        reason = SystemSleepWakeupReason::BY_GPIO;
+    }
+    Sim::advance(wake - start);
+    Sim::particle.asleep += wake - start;
+    return SystemSleepResult(reason);
+}
+
+void SystemC::reset()
+{
+    Sim::particle.resets++;
+}
+
+//////////////////////////////// CLOUD ////////////////////////////////
+
+bool ParticleC::connected()
+{
+    Sim::service();
+    return Sim::particle.connected;
+}
+
+void ParticleC::connect()
+{
+    if(Sim::particle.reachable) Sim::particle.connected = true;
+}
+
+void ParticleC::disconnect(const CloudDisconnectOptions &options)
+{
+    Sim::particle.connected = false;
+}
+
+void ParticleC::syncTime()
+{
+    if(!Sim::particle.connected || Sim::particle.syncPending) return;
+    Sim::particle.syncs++;
+    Sim::particle.syncPending = true;
+    Sim::particle.syncStampAt = Sim::now() + Sim::particle.syncLatency*500ULL; //Halfway there
+    Sim::particle.syncDoneAt = Sim::now() + Sim::particle.syncLatency*1000ULL;
+}
+
+bool ParticleC::syncTimePending()
+{
+    Sim::service();
+    return Sim::particle.syncPending;
+}
+
+bool ParticleC::syncTimeDone()
+{
+    Sim::service();
+    return !Sim::particle.syncPending;
+}
+
+void ParticleC::process()
+{
+    Sim::service();
+    Sim::dispatchEvents();
+}
+
+bool ParticleC::publish(const char *eventName, const char *data)
+{
+    if(!Sim::particle.connected) return false;
+    Sim::particle.publishes++;
+    Sim::particle.lastEvent = eventName;
+    Sim::particle.lastPublish = data != nullptr ? data : "";
+    return true;
+}
+
+//////////////////////////////// TIME ////////////////////////////////
+
+bool TimeC::isValid()
+{
+    Sim::service();
+    return Sim::particle.valid;
+}
+
+time_t TimeC::now()
+{
+    Sim::service();
+    return Sim::particle.clock.read();
+}
+
+void TimeC::setTime(time_t time)
+{
+    Sim::particle.clock.set(time);
+    Sim::particle.valid = true;
+    Sim::particle.pendingTimeEvent = time_changed_manually;
+}
+
+static struct tm breakDown(time_t time)
+{
+    struct tm t = {0};
+    gmtime_r(&time, &t);
+    return t;
+}
+
+int TimeC::year(time_t time)
+{
+    return breakDown(time).tm_year + 1900;
+}
+
+int TimeC::month(time_t time)
+{
+    return breakDown(time).tm_mon + 1;
+}
+
+int TimeC::day(time_t time)
+{
+    return breakDown(time).tm_mday;
+}
+
+int TimeC::hour(time_t time)
+{
+    return breakDown(time).tm_hour;
+}
+
+int TimeC::minute(time_t time)
+{
+    return breakDown(time).tm_min;
+}
+
+int TimeC::second(time_t time)
+{
+    return breakDown(time).tm_sec;
+}
@@ -0,0 +1,373 @@
+/******************************************************************************
+Particle (host simulation)
+Subset of the Particle Device OS API used by the Kestrel driver, for Linux
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Declares the Device OS calls the driver and its sibling libraries make so they
+compile unchanged on a host. Everything is backed by the simulation in Sim.h:
+time only advances when the code waits or talks to hardware, Wire talks to
+simulated devices and the cloud, Time and System are models with knobs the
+tests can turn.
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#ifndef Particle_h
+#define Particle_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <chrono>
+#include <string>
+
+using namespace std::chrono_literals;
+
+template <class A, class B> inline auto min(A a, B b) -> decltype(a < b ? a : b) { //Wiring style, mixed argument types allowed
+    return a < b ? a : b;
+}
+template <class A, class B> inline auto max(A a, B b) -> decltype(a < b ? a : b) {
+    return a > b ? a : b;
+}
+
+#define HEX 16
+#define DEC 10
+#define HIGH 1
+#define LOW 0
+#define SERIAL_8N1 0
+#define FALLING 2
+#define NETWORK_INTERFACE_CELLULAR 1
+#define PLATFORM_BSOM 23
+#define PLATFORM_B5SOM 25
+#define PLATFORM_ID PLATFORM_BSOM
+#define retained //Retained memory is just static storage on the host, a "reset" is a new Kestrel object
+
+enum PinMode {INPUT, OUTPUT, INPUT_PULLUP, INPUT_PULLDOWN};
+enum {D0 = 0, D1, D2, D3, D4, D5, D6, D7, D8, D22 = 22, D23 = 23, A0 = 30, A1, A2, A3, A4, A5, A6};
+constexpr uint16_t TOTAL_PINS = 40;
+
+void delay(unsigned long ms);
+unsigned long millis();
+unsigned long micros();
+void pinMode(uint16_t pin, PinMode mode);
+void digitalWrite(uint16_t pin, uint8_t value);
+int32_t digitalRead(uint16_t pin);
+uint32_t HAL_RNG_GetRandomNumber();
+uint32_t __get_FPSCR();
+void __set_FPSCR(uint32_t fpscr);
+
+class String
+{
+    public:
+        String() {}
+        String(const char *text) : str(text != nullptr ? text : "") {}
+        String(const std::string &text) : str(text) {}
+        String(char c) : str(1, c) {}
+        String(int val, int base = DEC);
+        String(unsigned int val, int base = DEC);
+        String(long val, int base = DEC);
+        String(unsigned long val, int base = DEC);
+        String(float val, int decimals = 2);
+        String(double val, int decimals = 2);
+        const char* c_str() const {
+            return str.c_str();
+        }
+        unsigned int length() const {
+            return str.length();
+        }
+        bool equals(const char *text) const {
+            return str == text;
+        }
+        bool equals(const String &other) const {
+            return str == other.str;
+        }
+        bool operator==(const char *text) const {
+            return str == text;
+        }
+        bool operator==(const String &other) const {
+            return str == other.str;
+        }
+        bool operator!=(const String &other) const {
+            return str != other.str;
+        }
+        String& operator+=(const String &other) {
+            str += other.str;
+            return *this;
+        }
+        friend String operator+(const String &a, const String &b) {
+            return String(a.str + b.str);
+        }
+        char charAt(unsigned int index) const {
+            return index < str.length() ? str[index] : 0;
+        }
+        String substring(unsigned int from) const {
+            return from < str.length() ? String(str.substr(from)) : String();
+        }
+        String substring(unsigned int from, unsigned int to) const {
+            return from < to && from < str.length() ? String(str.substr(from, to - from)) : String();
+        }
+        int indexOf(char c) const {
+            size_t pos = str.find(c);
+            return pos == std::string::npos ? -1 : (int)pos;
+        }
+        bool reserve(unsigned int size) {
+            str.reserve(size);
+            return true;
+        }
+
+    private:
+        std::string str;
+};
+
+class SerialC //Output is dropped unless Sim::echoSerial is set
+{
+    public:
+        void begin(unsigned long baud, int config = SERIAL_8N1) {}
+        template <class T> size_t print(T val) {
+            return emit(String(val));
+        }
+        size_t print(float val, int decimals) {
+            return emit(String(val, decimals));
+        }
+        size_t print(int val, int base) {
+            return emit(String(val, base));
+        }
+        size_t print(unsigned int val, int base) {
+            return emit(String(val, base));
+        }
+        size_t print(long val, int base) {
+            return emit(String(val, base));
+        }
+        size_t print(unsigned long val, int base) {
+            return emit(String(val, base));
+        }
+        template <class T> size_t println(T val) {
+            return print(val) + println();
+        }
+        template <class T> size_t println(T val, int format) {
+            return print(val, format) + println();
+        }
+        size_t println() {
+            return emit(String("\n"));
+        }
+        void flush() {}
+
+    private:
+        size_t emit(const String &text);
+};
+extern SerialC Serial;
+extern SerialC Serial1;
+
+class TwoWire
+{
+    public:
+        static constexpr size_t BUFFER_LENGTH = 32; ///<Device OS I2C buffer, longer transfers must be split
+        bool isEnabled() {
+            return enabled;
+        }
+        void begin() {
+            enabled = true;
+        }
+        void setClock(uint32_t speed) {
+            clock = speed;
+        }
+        void reset() {}
+        void beginTransmission(uint8_t address);
+        void beginTransmission(int address) {
+            beginTransmission((uint8_t)address);
+        }
+        size_t write(uint8_t data);
+        uint8_t endTransmission(bool stop = true); //0 = success, 2 = address NACK, as Device OS
+        uint8_t requestFrom(uint8_t address, uint8_t quantity, uint8_t stop = true);
+        uint8_t requestFrom(int address, int quantity) {
+            return requestFrom((uint8_t)address, (uint8_t)quantity);
+        }
+        int available() {
+            return rxLength - rxPos;
+        }
+        int read() {
+            return rxPos < rxLength ? rxBuffer[rxPos++] : -1;
+        }
+        uint32_t getClock() {
+            return clock;
+        }
+
+    private:
+        bool enabled = false;
+        uint32_t clock = 100000;
+        uint8_t txAddress = 0;
+        uint8_t txBuffer[BUFFER_LENGTH] = {0};
+        size_t txLength = 0;
+        uint8_t rxBuffer[BUFFER_LENGTH] = {0};
+        size_t rxLength = 0;
+        size_t rxPos = 0;
+};
+extern TwoWire Wire;
+
+typedef uint64_t system_event_t;
+enum {time_changed = 1, out_of_memory = 2};
+enum {time_changed_manually = 0, time_changed_sync = 1};
+enum class SystemSleepMode {STOP, ULTRA_LOW_POWER, HIBERNATE};
+enum class SystemSleepWakeupReason {UNKNOWN, BY_GPIO, BY_RTC, BY_NETWORK};
+
+class SystemSleepConfiguration
+{
+    public:
+        SystemSleepConfiguration& mode(SystemSleepMode sleepMode) {
+            sleepModeSet = sleepMode;
+            return *this;
+        }
+        SystemSleepConfiguration& network(int interface) {
+            networkKept = true;
+            return *this;
+        }
+        template <class Rep, class Period> SystemSleepConfiguration& duration(std::chrono::duration<Rep, Period> time) {
+            durationMs = std::chrono::duration_cast<std::chrono::milliseconds>(time).count();
+            return *this;
+        }
+        SystemSleepConfiguration& gpio(uint16_t pin, int edge) {
+            wakePin = pin;
+            return *this;
+        }
+        SystemSleepMode sleepModeSet = SystemSleepMode::STOP;
+        bool networkKept = false;
+        unsigned long durationMs = 0; ///<0 = no timed wake
+        int wakePin = -1;
+};
+
+class SystemSleepResult
+{
+    public:
+        SystemSleepResult(SystemSleepWakeupReason reason = SystemSleepWakeupReason::UNKNOWN) : reason(reason) {}
+        SystemSleepWakeupReason wakeupReason() const {
+            return reason;
+        }
+    private:
+        SystemSleepWakeupReason reason;
+};
+
+class SystemC
+{
+    public:
+        void on(int event, void (*handler)(system_event_t, int));
+        int resetReason();
+        uint32_t freeMemory();
+        SystemSleepResult sleep(const SystemSleepConfiguration &config);
+        void reset();
+        String version() {
+            return String("4.0.0");
+        }
+        String deviceID() {
+            return String("e00fce68000000000000000");
+        }
+};
+extern SystemC System;
+
+class CloudDisconnectOptions
+{
+    public:
+        CloudDisconnectOptions& graceful(bool state) {
+            return *this;
+        }
+        template <class Rep, class Period> CloudDisconnectOptions& timeout(std::chrono::duration<Rep, Period> time) {
+            return *this;
+        }
+};
+
+class ParticleC
+{
+    public:
+        static bool connected();
+        static void connect();
+        static void disconnect(const CloudDisconnectOptions &options = CloudDisconnectOptions());
+        static void syncTime();
+        static bool syncTimePending();
+        static bool syncTimeDone();
+        static void process();
+        static bool publish(const char *eventName, const char *data = nullptr);
+        static bool publish(const String &eventName, const String &data) {
+            return publish(eventName.c_str(), data.c_str());
+        }
+};
+extern ParticleC Particle;
+
+template <class Condition> bool waitFor(Condition condition, unsigned long timeout) //Device OS macro, as a function so simulated time moves on
+{
+    unsigned long start = millis();
+    while(!condition() && (millis() - start) < timeout) delay(1);
+    return condition();
+}
+
+class TimeC
+{
+    public:
+        bool isValid();
+        time_t now();
+        void zone(float offset) {}
+        void setTime(time_t time);
+        int year(time_t time);
+        int month(time_t time);
+        int day(time_t time);
+        int hour(time_t time);
+        int minute(time_t time);
+        int second(time_t time);
+        int year() {
+            return year(now());
+        }
+        int month() {
+            return month(now());
+        }
+        int day() {
+            return day(now());
+        }
+        int hour() {
+            return hour(now());
+        }
+        int minute() {
+            return minute(now());
+        }
+        int second() {
+            return second(now());
+        }
+};
+extern TimeC Time;
+
+class EEPROMC
+{
+    public:
+        static constexpr size_t SIZE = 4096;
+        template <class T> T& get(int address, T &val) {
+            if(address >= 0 && address + sizeof(T) <= SIZE) memcpy(&val, &data[address], sizeof(T));
+            return val;
+        }
+        template <class T> const T& put(int address, const T &val) {
+            if(address >= 0 && address + sizeof(T) <= SIZE) memcpy(&data[address], &val, sizeof(T));
+            return val;
+        }
+        void clear() {
+            memset(data, 0xFF, SIZE);
+        }
+        EEPROMC() {
+            clear();
+        }
+
+    private:
+        uint8_t data[SIZE];
+};
+extern EEPROMC EEPROM;
+
+class RGBC
+{
+    public:
+        void control(bool state) {}
+        void color(int red, int green, int blue) {}
+};
+extern RGBC RGB;
+
+#endif
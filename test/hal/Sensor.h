@@ -0,0 +1,40 @@
+/******************************************************************************
+Sensor (host simulation)
+Base class shared by GEMS sensor drivers, the parts the Kestrel driver uses
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#ifndef Sensor_h
+#define Sensor_h
+
+#include <Particle.h>
+
+const uint32_t EXCEED_COLLECT_TIME = 0x50020000; ///<Shared by every driver, subtype and port or'd in
+
+namespace BusType {
+	constexpr uint8_t NONE = 0;
+	constexpr uint8_t I2C = 1;
+	constexpr uint8_t SDI12 = 2;
+	constexpr uint8_t CORE = 3;
+}
+
+namespace PowerSaveModes {
+	constexpr uint8_t PERFORMANCE = 0;
+	constexpr uint8_t BALANCED = 1;
+	constexpr uint8_t LOW_POWER = 2;
+	constexpr uint8_t ULTRA_LOW_POWER = 3;
+}
+
+class Sensor
+{
+	public:
+		virtual ~Sensor() {}
+		uint8_t sensorInterface = BusType::NONE;
+		uint8_t powerSaveMode = PowerSaveModes::PERFORMANCE;
+};
+
+#endif
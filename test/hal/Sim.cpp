@@ -0,0 +1,902 @@
+/******************************************************************************
+Sim
+Simulated Kestrel board for host builds of the driver
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Clock, bus bookkeeping and the register level device models, see Sim.h
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#include "Sim.h"
+
+namespace Sim {
+    static uint64_t simTime = 0; //[us]
+    static time_t simEpoch = DEFAULT_EPOCH;
+    static Device *devices[128] = {nullptr};
+    bool echoSerial = false;
+    BusStats bus;
+    PinStats pins;
+    ParticleModel particle;
+    Board board;
+
+    static uint8_t bcd(int val)
+    {
+        return ((val/10) << 4) | (val % 10);
+    }
+
+    static int fromBcd(uint8_t val)
+    {
+        return (val >> 4)*10 + (val & 0x0F);
+    }
+
+    uint64_t now()
+    {
+        return simTime;
+    }
+
+    void advance(uint64_t us)
+    {
+        simTime += us;
+        service();
+    }
+
+    double utcAt(uint64_t us)
+    {
+        return simEpoch + us/1000000.0;
+    }
+
+    double utc()
+    {
+        return utcAt(simTime);
+    }
+
+    void attach(uint8_t address, Device *device)
+    {
+        devices[address & 0x7F] = device;
+    }
+
+    void detach(uint8_t address)
+    {
+        devices[address & 0x7F] = nullptr;
+    }
+
+    Device* device(uint8_t address)
+    {
+        return devices[address & 0x7F];
+    }
+
+    void reset(time_t epoch)
+    {
+        simTime = 0;
+        simEpoch = epoch;
+        bus = BusStats();
+        pins = PinStats();
+        particle = ParticleModel();
+        particle.clock.set(epoch);
+        for(int i = 0; i < 128; i++) devices[i] = nullptr;
+        board.powerOn();
+        attach(0x20, &board.ioOB);
+        attach(0x21, &board.ioTalon);
+        attach(Rtc::ADDRESS, &board.rtc);
+        attach(Rtc::EEPROM_ADDRESS, &board.rtc.eeprom);
+        attach(board.csaAlpha.address, &board.csaAlpha);
+        attach(board.csaBeta.address, &board.csaBeta);
+        attach(Als::ADDRESS, &board.als);
+        attach(Atmos::ADDRESS, &board.atmos);
+        attach(Accel::ADDRESS, &board.accel);
+        attach(0x52, &board.led);
+        attach(Gnss::ADDRESS, &board.gnss);
+    }
+
+    void service()
+    {
+        if(particle.syncPending && simTime >= particle.syncDoneAt) { //Server stamped whole seconds on the way, device applies it on arrival
+            particle.syncPending = false;
+            particle.clock.value = floor(utcAt(particle.syncStampAt));
+            particle.clock.ref = particle.syncDoneAt;
+            particle.valid = true;
+            particle.pendingTimeEvent = time_changed_sync;
+        }
+    }
+
+    void dispatchEvents()
+    {
+        if(particle.pendingTimeEvent >= 0 && particle.timeHandler != nullptr) {
+            int param = particle.pendingTimeEvent;
+            particle.pendingTimeEvent = -1;
+            particle.timeHandler(time_changed, param);
+        }
+    }
+
+    //////////////////////////////// CLOCK ////////////////////////////////
+
+    double ClockModel::at(uint64_t us) const
+    {
+        if(!running || us < ref) return value;
+        return value + (us - ref)/1000000.0*(1.0 + ppm*1e-6);
+    }
+
+    time_t ClockModel::read() const
+    {
+        return (time_t)floor(at(simTime));
+    }
+
+    void ClockModel::set(double seconds)
+    {
+        value = seconds;
+        ref = simTime;
+    }
+
+    void ClockModel::setRate(double newPpm)
+    {
+        value = at(simTime);
+        ref = simTime;
+        ppm = newPpm;
+    }
+
+    //////////////////////////////// REGISTERS ////////////////////////////////
+
+    void RegisterDevice::receive(const uint8_t *data, size_t length)
+    {
+        if(length == 0) return;
+        pointer = data[0];
+        for(size_t i = 1; i < length; i++) writeReg(pointer++, data[i]);
+        if(length > 1) written();
+    }
+
+    size_t RegisterDevice::transmit(uint8_t *data, size_t length)
+    {
+        for(size_t i = 0; i < length; i++) data[i] = readReg(pointer++);
+        return length;
+    }
+
+    //////////////////////////////// PCAL9535A ////////////////////////////////
+
+    Expander::Expander()
+    {
+        powerOn();
+    }
+
+    void Expander::powerOn()
+    {
+        memset(regs, 0, sizeof(regs));
+        regs[0x02] = regs[0x03] = 0xFF; //Outputs high
+        regs[0x06] = regs[0x07] = 0xFF; //All inputs
+        regs[0x40] = regs[0x41] = regs[0x42] = regs[0x43] = 0xFF; //Full drive strength
+        regs[0x48] = regs[0x49] = 0xFF; //Pull ups selected, not enabled
+        regs[0x4A] = regs[0x4B] = 0xFF; //Interrupts masked
+        external = 0xFFFF;
+        outputWrites = 0;
+        configWrites = 0;
+        wroteOutput = wroteConfig = false;
+        lastLevels = levels();
+    }
+
+    uint16_t Expander::levels()
+    {
+        uint16_t config = regs[0x06] | (regs[0x07] << 8);
+        uint16_t output = regs[0x02] | (regs[0x03] << 8);
+        return (output & ~config) | (external & config);
+    }
+
+    void Expander::writeReg(uint8_t reg, uint8_t val)
+    {
+        if(reg <= 0x01) return; //Input port is read only
+        if(reg == 0x02 || reg == 0x03) wroteOutput = true;
+        if(reg == 0x06 || reg == 0x07) wroteConfig = true;
+        regs[reg] = val;
+    }
+
+    uint8_t Expander::readReg(uint8_t reg)
+    {
+        if(reg == 0x00) return levels() & 0xFF;
+        if(reg == 0x01) return levels() >> 8;
+        return regs[reg];
+    }
+
+    void Expander::written()
+    {
+        if(wroteOutput) outputWrites++;
+        if(wroteConfig) configWrites++;
+        wroteOutput = wroteConfig = false;
+        uint16_t current = levels();
+        if(current != lastLevels) {
+            uint16_t previous = lastLevels;
+            lastLevels = current;
+            if(onChange) onChange(previous, current);
+        }
+    }
+
+    //////////////////////////////// MCP79412 ////////////////////////////////
+
+    Rtc::Eeprom::Eeprom()
+    {
+        const uint8_t eui[8] = {0x00, 0x04, 0xA3, 0x12, 0x34, 0x56, 0x78, 0x9A}; //Factory EUI-64 in the protected block
+        memcpy(&regs[0xF0], eui, sizeof(eui));
+    }
+
+    void Rtc::powerOn()
+    {
+        memset(regs, 0, 0xF0);
+        clock = ClockModel();
+        clock.set(floor(utc()) + 0.3); //Counting, set to the right second some time ago
+        crystalPpm = 0;
+        sets = 0;
+        trimWrites = 0;
+        timeWritten = false;
+        regs[0x00] = 0x80; //ST, oscillator running
+        regs[0x03] = 0x08 | 0x20; //VBATEN, OSCRUN
+    }
+
+    void Rtc::setDrift(double ppm)
+    {
+        crystalPpm = ppm;
+        clock.setRate(crystalPpm + trimPpm());
+    }
+
+    double Rtc::trimPpm()
+    {
+        double steps = regs[0x08] & 0x7F;
+        return (regs[0x08] & 0x80) ? steps*1.017 : -steps*1.017; //Sign set adds clocks
+    }
+
+    time_t Rtc::timeRegs(uint8_t *base)
+    {
+        struct tm t = {0};
+        t.tm_sec = fromBcd(base[0] & 0x7F);
+        t.tm_min = fromBcd(base[1] & 0x7F);
+        t.tm_hour = fromBcd(base[2] & 0x3F);
+        t.tm_mday = fromBcd(base[4] & 0x3F);
+        t.tm_mon = fromBcd(base[5] & 0x1F) - 1;
+        t.tm_year = fromBcd(base[6]) + 100;
+        return ::timegm(&t);
+    }
+
+    void Rtc::writeReg(uint8_t reg, uint8_t val)
+    {
+        if(reg <= 0x06) timeWritten = true;
+        if(reg == 0x08 && val != regs[0x08]) trimWrites++;
+        regs[reg] = val;
+        if(reg == 0x08) clock.setRate(crystalPpm + trimPpm());
+    }
+
+    uint8_t Rtc::readReg(uint8_t reg)
+    {
+        if(reg == 0x0D) alarmFired(); //Latch the flag before it is read
+        return regs[reg];
+    }
+
+    void Rtc::written()
+    {
+        if(!timeWritten) return;
+        timeWritten = false;
+        sets++;
+        clock.set(timeRegs(regs)); //Writing the time restarts the prescaler, any fraction is lost
+        clock.running = regs[0x00] & 0x80;
+    }
+
+    bool Rtc::alarmFired()
+    {
+        if(!(regs[0x07] & 0x10)) return false; //ALM0EN
+        if(regs[0x0D] & 0x08) return true; //Already latched
+        uint64_t at = nextAlarm();
+        if(at != 0 && at <= simTime) regs[0x0D] |= 0x08;
+        return regs[0x0D] & 0x08;
+    }
+
+    uint64_t Rtc::nextAlarm()
+    {
+        if(!(regs[0x07] & 0x10)) return 0;
+        uint8_t alarm[7] = {regs[0x0A], regs[0x0B], regs[0x0C], regs[0x0D], regs[0x0E], regs[0x0F], 0};
+        time_t current = clock.read();
+        struct tm now = {0};
+        gmtime_r(&current, &now);
+        alarm[6] = bcd(now.tm_year - 100); //No year register in the alarm, it matches this year
+        double target = timeRegs(alarm);
+        if(!clock.running) return 0;
+        double rate = 1.0 + clock.ppm*1e-6;
+        double us = clock.ref + (target - clock.value)/rate*1000000.0;
+        return us < 1 ? 1 : (uint64_t)ceil(us);
+    }
+
+    size_t Rtc::transmit(uint8_t *data, size_t length)
+    {
+        time_t current = clock.read(); //One snapshot so a multi byte read cannot tear
+        struct tm t = {0};
+        gmtime_r(&current, &t);
+        regs[0x00] = (regs[0x00] & 0x80) | bcd(t.tm_sec);
+        regs[0x01] = bcd(t.tm_min);
+        regs[0x02] = bcd(t.tm_hour);
+        regs[0x03] = (regs[0x03] & 0xF8) | (t.tm_wday + 1);
+        regs[0x03] = clock.running ? (regs[0x03] | 0x20) : (regs[0x03] & ~0x20);
+        regs[0x04] = bcd(t.tm_mday);
+        regs[0x05] = (regs[0x05] & 0x20) | bcd(t.tm_mon + 1);
+        regs[0x06] = bcd(t.tm_year - 100);
+        return RegisterDevice::transmit(data, length);
+    }
+
+    //////////////////////////////// PAC1934 ////////////////////////////////
+
+    Csa::Csa(uint8_t address, const double senseMilliOhm[4]) : address(address)
+    {
+        for(int i = 0; i < 4; i++) sense[i] = senseMilliOhm[i];
+        powerOn();
+    }
+
+    void Csa::powerOn()
+    {
+        ctrl = ctrlActive = 0; //1024 SPS
+        channelDis = channelDisActive = 0;
+        negPwr = negPwrActive = 0;
+        count = latchedCount = 0;
+        for(int i = 0; i < 4; i++) {
+            acc[i] = latchedAcc[i] = 0;
+            latchedVbus[i] = latchedVsense[i] = 0;
+            latchedPower[i] = 0;
+        }
+        refreshes = clears = 0;
+        nextSample = simTime + 1000000.0/sps();
+        powered = true;
+    }
+
+    bool Csa::present()
+    {
+        return powered;
+    }
+
+    uint16_t Csa::sps()
+    {
+        const uint16_t rates[4] = {1024, 256, 64, 8};
+        return rates[ctrlActive >> 6];
+    }
+
+    double Csa::currentAt(uint8_t ch, uint64_t us)
+    {
+        if(currentProfile[ch]) return currentProfile[ch](us < profileStart ? 0 : (us - profileStart)/1000000.0);
+        return current[ch];
+    }
+
+    uint16_t Csa::vbusCode(uint8_t ch, uint64_t us)
+    {
+        double code = round(vbus[ch]/32.0*65536.0);
+        return code < 0 ? 0 : (code > 65535 ? 65535 : (uint16_t)code);
+    }
+
+    uint16_t Csa::vsenseCode(uint8_t ch, uint64_t us)
+    {
+        double volts = currentAt(ch, us)*sense[ch]/1000.0;
+        if(negPwrActive & (0x80 >> ch)) { //Bipolar, two's complement
+            double code = round(volts/0.1*32768.0);
+            code = code < -32768 ? -32768 : (code > 32767 ? 32767 : code);
+            return (uint16_t)(int16_t)code;
+        }
+        double code = round(volts/0.1*65536.0);
+        return code < 0 ? 0 : (code > 65535 ? 65535 : (uint16_t)code);
+    }
+
+    void Csa::integrate()
+    {
+        double period = 1000000.0/sps();
+        if(nextSample > simTime) return;
+        bool profiled = false;
+        for(int ch = 0; ch < 4; ch++) if(currentProfile[ch]) profiled = true;
+        const uint64_t mask = (1ULL << 48) - 1;
+        if(!profiled) { //Constant inputs, add all conversions at once
+            uint64_t n = (uint64_t)floor((simTime - nextSample)/period) + 1;
+            for(int ch = 0; ch < 4; ch++) {
+                if(channelDisActive & (0x80 >> ch)) continue;
+                int64_t power = (negPwrActive & (0x80 >> ch)) ? ((int64_t)vbusCode(ch, simTime)*(int16_t)vsenseCode(ch, simTime)) >> 4 : ((int64_t)vbusCode(ch, simTime)*vsenseCode(ch, simTime)) >> 4;
+                acc[ch] = (acc[ch] + n*(uint64_t)power) & mask;
+            }
+            count = (count + n) & 0xFFFFFF;
+            nextSample += n*period;
+            return;
+        }
+        while(nextSample <= simTime) {
+            uint64_t at = (uint64_t)nextSample;
+            for(int ch = 0; ch < 4; ch++) {
+                if(channelDisActive & (0x80 >> ch)) continue;
+                int64_t power = (negPwrActive & (0x80 >> ch)) ? ((int64_t)vbusCode(ch, at)*(int16_t)vsenseCode(ch, at)) >> 4 : ((int64_t)vbusCode(ch, at)*vsenseCode(ch, at)) >> 4;
+                acc[ch] = (acc[ch] + (uint64_t)power) & mask;
+            }
+            count = (count + 1) & 0xFFFFFF;
+            nextSample += period;
+        }
+    }
+
+    void Csa::refresh(bool clear)
+    {
+        integrate();
+        refreshes++;
+        for(int ch = 0; ch < 4; ch++) {
+            latchedVbus[ch] = vbusCode(ch, simTime);
+            latchedVsense[ch] = vsenseCode(ch, simTime);
+            int64_t power = (negPwrActive & (0x80 >> ch)) ? (int64_t)latchedVbus[ch]*(int16_t)latchedVsense[ch] : (int64_t)latchedVbus[ch]*latchedVsense[ch];
+            latchedPower[ch] = (uint32_t)power & 0xFFFFFFF0;
+            latchedAcc[ch] = acc[ch];
+        }
+        latchedCount = count;
+        if(clear) {
+            clears++;
+            count = 0;
+            for(int ch = 0; ch < 4; ch++) acc[ch] = 0;
+        }
+        uint16_t oldSps = sps();
+        ctrlActive = ctrl; //Configuration writes take effect on refresh
+        channelDisActive = channelDis;
+        negPwrActive = negPwr;
+        if(sps() != oldSps) nextSample = simTime + 1000000.0/sps();
+    }
+
+    size_t Csa::regSize(uint8_t reg)
+    {
+        if(reg == 0x00 || reg == 0x1E || reg == 0x1F || reg == 0x1B) return 0; //Commands
+        if(reg == 0x02) return 3;
+        if(reg >= 0x03 && reg <= 0x06) return 6;
+        if(reg >= 0x07 && reg <= 0x16) return 2;
+        if(reg >= 0x17 && reg <= 0x1A) return 4;
+        return 1;
+    }
+
+    uint64_t Csa::regValue(uint8_t reg)
+    {
+        if(reg == 0x01) return ctrl;
+        if(reg == 0x02) return latchedCount;
+        if(reg >= 0x03 && reg <= 0x06) return latchedAcc[reg - 0x03];
+        if(reg >= 0x07 && reg <= 0x0A) return latchedVbus[reg - 0x07];
+        if(reg >= 0x0B && reg <= 0x0E) return latchedVsense[reg - 0x0B];
+        if(reg >= 0x0F && reg <= 0x12) return latchedVbus[reg - 0x0F]; //Averages equal the instantaneous value for steady inputs
+        if(reg >= 0x13 && reg <= 0x16) return latchedVsense[reg - 0x13];
+        if(reg >= 0x17 && reg <= 0x1A) return latchedPower[reg - 0x17];
+        if(reg == 0x1C) return channelDis;
+        if(reg == 0x1D) return negPwr;
+        if(reg == 0x21) return ctrlActive;
+        if(reg == 0x22) return channelDisActive;
+        if(reg == 0x23) return negPwrActive;
+        if(reg == 0xFD) return 0x5B; //PAC1934
+        if(reg == 0xFE) return 0x5D; //Microchip
+        if(reg == 0xFF) return 0x03;
+        return 0;
+    }
+
+    void Csa::receive(const uint8_t *data, size_t length)
+    {
+        if(length == 0) return;
+        pointer = data[0];
+        if(length == 1) {
+            if(pointer == 0x00 || pointer == 0x1E) refresh(true);
+            else if(pointer == 0x1F) refresh(false);
+            return;
+        }
+        for(size_t i = 1; i < length; i++) {
+            uint8_t reg = pointer++;
+            if(reg == 0x01) ctrl = data[i];
+            else if(reg == 0x1C) channelDis = data[i];
+            else if(reg == 0x1D) negPwr = data[i];
+        }
+    }
+
+    size_t Csa::transmit(uint8_t *data, size_t length)
+    {
+        size_t pos = 0;
+        uint16_t reg = pointer;
+        while(pos < length && reg <= 0xFF) { //Auto increment across registers of different widths
+            size_t size = regSize(reg);
+            uint64_t val = regValue(reg);
+            for(size_t b = 0; b < size && pos < length; b++) data[pos++] = (val >> (8*(size - 1 - b))) & 0xFF;
+            reg++;
+        }
+        while(pos < length) data[pos++] = 0;
+        return length;
+    }
+
+    //////////////////////////////// VEML3328 ////////////////////////////////
+
+    void Als::powerOn()
+    {
+        config = 0x8001; //SD1 and SD0, shut down
+        configWrites = 0;
+        configuredAt = simTime;
+        pointer = 0;
+    }
+
+    double Als::sensitivity()
+    {
+        const double it[4] = {1, 2, 4, 8}; //50, 100, 200, 400ms
+        const double gain[4] = {1, 2, 4, 0.5};
+        const double dg[4] = {1, 2, 4, 4};
+        return 0.5*it[(config >> 4) & 0x03]*gain[(config >> 10) & 0x03]*dg[(config >> 12) & 0x03];
+    }
+
+    uint16_t Als::counts(uint8_t channel)
+    {
+        if(config & 0x8001) return 0; //Shut down
+        const unsigned long it[4] = {50, 100, 200, 400};
+        if(simTime < configuredAt + it[(config >> 4) & 0x03]*1000UL) return 0; //First conversion at this range not finished
+        const double weight[5] = {1.6, 0.7, 1.0, 0.5, 0.15}; //Clear, Red, Green, Blue, IR relative to green
+        double val = round(lux*sensitivity()*weight[channel]);
+        return val > 65535 ? 65535 : (uint16_t)val;
+    }
+
+    void Als::receive(const uint8_t *data, size_t length)
+    {
+        if(length == 0) return;
+        pointer = data[0];
+        if(length >= 3 && pointer == 0x00) {
+            config = data[1] | (data[2] << 8);
+            configWrites++;
+            configuredAt = simTime;
+        }
+    }
+
+    size_t Als::transmit(uint8_t *data, size_t length)
+    {
+        uint16_t val = 0;
+        if(pointer == 0x00) val = config;
+        else if(pointer >= 0x04 && pointer <= 0x08) val = counts(pointer - 0x04);
+        else if(pointer == 0x0C) val = 0x0028; //Device ID
+        for(size_t i = 0; i < length; i++) data[i] = (i == 0) ? (val & 0xFF) : (i == 1 ? val >> 8 : 0);
+        return length;
+    }
+
+    //////////////////////////////// SHT4x ////////////////////////////////
+
+    uint8_t Atmos::crc(const uint8_t *data)
+    {
+        uint8_t crc = 0xFF;
+        for(int i = 0; i < 2; i++) {
+            crc ^= data[i];
+            for(int b = 0; b < 8; b++) crc = (crc & 0x80) ? (crc << 1) ^ 0x31 : (crc << 1);
+        }
+        return crc;
+    }
+
+    void Atmos::receive(const uint8_t *data, size_t length)
+    {
+        if(length == 0) return;
+        uint16_t words[2] = {0};
+        unsigned long conversion = 0; //[us]
+        switch(data[0]) {
+            case 0xFD: conversion = 8300; break;
+            case 0xF6: conversion = 4500; break;
+            case 0xE0: conversion = 1700; break;
+            case 0x89: //Serial number
+                words[0] = 0x1234;
+                words[1] = 0x5678;
+                conversion = 100;
+                break;
+            case 0x94: //Soft reset
+                pendingLength = 0;
+                readyAt = simTime + 1000;
+                return;
+            default:
+                return;
+        }
+        if(data[0] != 0x89) {
+            measurements++;
+            double t = round((temperature + 45.0)/175.0*65535.0);
+            double rh = round((humidity + 6.0)/125.0*65535.0);
+            words[0] = t < 0 ? 0 : (t > 65535 ? 65535 : (uint16_t)t);
+            words[1] = rh < 0 ? 0 : (rh > 65535 ? 65535 : (uint16_t)rh);
+        }
+        for(int i = 0; i < 2; i++) {
+            pending[3*i] = words[i] >> 8;
+            pending[3*i + 1] = words[i] & 0xFF;
+            pending[3*i + 2] = crc(&pending[3*i]);
+        }
+        pendingLength = 6;
+        readyAt = simTime + conversion;
+    }
+
+    size_t Atmos::transmit(uint8_t *data, size_t length)
+    {
+        if(pendingLength == 0 || simTime < readyAt) return 0; //NACK while converting
+        size_t n = length < pendingLength ? length : pendingLength;
+        memcpy(data, pending, n);
+        pendingLength = 0;
+        return n;
+    }
+
+    //////////////////////////////// MXC6655 ////////////////////////////////
+
+    Accel::Accel()
+    {
+        regs[0x0F] = 0x05; //WHO_AM_I
+    }
+
+    uint8_t Accel::readReg(uint8_t reg)
+    {
+        if(reg >= 0x03 && reg <= 0x08) { //12 bit left justified, 1024 LSB/g at 2g range
+            double val = round(g[(reg - 0x03)/2]*1024.0);
+            val = val < -2048 ? -2048 : (val > 2047 ? 2047 : val);
+            uint16_t raw = ((uint16_t)(int16_t)val) << 4;
+            return ((reg - 0x03) % 2 == 0) ? raw >> 8 : raw & 0xF0;
+        }
+        if(reg == 0x09) return (uint8_t)(int8_t)round((temperature - 25.0)/0.586);
+        return regs[reg];
+    }
+
+    //////////////////////////////// u-blox ////////////////////////////////
+
+    void Gnss::powerOn()
+    {
+        power = Power::OFF;
+        inputLength = 0;
+        outputLength = outputPos = 0;
+        pointer = 0xFF;
+        lastExtint = true; //Pulled up at the expander
+        polls = 0;
+        wakes = 0;
+        memset(pollsByClass, 0, sizeof(pollsByClass));
+    }
+
+    bool Gnss::present()
+    {
+        if(power == Power::BOOTING && simTime >= bootDoneAt) power = Power::RUNNING;
+        return power == Power::RUNNING;
+    }
+
+    void Gnss::setPowered(bool on)
+    {
+        if(on && power == Power::OFF) {
+            power = Power::BOOTING;
+            bootDoneAt = simTime + bootTime*1000UL;
+        }
+        else if(!on) {
+            power = Power::OFF;
+            inputLength = 0;
+            outputLength = outputPos = 0;
+        }
+    }
+
+    void Gnss::extint(bool level)
+    {
+        if(level == lastExtint) return;
+        lastExtint = level;
+        if(power == Power::BACKUP) { //Any edge wakes
+            power = Power::BOOTING;
+            bootDoneAt = simTime + bootTime*1000UL;
+            wakes++;
+        }
+    }
+
+    double Gnss::lastEpoch()
+    {
+        return floor(utc() - solutionLatency/1000.0);
+    }
+
+    size_t Gnss::available()
+    {
+        if(simTime < outputReadyAt) return 0;
+        return outputLength - outputPos;
+    }
+
+    void Gnss::queue(uint8_t cls, uint8_t id, const uint8_t *payload, uint16_t length)
+    {
+        if(outputPos == outputLength) outputLength = outputPos = 0;
+        if(outputLength + length + 8 > sizeof(output)) return; //Receiver drops output it has no room for
+        uint8_t *frame = &output[outputLength];
+        frame[0] = 0xB5;
+        frame[1] = 0x62;
+        frame[2] = cls;
+        frame[3] = id;
+        frame[4] = length & 0xFF;
+        frame[5] = length >> 8;
+        memcpy(&frame[6], payload, length);
+        uint8_t a = 0;
+        uint8_t b = 0;
+        for(int i = 2; i < 6 + length; i++) {
+            a += frame[i];
+            b += a;
+        }
+        frame[6 + length] = a;
+        frame[7 + length] = b;
+        outputLength += length + 8;
+        outputReadyAt = simTime + responseTime*1000UL;
+    }
+
+    static void put32(uint8_t *buf, uint32_t val)
+    {
+        for(int i = 0; i < 4; i++) buf[i] = (val >> (8*i)) & 0xFF;
+    }
+
+    void Gnss::handle(uint8_t cls, uint8_t id, const uint8_t *payload, uint16_t length)
+    {
+        polls++;
+        pollsByClass[cls]++;
+        uint8_t reply[92] = {0};
+        double reported = lastEpoch() + timeError;
+        time_t seconds = (time_t)floor(reported);
+        int32_t nano = (int32_t)round((reported - seconds)*1e9);
+        struct tm t = {0};
+        gmtime_r(&seconds, &t);
+        uint32_t iTow = (uint32_t)(((seconds - 315964800 + 18) % 604800)*1000 + nano/1000000);
+        bool fix = fixType >= 2 && fixType <= 4;
+        if(cls == 0x01 && length == 0) { //NAV polls
+            if(id == 0x21) { //TIMEUTC
+                put32(&reply[0], iTow);
+                put32(&reply[4], tAcc);
+                put32(&reply[8], (uint32_t)nano);
+                reply[12] = (t.tm_year + 1900) & 0xFF;
+                reply[13] = (t.tm_year + 1900) >> 8;
+                reply[14] = t.tm_mon + 1;
+                reply[15] = t.tm_mday;
+                reply[16] = t.tm_hour;
+                reply[17] = t.tm_min;
+                reply[18] = t.tm_sec;
+                reply[19] = timeValid ? 0x07 : 0x00;
+                queue(cls, id, reply, 20);
+            }
+            else if(id == 0x03) { //STATUS
+                put32(&reply[0], iTow);
+                reply[4] = fixType;
+                reply[5] = (gnssFixOk && fix ? 0x01 : 0) | (timeValid ? 0x0C : 0);
+                put32(&reply[8], fix ? ttff : 0);
+                put32(&reply[12], (uint32_t)(simTime/1000));
+                queue(cls, id, reply, 16);
+            }
+            else if(id == 0x07) { //PVT
+                put32(&reply[0], iTow);
+                reply[4] = (t.tm_year + 1900) & 0xFF;
+                reply[5] = (t.tm_year + 1900) >> 8;
+                reply[6] = t.tm_mon + 1;
+                reply[7] = t.tm_mday;
+                reply[8] = t.tm_hour;
+                reply[9] = t.tm_min;
+                reply[10] = t.tm_sec;
+                reply[11] = timeValid ? 0x07 : 0x00;
+                put32(&reply[12], tAcc);
+                put32(&reply[16], (uint32_t)nano);
+                reply[20] = fixType;
+                reply[21] = gnssFixOk ? 0x01 : 0;
+                reply[23] = siv;
+                put32(&reply[24], (uint32_t)longitude);
+                put32(&reply[28], (uint32_t)latitude);
+                put32(&reply[32], (uint32_t)altitude);
+                put32(&reply[36], (uint32_t)altitude);
+                queue(cls, id, reply, 92);
+            }
+            else if(id == 0x05) queue(cls, id, reply, 32); //ATT, all zero
+            return;
+        }
+        if(cls == 0x02 && id == 0x41) { //RXM-PMREQ, no reply
+            power = Power::BACKUP;
+            inputLength = 0;
+            outputLength = outputPos = 0;
+            return;
+        }
+        if(cls == 0x06) { //CFG, polls get the message then an ACK, sets just the ACK
+            if(id == 0x08 && length == 0) { //RATE
+                reply[0] = 1000 & 0xFF;
+                reply[1] = 1000 >> 8;
+                reply[2] = 1;
+                reply[4] = 1;
+                queue(cls, id, reply, 6);
+            }
+            else if(id == 0x00 && length <= 1) queue(cls, id, reply, 20); //PRT for the port asked for
+            uint8_t ack[2] = {cls, id};
+            queue(0x05, 0x01, ack, 2);
+        }
+    }
+
+    void Gnss::receive(const uint8_t *data, size_t length)
+    {
+        if(length == 1) { //Register address only
+            pointer = data[0];
+            return;
+        }
+        for(size_t i = 0; i < length; i++) {
+            if(inputLength < sizeof(input)) input[inputLength++] = data[i];
+        }
+        while(inputLength >= 2) {
+            if(input[0] != 0xB5 || input[1] != 0x62) { //Resynchronize on the next header
+                memmove(input, input + 1, --inputLength);
+                continue;
+            }
+            if(inputLength < 6) return;
+            uint16_t payloadLength = input[4] | (input[5] << 8);
+            if(payloadLength + 8u > sizeof(input)) {
+                inputLength = 0;
+                return;
+            }
+            if(inputLength < payloadLength + 8u) return;
+            uint8_t a = 0;
+            uint8_t b = 0;
+            for(int i = 2; i < 6 + payloadLength; i++) {
+                a += input[i];
+                b += a;
+            }
+            uint8_t frame[sizeof(input)];
+            size_t used = payloadLength + 8;
+            memcpy(frame, input, used);
+            memmove(input, input + used, inputLength - used); //Consume first, handling may reset the receiver
+            inputLength -= used;
+            if(a == frame[6 + payloadLength] && b == frame[7 + payloadLength]) handle(frame[2], frame[3], &frame[6], payloadLength);
+        }
+    }
+
+    size_t Gnss::transmit(uint8_t *data, size_t length)
+    {
+        size_t avail = available();
+        for(size_t i = 0; i < length; i++) {
+            if(pointer == 0xFD) {
+                data[i] = avail >> 8;
+                pointer = 0xFE;
+            }
+            else if(pointer == 0xFE) {
+                data[i] = avail & 0xFF;
+                pointer = 0xFF;
+            }
+            else if(available() > 0) data[i] = output[outputPos++];
+            else data[i] = 0xFF;
+        }
+        return length;
+    }
+
+    //////////////////////////////// BOARD ////////////////////////////////
+
+    static const double ALPHA_SENSE[4] = {2, 2, 2, 2};
+    static const double BETA_SENSE[4] = {2, 10, 10, 10};
+
+    Board::Board() : csaAlpha(0x18, ALPHA_SENSE), csaBeta(0x14, BETA_SENSE) {}
+
+    bool Board::auxPowered()
+    {
+        bool output = !(ioOB.regs[0x07] & (1 << (BoardPins::OB_AUX_EN - 8)));
+        bool high = ioOB.regs[0x03] & (1 << (BoardPins::OB_AUX_EN - 8));
+        return output && high;
+    }
+
+    int Board::inputLevel(uint16_t pin)
+    {
+        if(pin == BoardPins::CLOCK_INT) return rtc.alarmFired() ? LOW : HIGH; //MFP, open drain with pull up
+        return LOW;
+    }
+
+    void Board::powerOn()
+    {
+        ioOB.powerOn();
+        ioTalon.powerOn();
+        rtc.powerOn();
+        csaAlpha.powerOn();
+        csaBeta.powerOn();
+        for(int ch = 0; ch < 4; ch++) {
+            csaAlpha.vbus[ch] = csaBeta.vbus[ch] = 0;
+            csaAlpha.current[ch] = csaBeta.current[ch] = 0;
+            csaAlpha.currentProfile[ch] = csaBeta.currentProfile[ch] = nullptr;
+        }
+        csaAlpha.vbus[0] = 3.9; //Battery
+        csaAlpha.current[0] = 0.010;
+        csaAlpha.vbus[1] = 5.1; //Solar
+        csaAlpha.vbus[2] = 3.3; //3v3 rail
+        csaAlpha.current[2] = 0.020;
+        csaAlpha.vbus[3] = 3.3;
+        csaBeta.vbus[3] = 12.0; //Bulk
+        als = Als();
+        als.powerOn();
+        atmos = Atmos();
+        accel = Accel();
+        memset(led.regs, 0, sizeof(led.regs));
+        gnss = Gnss();
+        gnss.powerOn();
+        onTalonPower = nullptr;
+        ioOB.onChange = [this](uint16_t previous, uint16_t current) {
+            bool aux = auxPowered();
+            gnss.setPowered(aux);
+            if(aux != als.powered) {
+                als.powerOn();
+                als.powered = aux;
+            }
+            if((previous ^ current) & (1 << BoardPins::OB_GPS_INT)) gnss.extint(current & (1 << BoardPins::OB_GPS_INT));
+        };
+        ioTalon.onChange = [this](uint16_t previous, uint16_t current) {
+            for(uint8_t port = 0; port < 4; port++) {
+                uint16_t bit = 1 << BoardPins::TALON_EN[port];
+                if(((previous ^ current) & bit) && onTalonPower) onTalonPower(port + 1, current & bit);
+            }
+        };
+    }
+}
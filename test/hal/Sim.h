@@ -0,0 +1,335 @@
+/******************************************************************************
+Sim
+Simulated Kestrel board for host builds of the driver
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Simulated time is a microsecond counter that only moves when code waits
+(delay, busy loops on millis/micros, sleep) or when bytes cross the simulated
+I2C bus, so a test run of begin() through a full diagnostic takes
+milliseconds of wall time while every latency reported is the one the board
+would see. Each call to millis() or micros() costs 1us, so busy waits end.
+
+Devices are register level models attached to Wire by address. The driver and
+its sibling libraries talk to them through the same Wire calls they use on
+hardware, so bus counts here are complete, not just the traffic the driver
+chooses to count itself. Models carry the physics tests need to steer:
+drifting clocks, PAC1934 accumulators, a navigating GNSS receiver, a cloud
+time sync with latency, and the aux rail that powers the GNSS and ALS.
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#ifndef Sim_h
+#define Sim_h
+
+#include <Particle.h>
+#include <functional>
+
+namespace Sim {
+    constexpr time_t DEFAULT_EPOCH = 1700000000; ///<True UTC at simulated time 0, 2023-11-14 22:13:20
+
+    uint64_t now(); //[us] Simulated time since reset
+    void advance(uint64_t us); //Move simulated time forward, running anything that falls due
+    double utc(); //[s] True UTC right now, what GNSS and the cloud report
+    double utcAt(uint64_t us);
+    void reset(time_t epoch = DEFAULT_EPOCH); //Power on: time back to 0, every model to its default, devices attached at board addresses
+    extern bool echoSerial; ///<Print Serial output to stdout
+
+    class Device { //One I2C target, the address NACKs unless present()
+        public:
+            virtual ~Device() {}
+            virtual bool present() {
+                return true;
+            }
+            virtual void receive(const uint8_t *data, size_t length) {} //Bytes of one write transaction, in order
+            virtual size_t transmit(uint8_t *data, size_t length) { //Fill a read transaction, return bytes supplied (0 = NACK)
+                return 0;
+            }
+    };
+    void attach(uint8_t address, Device *device);
+    void detach(uint8_t address);
+    Device* device(uint8_t address);
+
+    struct BusStats {
+        unsigned long transactions = 0; ///<Every start condition, reads and writes, ACKed or not
+        unsigned long writes = 0;
+        unsigned long reads = 0;
+        unsigned long nacks = 0;
+        unsigned long bytes = 0; ///<Data bytes, excluding address
+        unsigned long perAddress[128] = {0}; ///<Transactions per 7 bit address
+        uint64_t busy = 0; ///<[us] Time the bus was in use
+    };
+    extern BusStats bus;
+
+    struct PinStats {
+        uint8_t level[TOTAL_PINS] = {0}; ///<Last level driven by the MCU
+        bool output[TOTAL_PINS] = {false};
+        unsigned long writes[TOTAL_PINS] = {0}; ///<digitalWrite calls, whether or not the level changed
+        unsigned long modes[TOTAL_PINS] = {0}; ///<pinMode calls
+    };
+    extern PinStats pins;
+
+    struct ClockModel { //A free running clock counting whole seconds
+        double value = 0; ///<[s] Reading at ref
+        uint64_t ref = 0; ///<[us] Simulated time of value
+        double ppm = 0; ///<Rate error, positive runs fast
+        bool running = true;
+        double at(uint64_t us) const; //[s] Fractional reading at simulated time
+        time_t read() const; //Whole seconds, as the registers give it
+        void set(double seconds); //Restart from seconds at simulated now
+        void setRate(double newPpm); //Change rate from now on without a jump
+    };
+
+    struct ParticleModel {
+        ClockModel clock; ///<Device OS RTC behind Time
+        bool valid = true; ///<Time.isValid()
+        bool connected = true; ///<Cloud session up
+        bool reachable = true; ///<Particle.connect() succeeds
+        unsigned long syncLatency = 800; ///<[ms] Request to time set, server stamps the time halfway
+        bool syncPending = false;
+        uint64_t syncDoneAt = 0;
+        uint64_t syncStampAt = 0;
+        unsigned long syncs = 0; ///<Particle.syncTime() requests sent
+        unsigned long publishes = 0;
+        std::string lastEvent;
+        std::string lastPublish;
+        int resetReason = 20; ///<RESET_REASON_POWER_DOWN
+        uint32_t freeMemory = 80000;
+        unsigned long maxSleep = 300000; ///<[ms] Wake by GPIO after this if nothing else wakes the device
+        unsigned long sleeps = 0;
+        unsigned long resets = 0; ///<System.reset() calls
+        uint64_t asleep = 0; ///<[us] Total time spent in System.sleep
+        void (*timeHandler)(system_event_t, int) = nullptr;
+        void (*memoryHandler)(system_event_t, int) = nullptr;
+        int pendingTimeEvent = -1; ///<time_changed param waiting for Particle.process(), -1 if none
+    };
+    extern ParticleModel particle;
+
+    class RegisterDevice : public Device { //8 bit register pointer, auto increment, as most parts on the board
+        public:
+            uint8_t regs[256] = {0};
+            uint8_t pointer = 0;
+            void receive(const uint8_t *data, size_t length) override;
+            size_t transmit(uint8_t *data, size_t length) override;
+        protected:
+            virtual void writeReg(uint8_t reg, uint8_t val) {
+                regs[reg] = val;
+            }
+            virtual uint8_t readReg(uint8_t reg) {
+                return regs[reg];
+            }
+            virtual void written() {} //After a write transaction with data
+    };
+
+    class Expander : public RegisterDevice { //PCAL9535A
+        public:
+            Expander();
+            uint16_t external = 0xFFFF; ///<Level on pins not driven as outputs, pull ups by default
+            uint16_t levels(); //Actual pin levels, driven outputs or external
+            unsigned long outputWrites = 0; ///<Transactions that wrote an output register
+            unsigned long configWrites = 0; ///<Transactions that wrote a configuration register
+            std::function<void(uint16_t previous, uint16_t current)> onChange; ///<Pin levels changed
+            void powerOn();
+        protected:
+            void writeReg(uint8_t reg, uint8_t val) override;
+            uint8_t readReg(uint8_t reg) override;
+            void written() override;
+        private:
+            bool wroteOutput = false;
+            bool wroteConfig = false;
+            uint16_t lastLevels = 0xFFFF;
+    };
+
+    class Rtc : public RegisterDevice { //MCP79412, time keeping registers at 0x6F, unique ID at 0x57
+        public:
+            static constexpr uint8_t ADDRESS = 0x6F;
+            static constexpr uint8_t EEPROM_ADDRESS = 0x57;
+            ClockModel clock;
+            double crystalPpm = 0; ///<Untrimmed oscillator error, use setDrift
+            void setDrift(double ppm); //Crystal error from now on, trim is applied on top
+            unsigned long sets = 0; ///<Time register writes
+            unsigned long trimWrites = 0;
+            bool alarmFired(); //MFP asserted by an alarm, Clock_INT is low
+            uint64_t nextAlarm(); //[us] Simulated time the enabled alarm fires, 0 if none
+            double trimPpm(); //Rate correction from OSCTRIM
+            void powerOn();
+            size_t transmit(uint8_t *data, size_t length) override;
+            class Eeprom : public RegisterDevice {
+                public:
+                    Eeprom();
+            } eeprom;
+        protected:
+            void writeReg(uint8_t reg, uint8_t val) override;
+            uint8_t readReg(uint8_t reg) override;
+            void written() override;
+        private:
+            bool timeWritten = false;
+            time_t timeRegs(uint8_t *base);
+    };
+
+    class Csa : public Device { //PAC1934
+        public:
+            Csa(uint8_t address, const double senseMilliOhm[4]);
+            uint8_t address;
+            double sense[4]; ///<[mOhm] Fitted sense resistors
+            double vbus[4] = {0}; ///<[V]
+            double current[4] = {0}; ///<[A]
+            std::function<double(double)> currentProfile[4]; ///<[A] Optional current against seconds since profileStart, overrides current
+            uint64_t profileStart = 0;
+            uint8_t ctrl = 0; ///<As written, 1024 SPS at power on
+            uint8_t channelDis = 0;
+            uint8_t negPwr = 0;
+            uint32_t count = 0; ///<ACC_COUNT, 24 bit, rolls over
+            uint64_t acc[4] = {0}; ///<VPOWERn_ACC, 48 bit, rolls over
+            unsigned long refreshes = 0;
+            unsigned long clears = 0;
+            uint16_t sps(); //Active sample rate
+            double currentAt(uint8_t ch, uint64_t us);
+            void powerOn();
+            bool present() override;
+            void receive(const uint8_t *data, size_t length) override;
+            size_t transmit(uint8_t *data, size_t length) override;
+            bool powered = true;
+        private:
+            uint8_t ctrlActive = 0;
+            uint8_t channelDisActive = 0;
+            uint8_t negPwrActive = 0;
+            double nextSample = 0; ///<[us] Simulated time of the next conversion
+            uint32_t latchedCount = 0; ///<ACC_COUNT and VPOWERn_ACC as of the last refresh
+            uint64_t latchedAcc[4] = {0};
+            uint16_t latchedVbus[4] = {0};
+            uint16_t latchedVsense[4] = {0};
+            uint32_t latchedPower[4] = {0};
+            uint8_t pointer = 0;
+            void integrate();
+            void refresh(bool clear);
+            uint16_t vbusCode(uint8_t ch, uint64_t us);
+            uint16_t vsenseCode(uint8_t ch, uint64_t us);
+            size_t regSize(uint8_t reg);
+            uint64_t regValue(uint8_t reg);
+    };
+
+    class Als : public Device { //VEML3328, 16 bit little endian registers
+        public:
+            static constexpr uint8_t ADDRESS = 0x10;
+            double lux = 500;
+            bool powered = false; ///<On the aux rail
+            uint16_t config = 0x0001; ///<Shut down at power on
+            unsigned long configWrites = 0;
+            uint16_t counts(uint8_t channel); //Channel register value for current light and range
+            double sensitivity(); //Green counts per lux at current range
+            void powerOn();
+            bool present() override {
+                return powered;
+            }
+            void receive(const uint8_t *data, size_t length) override;
+            size_t transmit(uint8_t *data, size_t length) override;
+        private:
+            uint8_t pointer = 0;
+            uint64_t configuredAt = 0; ///<[us] Data is valid one integration time after this
+    };
+
+    class Atmos : public Device { //SHT4x
+        public:
+            static constexpr uint8_t ADDRESS = 0x44;
+            double temperature = 21.5; ///<[C]
+            double humidity = 45.0; ///<[%]
+            unsigned long measurements = 0;
+            void receive(const uint8_t *data, size_t length) override;
+            size_t transmit(uint8_t *data, size_t length) override;
+            static uint8_t crc(const uint8_t *data);
+        private:
+            uint8_t pending[6] = {0};
+            size_t pendingLength = 0;
+            uint64_t readyAt = 0;
+    };
+
+    class Accel : public RegisterDevice { //MXC6655
+        public:
+            static constexpr uint8_t ADDRESS = 0x15;
+            double g[3] = {0.01, -0.02, 1.0};
+            double temperature = 24.0;
+            Accel();
+        protected:
+            uint8_t readReg(uint8_t reg) override;
+    };
+
+    class Led : public RegisterDevice {}; //PCA9634, registers only
+
+    class Gnss : public Device { //u-blox receiver on the aux rail, UBX over the DDC (I2C) port
+        public:
+            static constexpr uint8_t ADDRESS = 0x42;
+            enum class Power {OFF, BOOTING, RUNNING, BACKUP};
+            Power power = Power::OFF;
+            uint64_t bootDoneAt = 0;
+            unsigned long bootTime = 500; ///<[ms] Power or wake to first I2C ACK
+            unsigned long responseTime = 20; ///<[ms] Poll to response in the output buffer
+            unsigned long solutionLatency = 50; ///<[ms] Navigation epoch to solution available
+            uint8_t fixType = 3;
+            bool gnssFixOk = true;
+            bool timeValid = true; ///<NAV-TIMEUTC valid flags, independent of fix (receiver RTC)
+            uint8_t siv = 9;
+            int32_t latitude = 449740000; ///<[deg * 1e-7]
+            int32_t longitude = -932350000;
+            int32_t altitude = 256000; ///<[mm]
+            uint32_t tAcc = 25; ///<[ns]
+            uint32_t ttff = 28000; ///<[ms]
+            double timeError = 0; ///<[s] Added to reported time, for a receiver that is wrong
+            unsigned long polls = 0; ///<UBX messages received
+            unsigned long pollsByClass[256] = {0};
+            unsigned long wakes = 0;
+            void setPowered(bool on);
+            void extint(bool level); //GPS_INT line, an edge wakes from backup
+            void powerOn();
+            bool present() override;
+            void receive(const uint8_t *data, size_t length) override;
+            size_t transmit(uint8_t *data, size_t length) override;
+            double lastEpoch(); //[s] UTC of the newest navigation solution available now
+        private:
+            uint8_t pointer = 0xFF;
+            uint8_t input[300] = {0};
+            size_t inputLength = 0;
+            uint8_t output[512] = {0};
+            size_t outputLength = 0;
+            size_t outputPos = 0;
+            uint64_t outputReadyAt = 0;
+            bool lastExtint = false;
+            void handle(uint8_t cls, uint8_t id, const uint8_t *payload, uint16_t length);
+            void queue(uint8_t cls, uint8_t id, const uint8_t *payload, uint16_t length);
+            size_t available();
+    };
+
+    struct Board {
+        Board();
+        Expander ioOB; ///<0x20
+        Expander ioTalon; ///<0x21
+        Rtc rtc;
+        Csa csaAlpha; ///<0x18
+        Csa csaBeta; ///<0x14
+        Als als;
+        Atmos atmos;
+        Accel accel;
+        Led led;
+        Gnss gnss;
+        std::function<void(uint8_t port, bool on)> onTalonPower; ///<Talon port 1-4 rail switched
+        bool auxPowered(); //AUX_EN, ioOB pin 15, driven high
+        int inputLevel(uint16_t pin); //Level seen by digitalRead on an MCU pin not driven as output
+        void powerOn();
+    };
+    extern Board board;
+
+    namespace BoardPins { //Mirrors the driver's pin maps, kept separate so a driver change cannot silently fix the model
+        constexpr uint16_t CLOCK_INT = D22;
+        constexpr uint8_t OB_GPS_INT = 7;
+        constexpr uint8_t OB_CE = 11;
+        constexpr uint8_t OB_AUX_EN = 15;
+        constexpr uint8_t TALON_EN[4] = {3, 7, 11, 15};
+    }
+
+    void service(); //Complete anything due at the current simulated time
+    void dispatchEvents(); //Deliver queued system events, Particle.process()
+}
+
+#endif
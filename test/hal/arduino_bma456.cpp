@@ -0,0 +1,37 @@
+/******************************************************************************
+arduino_bma456 (host simulation)
+BMA456 accelerometer library, the parts the Kestrel driver uses
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#include "arduino_bma456.h"
+
+BMA456 bma456;
+
+static constexpr uint8_t BMA456_ADR = 0x18; //Shared with csaAlpha on boards without the BMA456
+static constexpr uint8_t BMA456_CHIP_ID = 0x16;
+
+bool BMA456::begin()
+{
+	Wire.beginTransmission(BMA456_ADR);
+	Wire.write(0x00); //CHIP_ID
+	if(Wire.endTransmission(false) != 0) return false;
+	if(Wire.requestFrom(BMA456_ADR, (uint8_t)1) != 1) return false;
+	return Wire.read() == BMA456_CHIP_ID;
+}
+
+void BMA456::getAcceleration(float *x, float *y, float *z)
+{
+	*x = 0;
+	*y = 0;
+	*z = 1000; //[mg]
+}
+
+int32_t BMA456::getTemperature()
+{
+	return 23;
+}
@@ -0,0 +1,28 @@
+/******************************************************************************
+arduino_bma456 (host simulation)
+BMA456 accelerometer library, the parts the Kestrel driver uses
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Not fitted on the simulated board, begin() probes the bus and fails.
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#ifndef arduino_bma456_h
+#define arduino_bma456_h
+
+#include <Particle.h>
+
+class BMA456
+{
+	public:
+		bool begin();
+		void initialize() {}
+		void getAcceleration(float *x, float *y, float *z);
+		int32_t getTemperature();
+};
+extern BMA456 bma456;
+
+#endif
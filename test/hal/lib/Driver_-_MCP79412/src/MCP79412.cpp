@@ -0,0 +1,145 @@
+/******************************************************************************
+MCP79412 (host simulation)
+Real time clock library, the parts the Kestrel driver uses
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#include "MCP79412.h"
+
+static uint8_t toBcd(int val)
+{
+	return ((val/10) << 4) | (val % 10);
+}
+
+static int fromBcd(uint8_t val)
+{
+	return (val >> 4)*10 + (val & 0x0F);
+}
+
+void MCP79412::error(uint32_t code)
+{
+	if(numErrors < sizeof(errors)/sizeof(errors[0])) errors[numErrors] = code;
+	numErrors++; //Keeps counting past the array so overwrites can be detected
+}
+
+int MCP79412::readRegs(uint8_t adr, uint8_t reg, uint8_t *vals, uint8_t len)
+{
+	Wire.beginTransmission(adr);
+	Wire.write(reg);
+	int status = Wire.endTransmission(false);
+	if(status != 0) return status;
+	if(Wire.requestFrom(adr, len) != len) return 4;
+	for(int i = 0; i < len; i++) vals[i] = Wire.read();
+	return 0;
+}
+
+uint8_t MCP79412::readByte(int reg)
+{
+	uint8_t val = 0;
+	if(readRegs(ADR, reg, &val, 1) != 0) error(RTC_READ_FAIL);
+	return val;
+}
+
+int MCP79412::writeByte(int reg, uint8_t data)
+{
+	Wire.beginTransmission(ADR);
+	Wire.write(reg);
+	Wire.write(data);
+	return Wire.endTransmission();
+}
+
+int MCP79412::begin(bool useExtOsc)
+{
+	if(!Wire.isEnabled()) Wire.begin();
+	Wire.beginTransmission(ADR);
+	if(Wire.endTransmission() != 0) return 0;
+	uint8_t control = readByte(0x07);
+	writeByte(0x07, useExtOsc ? (control | 0x08) : (control & ~0x08)); //EXTOSC
+	uint8_t wkday = readByte(0x03);
+	writeByte(0x03, wkday | 0x08); //VBATEN
+	uint8_t sec = readByte(0x00);
+	if(!(sec & 0x80)) writeByte(0x00, sec | 0x80); //Start oscillator if stopped
+	return 1;
+}
+
+int MCP79412::setTime(int year, int month, int day, int hour, int minute, int second)
+{
+	struct tm t = {0};
+	t.tm_year = year - 1900;
+	t.tm_mon = month - 1;
+	t.tm_mday = day;
+	time_t epoch = ::timegm(&t);
+	gmtime_r(&epoch, &t);
+	Wire.beginTransmission(ADR);
+	Wire.write(0x00);
+	Wire.write(toBcd(second) | 0x80); //Keep ST set
+	Wire.write(toBcd(minute));
+	Wire.write(toBcd(hour)); //24 hour
+	Wire.write((t.tm_wday + 1) | 0x08); //Keep VBATEN
+	Wire.write(toBcd(day));
+	Wire.write(toBcd(month));
+	Wire.write(toBcd(year % 100));
+	return Wire.endTransmission();
+}
+
+time_t MCP79412::getTimeUnix()
+{
+	uint8_t regs[7] = {0};
+	if(readRegs(ADR, 0x00, regs, 7) != 0) {
+		error(RTC_READ_FAIL);
+		return 0;
+	}
+	struct tm t = {0};
+	t.tm_sec = fromBcd(regs[0] & 0x7F);
+	t.tm_min = fromBcd(regs[1] & 0x7F);
+	t.tm_hour = fromBcd(regs[2] & 0x3F);
+	t.tm_mday = fromBcd(regs[4] & 0x3F);
+	t.tm_mon = fromBcd(regs[5] & 0x1F) - 1;
+	t.tm_year = fromBcd(regs[6]) + 100;
+	return ::timegm(&t);
+}
+
+int MCP79412::setAlarm(unsigned int seconds, bool alarmNum)
+{
+	time_t target = getTimeUnix() + seconds;
+	struct tm t = {0};
+	gmtime_r(&target, &t);
+	uint8_t base = alarmNum ? 0x11 : 0x0A;
+	Wire.beginTransmission(ADR);
+	Wire.write(base);
+	Wire.write(toBcd(t.tm_sec));
+	Wire.write(toBcd(t.tm_min));
+	Wire.write(toBcd(t.tm_hour));
+	Wire.write(0x70 | (t.tm_wday + 1)); //Full date and time match, clears the flag
+	Wire.write(toBcd(t.tm_mday));
+	Wire.write(toBcd(t.tm_mon + 1));
+	int status = Wire.endTransmission();
+	if(status != 0) return status;
+	return enableAlarm(true, alarmNum);
+}
+
+int MCP79412::enableAlarm(bool state, bool alarmNum)
+{
+	uint8_t bit = alarmNum ? 0x20 : 0x10;
+	uint8_t control = readByte(0x07);
+	return writeByte(0x07, state ? (control | bit) : (control & ~bit));
+}
+
+int MCP79412::setMode(Mode mode)
+{
+	uint8_t wkday = readByte(0x0D);
+	return writeByte(0x0D, mode == Mode::Inverted ? (wkday | 0x80) : (wkday & ~0x80)); //ALMPOL
+}
+
+String MCP79412::getUUIDString()
+{
+	uint8_t id[8] = {0};
+	if(readRegs(EEPROM_ADR, 0xF0, id, 8) != 0) return String("null");
+	char text[17] = {0};
+	for(int i = 0; i < 8; i++) snprintf(&text[2*i], 3, "%02X", id[i]);
+	return String(text);
+}
@@ -0,0 +1,39 @@
+/******************************************************************************
+MCP79412 (host simulation)
+Real time clock library, the parts the Kestrel driver uses
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#ifndef MCP79412_h
+#define MCP79412_h
+
+#include <Particle.h>
+
+class MCP79412
+{
+	public:
+		enum class Mode {Normal, Inverted};
+		static constexpr uint32_t RTC_READ_FAIL = 0x100C00F5;
+		int begin(bool useExtOsc = false); //1 on success, 0 if not found
+		int setTime(int year, int month, int day, int hour, int minute, int second);
+		time_t getTimeUnix();
+		int setAlarm(unsigned int seconds, bool alarmNum = 0); //Alarm seconds from now, full date match
+		int enableAlarm(bool state, bool alarmNum = 0);
+		int setMode(Mode mode);
+		uint8_t readByte(int reg);
+		int writeByte(int reg, uint8_t data);
+		String getUUIDString();
+		uint32_t errors[10] = {0};
+		uint8_t numErrors = 0;
+	private:
+		static constexpr uint8_t ADR = 0x6F;
+		static constexpr uint8_t EEPROM_ADR = 0x57;
+		int readRegs(uint8_t adr, uint8_t reg, uint8_t *vals, uint8_t len);
+		void error(uint32_t code);
+};
+
+#endif
@@ -0,0 +1,127 @@
+/******************************************************************************
+PAC1934 (host simulation)
+Four channel current and power monitor library, the parts the Kestrel driver uses
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#include "PAC1934.h"
+
+PAC1934::PAC1934(float r1, float r2, float r3, float r4, uint8_t address) : adr(address)
+{
+	sense[0] = r1;
+	sense[1] = r2;
+	sense[2] = r3;
+	sense[3] = r4;
+}
+
+int PAC1934::readReg(uint8_t reg)
+{
+	Wire.beginTransmission(adr);
+	Wire.write(reg);
+	if(Wire.endTransmission(false) != 0) return -1;
+	if(Wire.requestFrom(adr, (uint8_t)1) != 1) return -1;
+	return Wire.read();
+}
+
+int PAC1934::writeReg(uint8_t reg, uint8_t val)
+{
+	Wire.beginTransmission(adr);
+	Wire.write(reg);
+	Wire.write(val);
+	return Wire.endTransmission();
+}
+
+int PAC1934::command(uint8_t reg)
+{
+	Wire.beginTransmission(adr);
+	Wire.write(reg);
+	int status = Wire.endTransmission();
+	delay(1); //Registers are valid 1ms after a refresh
+	return status;
+}
+
+bool PAC1934::begin()
+{
+	if(!Wire.isEnabled()) Wire.begin();
+	return readReg(0xFD) == 0x5B;
+}
+
+int PAC1934::setFrequency(Frequency frequency)
+{
+	int ctrl = readReg(0x01);
+	if(ctrl < 0) return -1;
+	int status = writeReg(0x01, (ctrl & 0x3F) | (frequency << 6));
+	return status != 0 ? status : command(0x1F); //Takes effect on refresh, keep the accumulators
+}
+
+int PAC1934::enableChannel(Channel ch, bool state)
+{
+	int val = readReg(0x1C);
+	if(val < 0) return -1;
+	return writeReg(0x1C, state ? (val & ~(0x80 >> ch)) : (val | (0x80 >> ch)));
+}
+
+int PAC1934::setCurrentDirection(Channel ch, Direction dir)
+{
+	int val = readReg(0x1D);
+	if(val < 0) return -1;
+	return writeReg(0x1D, dir == BIDIRECTIONAL ? (val | (0x80 >> ch)) : (val & ~(0x80 >> ch)));
+}
+
+int PAC1934::update(bool clearAccumulators)
+{
+	return command(clearAccumulators ? 0x00 : 0x1F);
+}
+
+bool PAC1934::readBlock(uint8_t reg, uint8_t *data, uint8_t length)
+{
+	Wire.beginTransmission(adr);
+	Wire.write(reg);
+	if(Wire.endTransmission(false) != 0) return false;
+	if(Wire.requestFrom(adr, length) != length) return false;
+	for(int i = 0; i < length; i++) data[i] = Wire.read();
+	return true;
+}
+
+float PAC1934::getBusVoltage(uint8_t unit, bool avg, bool &err)
+{
+	uint8_t data[2] = {0};
+	err = unit > CH4 || update() != 0 || !readBlock((avg ? 0x0F : 0x07) + unit, data, 2);
+	if(err) return 0;
+	return 32.0*((data[0] << 8) | data[1])/65536.0; //32V full scale
+}
+
+float PAC1934::getCurrent(uint8_t unit, bool avg, bool &err)
+{
+	uint8_t data[2] = {0};
+	int negPwr = -1;
+	err = unit > CH4 || update() != 0 || (negPwr = readReg(0x1D)) < 0 || !readBlock((avg ? 0x13 : 0x0B) + unit, data, 2);
+	if(err) return 0;
+	float full = 0.1/(sense[unit]/1000.0); //[A] 100mV full scale
+	uint16_t vsense = (data[0] << 8) | data[1];
+	if(negPwr & (0x80 >> unit)) return full*(int16_t)vsense/32768.0;
+	return full*vsense/65536.0;
+}
+
+float PAC1934::getPowerAvg(uint8_t unit, bool &err)
+{
+	uint8_t count[3] = {0};
+	uint8_t acc[6] = {0};
+	int negPwr = -1;
+	err = unit > CH4 || update() != 0 || (negPwr = readReg(0x1D)) < 0 || !readBlock(0x02, count, 3) || !readBlock(0x03 + unit, acc, 6);
+	if(err) return 0;
+	uint32_t samples = ((uint32_t)count[0] << 16) | ((uint32_t)count[1] << 8) | count[2];
+	if(samples == 0) return 0;
+	uint64_t raw = 0;
+	for(int i = 0; i < 6; i++) raw = (raw << 8) | acc[i];
+	float full = 3.2/(sense[unit]/1000.0); //[W] 32V * 100mV full scale
+	if(negPwr & (0x80 >> unit)) {
+		int64_t signedRaw = (raw & 0x800000000000ULL) ? (int64_t)(raw | 0xFFFF000000000000ULL) : (int64_t)raw;
+		return signedRaw*full/134217728.0/samples; //2^27 bipolar
+	}
+	return raw*full/268435456.0/samples; //2^28 unipolar
+}
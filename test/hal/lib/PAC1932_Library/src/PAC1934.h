@@ -0,0 +1,44 @@
+/******************************************************************************
+PAC1934 (host simulation)
+Four channel current and power monitor library, the parts the Kestrel driver uses
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#ifndef PAC1934_h
+#define PAC1934_h
+
+#include <Particle.h>
+
+enum Channel {CH1 = 0, CH2 = 1, CH3 = 2, CH4 = 3};
+enum Direction {UNIDIRECTIONAL = 0, BIDIRECTIONAL = 1};
+enum Frequency {SPS_1024 = 0, SPS_256 = 1, SPS_64 = 2, SPS_8 = 3}; ///<CTRL bits 7:6
+
+class PAC1934
+{
+	public:
+		PAC1934(float r1, float r2, float r3, float r4, uint8_t address = 0x18);
+		bool begin(); //Probes the product ID
+		void setAddress(uint8_t address) {
+			adr = address;
+		}
+		int setFrequency(Frequency frequency);
+		int enableChannel(Channel ch, bool state);
+		int setCurrentDirection(Channel ch, Direction dir);
+		int update(bool clearAccumulators = false); //REFRESH or REFRESH_V
+		float getBusVoltage(uint8_t unit, bool avg, bool &err); //[V] Refreshes, then reads VBUSn or VBUSn_AVG
+		float getCurrent(uint8_t unit, bool avg, bool &err); //[A] Refreshes, then reads the direction and VSENSEn or VSENSEn_AVG
+		float getPowerAvg(uint8_t unit, bool &err); //[W] Refreshes, then reads the direction, ACC_COUNT and VPOWERn_ACC
+	private:
+		uint8_t adr;
+		float sense[4]; ///<[mOhm]
+		int readReg(uint8_t reg);
+		int writeReg(uint8_t reg, uint8_t val);
+		int command(uint8_t reg);
+		bool readBlock(uint8_t reg, uint8_t *data, uint8_t length);
+};
+
+#endif
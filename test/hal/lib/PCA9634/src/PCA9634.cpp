@@ -0,0 +1,102 @@
+/******************************************************************************
+PCA9634 (host simulation)
+8 channel LED driver library, the parts the Kestrel driver uses
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#include "PCA9634.h"
+
+int PCA9634::readReg(uint8_t reg)
+{
+	Wire.beginTransmission(adr);
+	Wire.write(reg);
+	if(Wire.endTransmission(false) != 0) return -1;
+	if(Wire.requestFrom(adr, (uint8_t)1) != 1) return -1;
+	return Wire.read();
+}
+
+int PCA9634::writeReg(uint8_t reg, uint8_t val)
+{
+	Wire.beginTransmission(adr);
+	Wire.write(reg);
+	Wire.write(val);
+	return Wire.endTransmission();
+}
+
+int PCA9634::begin()
+{
+	return writeReg(0x00, 0x01); //MODE1, oscillator on, respond to all call
+}
+
+int PCA9634::sleep(bool state)
+{
+	int mode = readReg(0x00);
+	if(mode < 0) return -1;
+	return writeReg(0x00, state ? (mode | 0x10) : (mode & ~0x10));
+}
+
+int PCA9634::setOutputMode(OutputMode mode)
+{
+	int val = readReg(0x01);
+	if(val < 0) return -1;
+	return writeReg(0x01, mode == TotemPole ? (val | 0x04) : (val & ~0x04));
+}
+
+int PCA9634::setGroupMode(GroupMode mode)
+{
+	int val = readReg(0x01);
+	if(val < 0) return -1;
+	return writeReg(0x01, mode == Blink ? (val | 0x20) : (val & ~0x20));
+}
+
+int PCA9634::setOutput(int pin, PortState state)
+{
+	if(pin < 0 || pin > 7) return -1;
+	uint8_t reg = 0x0C + pin/4;
+	int val = readReg(reg);
+	if(val < 0) return -1;
+	uint8_t shift = 2*(pin % 4);
+	return writeReg(reg, (val & ~(0x03 << shift)) | (state << shift));
+}
+
+int PCA9634::setOutputArray(PortState state)
+{
+	uint8_t val = state | (state << 2) | (state << 4) | (state << 6);
+	int error = writeReg(0x0C, val);
+	return error != 0 ? error : writeReg(0x0D, val);
+}
+
+int PCA9634::setBrightness(int pin, float brightness)
+{
+	if(pin < 0 || pin > 7) return -1;
+	return writeReg(0x02 + pin, (uint8_t)(brightness*255/100));
+}
+
+int PCA9634::setBrightnessArray(float brightness)
+{
+	for(int i = 0; i < 8; i++) {
+		int error = setBrightness(i, brightness);
+		if(error != 0) return error;
+	}
+	return 0;
+}
+
+int PCA9634::setGroupBrightness(float brightness)
+{
+	return writeReg(0x0A, (uint8_t)(brightness*255/100));
+}
+
+int PCA9634::setGroupBlinkPeriod(uint16_t period)
+{
+	blinkPeriod = period;
+	return writeReg(0x0B, (uint8_t)(period*24/1000 - 1));
+}
+
+int PCA9634::setGroupOnTime(uint16_t onTime)
+{
+	return writeReg(0x0A, (uint8_t)(256UL*onTime/(blinkPeriod > 0 ? blinkPeriod : 1)));
+}
@@ -0,0 +1,42 @@
+/******************************************************************************
+PCA9634 (host simulation)
+8 channel LED driver library, the parts the Kestrel driver uses
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#ifndef PCA9634_h
+#define PCA9634_h
+
+#include <Particle.h>
+
+enum OutputMode {OpenDrain = 0, TotemPole = 1};
+enum GroupMode {Dim = 0, Blink = 1};
+enum PortState {Off = 0, On = 1, PWM = 2, Group = 3};
+
+class PCA9634
+{
+	public:
+		PCA9634(int address = 0x52) : adr(address) {}
+		int begin();
+		int sleep(bool state);
+		int setOutputMode(OutputMode mode);
+		int setGroupMode(GroupMode mode);
+		int setOutput(int pin, PortState state);
+		int setOutputArray(PortState state);
+		int setBrightness(int pin, float brightness); //[%]
+		int setBrightnessArray(float brightness);
+		int setGroupBrightness(float brightness);
+		int setGroupBlinkPeriod(uint16_t period); //[ms]
+		int setGroupOnTime(uint16_t onTime); //[ms]
+	private:
+		uint8_t adr;
+		uint16_t blinkPeriod = 1000;
+		int readReg(uint8_t reg);
+		int writeReg(uint8_t reg, uint8_t val);
+};
+
+#endif
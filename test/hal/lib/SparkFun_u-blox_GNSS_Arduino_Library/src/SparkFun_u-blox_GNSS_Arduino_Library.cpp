@@ -0,0 +1,328 @@
+/******************************************************************************
+SparkFun u-blox GNSS (host simulation)
+UBX over I2C, the parts of the SparkFun library the Kestrel driver uses
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#include "SparkFun_u-blox_GNSS_Arduino_Library.h"
+
+bool SFE_UBLOX_GNSS::begin(TwoWire &wirePort, uint8_t deviceAddress, uint16_t maxWait)
+{
+	port = &wirePort;
+	adr = deviceAddress;
+	return isConnected(maxWait);
+}
+
+bool SFE_UBLOX_GNSS::isConnected(uint16_t maxWait)
+{
+	port->beginTransmission(adr);
+	if(port->endTransmission() != 0) return false;
+	return pollCfg(UBX_CFG_RATE, nullptr, 0, maxWait);
+}
+
+bool SFE_UBLOX_GNSS::setPacketCfgPayloadSize(size_t payloadSize)
+{
+	return payloadSize <= MAX_PAYLOAD_SIZE;
+}
+
+bool SFE_UBLOX_GNSS::writeFrame(ubxPacket *packet)
+{
+	uint8_t frame[MAX_PAYLOAD_SIZE + 8];
+	if(packet->len > MAX_PAYLOAD_SIZE) return false;
+	frame[0] = 0xB5;
+	frame[1] = 0x62;
+	frame[2] = packet->cls;
+	frame[3] = packet->id;
+	frame[4] = packet->len & 0xFF;
+	frame[5] = packet->len >> 8;
+	if(packet->len > 0) memcpy(&frame[6], packet->payload, packet->len);
+	uint8_t a = 0;
+	uint8_t b = 0;
+	for(int i = 2; i < 6 + packet->len; i++) {
+		a += frame[i];
+		b += a;
+	}
+	packet->checksumA = frame[6 + packet->len] = a;
+	packet->checksumB = frame[7 + packet->len] = b;
+	size_t total = packet->len + 8;
+	for(size_t pos = 0; pos < total;) {
+		size_t chunk = total - pos > TwoWire::BUFFER_LENGTH ? TwoWire::BUFFER_LENGTH : total - pos;
+		if(total - pos - chunk == 1) chunk--; //Never leave a lone byte, the receiver takes it as a register address
+		port->beginTransmission(adr);
+		for(size_t i = 0; i < chunk; i++) port->write(frame[pos + i]);
+		if(port->endTransmission() != 0) return false;
+		pos += chunk;
+	}
+	return true;
+}
+
+int SFE_UBLOX_GNSS::checkUblox(ubxPacket *expected, bool &acked, bool &nacked)
+{
+	if(millis() - lastCheck < i2cPollingWait) return 0;
+	port->beginTransmission(adr);
+	port->write(0xFD);
+	if(port->endTransmission(false) != 0) return -1;
+	if(port->requestFrom(adr, (uint8_t)2) != 2) return -1;
+	uint16_t avail = port->read() << 8;
+	avail |= port->read();
+	if(avail == 0) {
+		lastCheck = millis();
+		return 0;
+	}
+	int found = 0;
+	while(avail > 0) {
+		uint8_t chunk = avail > TwoWire::BUFFER_LENGTH ? TwoWire::BUFFER_LENGTH : avail;
+		if(port->requestFrom(adr, chunk) != chunk) return -1;
+		avail -= chunk;
+		for(int i = 0; i < chunk; i++) {
+			uint8_t val = port->read();
+			if(rxLength == 0 && val != 0xB5) continue;
+			if(rxLength == 1 && val != 0x62) {
+				rxLength = 0;
+				continue;
+			}
+			rx[rxLength++] = val;
+			if(rxLength < 8) continue;
+			uint16_t length = rx[4] | (rx[5] << 8);
+			if(length > MAX_PAYLOAD_SIZE) {
+				rxLength = 0;
+				continue;
+			}
+			if(rxLength < length + 8u) continue;
+			rxLength = 0;
+			uint8_t a = 0;
+			uint8_t b = 0;
+			for(int j = 2; j < 6 + length; j++) {
+				a += rx[j];
+				b += a;
+			}
+			if(a != rx[6 + length] || b != rx[7 + length]) continue;
+			if(rx[2] == UBX_CLASS_ACK && length == 2 && rx[6] == expected->cls && rx[7] == expected->id) {
+				if(rx[3] == UBX_ACK_ACK) acked = true;
+				else nacked = true;
+			}
+			else if(rx[2] == expected->cls && rx[3] == expected->id) {
+				if(expected->payload != nullptr) memcpy(expected->payload, &rx[6], length);
+				expected->len = length;
+				expected->valid = SFE_UBLOX_PACKET_VALIDITY_VALID;
+				expected->classAndIDmatch = SFE_UBLOX_PACKET_VALIDITY_VALID;
+				found = 1;
+			}
+		}
+	}
+	return found;
+}
+
+sfe_ublox_status_e SFE_UBLOX_GNSS::sendCommand(ubxPacket *outgoingUBX, uint16_t maxWait, bool expectACKonly)
+{
+	outgoingUBX->valid = SFE_UBLOX_PACKET_VALIDITY_NOT_DEFINED;
+	outgoingUBX->classAndIDmatch = SFE_UBLOX_PACKET_VALIDITY_NOT_DEFINED;
+	if(!writeFrame(outgoingUBX)) return SFE_UBLOX_STATUS_I2C_COMM_FAILURE;
+	if(maxWait == 0) return SFE_UBLOX_STATUS_SUCCESS; //Not waiting for anything
+	bool set = outgoingUBX->cls == UBX_CLASS_CFG && (expectACKonly || outgoingUBX->len > 1); //CFG-PRT polls carry the port
+	bool cfg = outgoingUBX->cls == UBX_CLASS_CFG;
+	bool acked = false;
+	bool nacked = false;
+	bool received = false;
+	unsigned long start = millis();
+	while(millis() - start < maxWait) {
+		int result = checkUblox(outgoingUBX, acked, nacked);
+		if(result < 0) return SFE_UBLOX_STATUS_I2C_COMM_FAILURE;
+		if(result > 0) received = true;
+		if(nacked) return SFE_UBLOX_STATUS_COMMAND_NACK;
+		if(set && acked) return SFE_UBLOX_STATUS_DATA_SENT;
+		if(!set && received && (!cfg || acked)) return SFE_UBLOX_STATUS_DATA_RECEIVED;
+		delay(1);
+	}
+	return SFE_UBLOX_STATUS_TIMEOUT;
+}
+
+bool SFE_UBLOX_GNSS::pollCfg(uint8_t id, const uint8_t *payload, uint16_t length, uint16_t maxWait)
+{
+	uint8_t out[MAX_PAYLOAD_SIZE] = {0};
+	if(length > 0) memcpy(out, payload, length);
+	ubxPacket packet = {UBX_CLASS_CFG, id, length, 0, 0, out, 0, 0, SFE_UBLOX_PACKET_VALIDITY_NOT_DEFINED, SFE_UBLOX_PACKET_VALIDITY_NOT_DEFINED};
+	if(sendCommand(&packet, maxWait) != SFE_UBLOX_STATUS_DATA_RECEIVED) return false;
+	memcpy(cfg, out, packet.len);
+	cfgLength = packet.len;
+	return true;
+}
+
+bool SFE_UBLOX_GNSS::setCfg(uint8_t id, const uint8_t *payload, uint16_t length, uint16_t maxWait)
+{
+	uint8_t out[MAX_PAYLOAD_SIZE] = {0};
+	memcpy(out, payload, length);
+	ubxPacket packet = {UBX_CLASS_CFG, id, length, 0, 0, out, 0, 0, SFE_UBLOX_PACKET_VALIDITY_NOT_DEFINED, SFE_UBLOX_PACKET_VALIDITY_NOT_DEFINED};
+	return sendCommand(&packet, maxWait, true) == SFE_UBLOX_STATUS_DATA_SENT;
+}
+
+bool SFE_UBLOX_GNSS::pollNav(uint8_t id, uint8_t *payload, uint16_t length, uint16_t maxWait)
+{
+	uint8_t in[MAX_PAYLOAD_SIZE] = {0};
+	ubxPacket packet = {UBX_CLASS_NAV, id, 0, 0, 0, in, 0, 0, SFE_UBLOX_PACKET_VALIDITY_NOT_DEFINED, SFE_UBLOX_PACKET_VALIDITY_NOT_DEFINED};
+	if(sendCommand(&packet, maxWait) != SFE_UBLOX_STATUS_DATA_RECEIVED) return false;
+	memcpy(payload, in, packet.len < length ? packet.len : length);
+	return true;
+}
+
+bool SFE_UBLOX_GNSS::setI2COutput(uint8_t comSettings, uint16_t maxWait)
+{
+	uint8_t portID = COM_PORT_I2C;
+	if(!pollCfg(UBX_CFG_PRT, &portID, 1, maxWait)) return false;
+	uint8_t prt[20] = {0};
+	memcpy(prt, cfg, cfgLength < 20 ? cfgLength : 20);
+	prt[0] = COM_PORT_I2C;
+	prt[14] = comSettings; //outProtoMask
+	return setCfg(UBX_CFG_PRT, prt, 20, maxWait);
+}
+
+bool SFE_UBLOX_GNSS::setNavigationFrequency(uint8_t navFreq, uint16_t maxWait)
+{
+	if(navFreq == 0) return false;
+	if(!pollCfg(UBX_CFG_RATE, nullptr, 0, maxWait)) return false;
+	uint8_t rate[6] = {0};
+	memcpy(rate, cfg, cfgLength < 6 ? cfgLength : 6);
+	uint16_t measRate = 1000/navFreq;
+	rate[0] = measRate & 0xFF;
+	rate[1] = measRate >> 8;
+	i2cPollingWait = 1000/(((int)navFreq)*4); //As the library, a quarter of the navigation period
+	return setCfg(UBX_CFG_RATE, rate, 6, maxWait);
+}
+
+uint16_t SFE_UBLOX_GNSS::getMeasurementRate(uint16_t maxWait)
+{
+	if(!pollCfg(UBX_CFG_RATE, nullptr, 0, maxWait)) return 0;
+	return cfg[0] | (cfg[1] << 8);
+}
+
+uint16_t SFE_UBLOX_GNSS::getNavigationRate(uint16_t maxWait)
+{
+	if(!pollCfg(UBX_CFG_RATE, nullptr, 0, maxWait)) return 0;
+	return cfg[2] | (cfg[3] << 8);
+}
+
+uint8_t SFE_UBLOX_GNSS::getNavigationFrequency(uint16_t maxWait)
+{
+	uint16_t measRate = getMeasurementRate(maxWait);
+	return measRate > 0 ? 1000/measRate : 0;
+}
+
+bool SFE_UBLOX_GNSS::setAutoPVT(bool enabled, uint16_t maxWait)
+{
+	uint8_t msg[3] = {UBX_CLASS_NAV, UBX_NAV_PVT, (uint8_t)(enabled ? 1 : 0)};
+	return setCfg(UBX_CFG_MSG, msg, 3, maxWait);
+}
+
+bool SFE_UBLOX_GNSS::powerOffWithInterrupt(uint32_t durationInMs, uint32_t wakeupSources, bool forceWhileUsb, uint16_t maxWait)
+{
+	uint8_t req[16] = {0};
+	for(int i = 0; i < 4; i++) req[4 + i] = (durationInMs >> (8*i)) & 0xFF;
+	req[8] = 0x02 | (forceWhileUsb ? 0x04 : 0); //backup, force
+	for(int i = 0; i < 4; i++) req[12 + i] = (wakeupSources >> (8*i)) & 0xFF;
+	ubxPacket packet = {UBX_CLASS_RXM, UBX_RXM_PMREQ, 16, 0, 0, req, 0, 0, SFE_UBLOX_PACKET_VALIDITY_NOT_DEFINED, SFE_UBLOX_PACKET_VALIDITY_NOT_DEFINED};
+	return sendCommand(&packet, 0) == SFE_UBLOX_STATUS_SUCCESS; //No ACK, the receiver is already going down
+}
+
+bool SFE_UBLOX_GNSS::getPVT(uint16_t maxWait)
+{
+	if(!pollNav(UBX_NAV_PVT, pvt, sizeof(pvt), maxWait)) return false;
+	pvtQueried = 0xFFFFFFFF;
+	return true;
+}
+
+bool SFE_UBLOX_GNSS::queried(int field, uint16_t maxWait)
+{
+	if(!(pvtQueried & (1UL << field)) && !getPVT(maxWait)) return false;
+	pvtQueried &= ~(1UL << field); //Served once, the next call polls again
+	return true;
+}
+
+int32_t SFE_UBLOX_GNSS::pvt32(int offset)
+{
+	return (int32_t)(pvt[offset] | (pvt[offset + 1] << 8) | (pvt[offset + 2] << 16) | ((uint32_t)pvt[offset + 3] << 24));
+}
+
+uint8_t SFE_UBLOX_GNSS::getFixType(uint16_t maxWait)
+{
+	return queried(0, maxWait) ? pvt[20] : 0;
+}
+
+bool SFE_UBLOX_GNSS::getGnssFixOk(uint16_t maxWait)
+{
+	return queried(1, maxWait) ? (pvt[21] & 0x01) : false;
+}
+
+uint8_t SFE_UBLOX_GNSS::getSIV(uint16_t maxWait)
+{
+	return queried(2, maxWait) ? pvt[23] : 0;
+}
+
+int32_t SFE_UBLOX_GNSS::getLongitude(uint16_t maxWait)
+{
+	return queried(3, maxWait) ? pvt32(24) : 0;
+}
+
+int32_t SFE_UBLOX_GNSS::getLatitude(uint16_t maxWait)
+{
+	return queried(4, maxWait) ? pvt32(28) : 0;
+}
+
+int32_t SFE_UBLOX_GNSS::getAltitude(uint16_t maxWait)
+{
+	return queried(5, maxWait) ? pvt32(32) : 0;
+}
+
+bool SFE_UBLOX_GNSS::getDateValid(uint16_t maxWait)
+{
+	return queried(6, maxWait) ? (pvt[11] & 0x01) : false;
+}
+
+bool SFE_UBLOX_GNSS::getTimeValid(uint16_t maxWait)
+{
+	return queried(7, maxWait) ? (pvt[11] & 0x02) : false;
+}
+
+bool SFE_UBLOX_GNSS::getTimeFullyResolved(uint16_t maxWait)
+{
+	return queried(8, maxWait) ? (pvt[11] & 0x04) : false;
+}
+
+uint8_t SFE_UBLOX_GNSS::getHour(uint16_t maxWait)
+{
+	return queried(9, maxWait) ? pvt[8] : 0;
+}
+
+uint8_t SFE_UBLOX_GNSS::getMinute(uint16_t maxWait)
+{
+	return queried(10, maxWait) ? pvt[9] : 0;
+}
+
+uint8_t SFE_UBLOX_GNSS::getSecond(uint16_t maxWait)
+{
+	return queried(11, maxWait) ? pvt[10] : 0;
+}
+
+int32_t SFE_UBLOX_GNSS::getATTroll(uint16_t maxWait)
+{
+	uint8_t att[32] = {0};
+	if(!pollNav(UBX_NAV_ATT, att, sizeof(att), maxWait)) return 0;
+	return (int32_t)(att[8] | (att[9] << 8) | (att[10] << 16) | ((uint32_t)att[11] << 24));
+}
+
+int32_t SFE_UBLOX_GNSS::getATTpitch(uint16_t maxWait)
+{
+	uint8_t att[32] = {0};
+	if(!pollNav(UBX_NAV_ATT, att, sizeof(att), maxWait)) return 0;
+	return (int32_t)(att[12] | (att[13] << 8) | (att[14] << 16) | ((uint32_t)att[15] << 24));
+}
+
+int32_t SFE_UBLOX_GNSS::getATTheading(uint16_t maxWait)
+{
+	uint8_t att[32] = {0};
+	if(!pollNav(UBX_NAV_ATT, att, sizeof(att), maxWait)) return 0;
+	return (int32_t)(att[16] | (att[17] << 8) | (att[18] << 16) | ((uint32_t)att[19] << 24));
+}
@@ -0,0 +1,133 @@
+/******************************************************************************
+SparkFun u-blox GNSS (host simulation)
+UBX over I2C, the parts of the SparkFun library the Kestrel driver uses
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Keeps the library's I2C behaviour that costs time on the real board: frames are
+written in 32 byte chunks, the 0xFD/0xFE count is polled no faster than
+i2cPollingWait (100ms, or a quarter of the navigation period once
+setNavigationFrequency is called), and every poll waits up to maxWait.
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#ifndef SPARKFUN_UBLOX_GNSS_ARDUINO_LIBRARY_H
+#define SPARKFUN_UBLOX_GNSS_ARDUINO_LIBRARY_H
+
+#include <Particle.h>
+
+#define MAX_PAYLOAD_SIZE 256
+
+const uint8_t UBX_CLASS_NAV = 0x01;
+const uint8_t UBX_CLASS_RXM = 0x02;
+const uint8_t UBX_CLASS_ACK = 0x05;
+const uint8_t UBX_CLASS_CFG = 0x06;
+const uint8_t UBX_NAV_STATUS = 0x03;
+const uint8_t UBX_NAV_ATT = 0x05;
+const uint8_t UBX_NAV_PVT = 0x07;
+const uint8_t UBX_NAV_TIMEUTC = 0x21;
+const uint8_t UBX_RXM_PMREQ = 0x41;
+const uint8_t UBX_ACK_NACK = 0x00;
+const uint8_t UBX_ACK_ACK = 0x01;
+const uint8_t UBX_CFG_PRT = 0x00;
+const uint8_t UBX_CFG_MSG = 0x01;
+const uint8_t UBX_CFG_RATE = 0x08;
+const uint8_t COM_PORT_I2C = 0;
+const uint8_t COM_TYPE_UBX = (1 << 0);
+const uint8_t COM_TYPE_NMEA = (1 << 1);
+const uint32_t VAL_RXM_PMREQ_WAKEUPSOURCE_EXTINT0 = 0x00000020;
+const uint16_t defaultMaxWait = 1100;
+
+typedef enum
+{
+	SFE_UBLOX_STATUS_SUCCESS,
+	SFE_UBLOX_STATUS_FAIL,
+	SFE_UBLOX_STATUS_CRC_FAIL,
+	SFE_UBLOX_STATUS_TIMEOUT,
+	SFE_UBLOX_STATUS_COMMAND_NACK,
+	SFE_UBLOX_STATUS_OUT_OF_RANGE,
+	SFE_UBLOX_STATUS_INVALID_ARG,
+	SFE_UBLOX_STATUS_INVALID_OPERATION,
+	SFE_UBLOX_STATUS_MEM_ERR,
+	SFE_UBLOX_STATUS_HW_ERR,
+	SFE_UBLOX_STATUS_DATA_SENT,
+	SFE_UBLOX_STATUS_DATA_RECEIVED,
+	SFE_UBLOX_STATUS_I2C_COMM_FAILURE,
+	SFE_UBLOX_STATUS_DATA_OVERWRITTEN
+} sfe_ublox_status_e;
+
+typedef enum
+{
+	SFE_UBLOX_PACKET_VALIDITY_NOT_VALID,
+	SFE_UBLOX_PACKET_VALIDITY_VALID,
+	SFE_UBLOX_PACKET_VALIDITY_NOT_DEFINED,
+	SFE_UBLOX_PACKET_NOTACKNOWLEDGED
+} sfe_ublox_packet_validity_e;
+
+typedef struct
+{
+	uint8_t cls;
+	uint8_t id;
+	uint16_t len;
+	uint16_t counter;
+	uint16_t startingSpot;
+	uint8_t *payload;
+	uint8_t checksumA;
+	uint8_t checksumB;
+	sfe_ublox_packet_validity_e valid;
+	sfe_ublox_packet_validity_e classAndIDmatch;
+} ubxPacket;
+
+class SFE_UBLOX_GNSS
+{
+	public:
+		bool begin(TwoWire &wirePort = Wire, uint8_t deviceAddress = 0x42, uint16_t maxWait = defaultMaxWait);
+		bool isConnected(uint16_t maxWait = defaultMaxWait);
+		bool setPacketCfgPayloadSize(size_t payloadSize);
+		sfe_ublox_status_e sendCommand(ubxPacket *outgoingUBX, uint16_t maxWait = defaultMaxWait, bool expectACKonly = false);
+		bool setI2COutput(uint8_t comSettings, uint16_t maxWait = defaultMaxWait);
+		bool setNavigationFrequency(uint8_t navFreq, uint16_t maxWait = defaultMaxWait);
+		uint8_t getNavigationFrequency(uint16_t maxWait = defaultMaxWait);
+		uint16_t getMeasurementRate(uint16_t maxWait = defaultMaxWait);
+		uint16_t getNavigationRate(uint16_t maxWait = defaultMaxWait);
+		bool setAutoPVT(bool enabled, uint16_t maxWait = defaultMaxWait);
+		bool powerOffWithInterrupt(uint32_t durationInMs, uint32_t wakeupSources = VAL_RXM_PMREQ_WAKEUPSOURCE_EXTINT0, bool forceWhileUsb = true, uint16_t maxWait = defaultMaxWait);
+		bool getPVT(uint16_t maxWait = defaultMaxWait);
+		uint8_t getFixType(uint16_t maxWait = defaultMaxWait);
+		bool getGnssFixOk(uint16_t maxWait = defaultMaxWait);
+		uint8_t getSIV(uint16_t maxWait = defaultMaxWait);
+		int32_t getLatitude(uint16_t maxWait = defaultMaxWait);
+		int32_t getLongitude(uint16_t maxWait = defaultMaxWait);
+		int32_t getAltitude(uint16_t maxWait = defaultMaxWait);
+		bool getTimeValid(uint16_t maxWait = defaultMaxWait);
+		bool getDateValid(uint16_t maxWait = defaultMaxWait);
+		bool getTimeFullyResolved(uint16_t maxWait = defaultMaxWait);
+		uint8_t getHour(uint16_t maxWait = defaultMaxWait);
+		uint8_t getMinute(uint16_t maxWait = defaultMaxWait);
+		uint8_t getSecond(uint16_t maxWait = defaultMaxWait);
+		int32_t getATTroll(uint16_t maxWait = defaultMaxWait);
+		int32_t getATTpitch(uint16_t maxWait = defaultMaxWait);
+		int32_t getATTheading(uint16_t maxWait = defaultMaxWait);
+		uint8_t i2cPollingWait = 100; ///<[ms] Minimum time between checks of the 0xFD/0xFE count
+	private:
+		TwoWire *port = &Wire;
+		uint8_t adr = 0x42;
+		unsigned long lastCheck = 0;
+		uint8_t rx[MAX_PAYLOAD_SIZE + 8] = {0}; ///<Frame being assembled
+		size_t rxLength = 0;
+		uint8_t pvt[92] = {0};
+		uint32_t pvtQueried = 0; ///<One bit per field, cleared as each getter serves it
+		uint8_t cfg[MAX_PAYLOAD_SIZE] = {0};
+		uint16_t cfgLength = 0;
+		bool pollCfg(uint8_t id, const uint8_t *payload, uint16_t length, uint16_t maxWait); //Fills cfg
+		bool setCfg(uint8_t id, const uint8_t *payload, uint16_t length, uint16_t maxWait);
+		bool pollNav(uint8_t id, uint8_t *payload, uint16_t length, uint16_t maxWait);
+		bool queried(int field, uint16_t maxWait);
+		int32_t pvt32(int offset);
+		bool writeFrame(ubxPacket *packet);
+		int checkUblox(ubxPacket *expected, bool &acked, bool &nacked); //Frames for expected copied in, 1 when it arrived
+};
+
+#endif
@@ -0,0 +1,99 @@
+/******************************************************************************
+VEML3328 (host simulation)
+RGB, clear and IR light sensor library, the parts the Kestrel driver uses
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#include "VEML3328.h"
+
+static const uint16_t RANGES[] = { //Least to most sensitive: IT bits 5:4, gain 11:10, digital gain 13:12
+	0x0C00, //50ms, x1/2
+	0x0000, //50ms, x1
+	0x0010, //100ms
+	0x0020, //200ms
+	0x0030, //400ms
+	0x0430, //400ms, x2
+	0x0830, //400ms, x4
+	0x1830, //400ms, x4, DG x2
+	0x2830 //400ms, x4, DG x4
+};
+static constexpr uint16_t SATURATED = 0xF000;
+
+int VEML3328::writeConfig(uint16_t val)
+{
+	Wire.beginTransmission(ADR);
+	Wire.write(0x00);
+	Wire.write(val & 0xFF);
+	Wire.write(val >> 8);
+	int status = Wire.endTransmission();
+	if(status == 0) config = val;
+	return status;
+}
+
+int VEML3328::readChannel(uint8_t reg, uint16_t &val)
+{
+	Wire.beginTransmission(ADR);
+	Wire.write(reg);
+	int status = Wire.endTransmission(false);
+	if(status != 0) return status;
+	if(Wire.requestFrom(ADR, (uint8_t)2) != 2) return 4;
+	val = Wire.read();
+	val = val | (Wire.read() << 8);
+	return 0;
+}
+
+unsigned long VEML3328::integrationTime()
+{
+	const unsigned long it[4] = {50, 100, 200, 400};
+	return it[(config >> 4) & 0x03];
+}
+
+float VEML3328::sensitivity()
+{
+	const float it[4] = {1, 2, 4, 8};
+	const float gain[4] = {1, 2, 4, 0.5};
+	const float dg[4] = {1, 2, 4, 4};
+	return it[(config >> 4) & 0x03]*gain[(config >> 10) & 0x03]*dg[(config >> 12) & 0x03];
+}
+
+int VEML3328::begin()
+{
+	if(!Wire.isEnabled()) Wire.begin();
+	return writeConfig(RANGES[1]); //Power on, 50ms, x1
+}
+
+int VEML3328::AutoRange()
+{
+	uint16_t best = RANGES[0];
+	for(size_t i = 0; i < sizeof(RANGES)/sizeof(RANGES[0]); i++) {
+		int status = writeConfig(RANGES[i]);
+		if(status != 0) return status;
+		delay(integrationTime() + 10); //First conversion at the new setting
+		uint16_t clear = 0;
+		status = readChannel(0x04, clear);
+		if(status != 0) return status;
+		if(clear >= SATURATED) break; //More sensitive only saturates further
+		best = RANGES[i];
+	}
+	int status = writeConfig(best);
+	if(status == 0) delay(integrationTime() + 10);
+	return status;
+}
+
+float VEML3328::GetValue(Channel channel, bool &state)
+{
+	uint16_t val = 0;
+	state = (readChannel(0x04 + static_cast<uint8_t>(channel), val) != 0);
+	return state ? 0 : val/sensitivity();
+}
+
+float VEML3328::GetLux()
+{
+	bool state = false;
+	float green = GetValue(Channel::Green, state);
+	return state ? 0 : green*2.0; //0.5 counts per lux at the least sensitive x1 setting
+}
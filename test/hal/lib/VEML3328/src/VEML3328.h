@@ -0,0 +1,33 @@
+/******************************************************************************
+VEML3328 (host simulation)
+RGB, clear and IR light sensor library, the parts the Kestrel driver uses
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#ifndef VEML3328_h
+#define VEML3328_h
+
+#include <Particle.h>
+
+class VEML3328
+{
+	public:
+		enum class Channel {Clear = 0, Red = 1, Green = 2, Blue = 3, IR = 4};
+		int begin(); //0 on success, else Wire error
+		int AutoRange(); //Walk from least to most sensitive setting, keep the last one not saturated
+		float GetValue(Channel channel, bool &state); //State set on read error
+		float GetLux();
+	private:
+		static constexpr uint8_t ADR = 0x10;
+		uint16_t config = 0x0000;
+		int writeConfig(uint16_t val);
+		int readChannel(uint8_t reg, uint16_t &val);
+		float sensitivity(); //Counts per unit at the current setting, relative to the least sensitive step
+		unsigned long integrationTime(); //[ms]
+};
+
+#endif
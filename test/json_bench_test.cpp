@@ -0,0 +1,151 @@
+/******************************************************************************
+json_bench_test
+JsonWriter against the String concatenation it replaced, and report overflow
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#include <Kestrel.h>
+#include <Sim.h>
+#include <chrono>
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+#include "Check.h"
+
+static unsigned long allocations = 0;
+
+void* operator new(size_t size)
+{
+	allocations++;
+	void *ptr = malloc(size > 0 ? size : 1);
+	if(ptr == nullptr) throw std::bad_alloc();
+	return ptr;
+}
+
+void operator delete(void *ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete(void *ptr, size_t size) noexcept
+{
+	free(ptr);
+}
+
+static const uint32_t codes[] = {0x100500F6, 0x20010000, 0xF00A0001, 0x500200F4, 0x10050000, 0x80020100};
+static const float temps[] = {22.41, -3.5, 101.27, 0.04};
+static const unsigned long counts[] = {1, 17, 3, 65535, 2, 9};
+
+static String concatReport()
+{
+	//Same shape as the baseline getErrors and selfDiagnostic builders
+	String output = "\"KESTREL\":{";
+	output = output + "\"CODES\":[";
+	for(size_t i = 0; i < sizeof(codes)/sizeof(codes[0]); i++) output = output + "\"0x" + String(codes[i], HEX) + "\",";
+	if(output.substring(output.length() - 1).equals(",")) output = output.substring(0, output.length() - 1);
+	output = output + "],";
+	output = output + "\"CNT\":[";
+	for(size_t i = 0; i < sizeof(counts)/sizeof(counts[0]); i++) output = output + String(counts[i]) + ",";
+	if(output.substring(output.length() - 1).equals(",")) output = output.substring(0, output.length() - 1);
+	output = output + "],";
+	output = output + "\"Temperature\":[";
+	for(size_t i = 0; i < sizeof(temps)/sizeof(temps[0]); i++) output = output + String(temps[i]) + ",";
+	if(output.substring(output.length() - 1).equals(",")) output = output.substring(0, output.length() - 1);
+	output = output + "],";
+	output = output + "\"OW\":0,";
+	output = output + "\"NUM\":" + String(98);
+	output = output + "}";
+	return output;
+}
+
+static size_t writerReport(char *buffer, size_t size)
+{
+	JsonWriter json(buffer, size);
+	json.beginObject("KESTREL");
+	json.beginArray("CODES");
+	for(size_t i = 0; i < sizeof(codes)/sizeof(codes[0]); i++) json.hex(codes[i]);
+	json.endArray();
+	json.beginArray("CNT");
+	for(size_t i = 0; i < sizeof(counts)/sizeof(counts[0]); i++) json.value(counts[i]);
+	json.endArray();
+	json.beginArray("Temperature");
+	for(size_t i = 0; i < sizeof(temps)/sizeof(temps[0]); i++) json.value(temps[i]);
+	json.endArray();
+	json.key("OW").value(false);
+	json.key("NUM").value(98);
+	json.endObject();
+	return json.overflow() ? 0 : json.length();
+}
+
+int main()
+{
+	//Finite values come out byte for byte the same as String concatenation
+	char buffer[512];
+	String expected = concatReport();
+	CHECK(writerReport(buffer, sizeof(buffer)) == expected.length());
+	CHECK(strcmp(buffer, expected.c_str()) == 0);
+
+	//Non-finite floats are the one deliberate difference, String wrote nan which no JSON parser accepts
+	{
+		JsonWriter json(buffer, sizeof(buffer));
+		json.beginArray();
+		json.value(NAN).value(INFINITY).value(1.5f);
+		json.endArray();
+		CHECK(strcmp(buffer, "[null,null,1.50]") == 0);
+	}
+
+	const int runs = 20000;
+	unsigned long before = allocations;
+	auto start = std::chrono::steady_clock::now();
+	size_t total = 0;
+	for(int i = 0; i < runs; i++) total += concatReport().length();
+	auto mid = std::chrono::steady_clock::now();
+	unsigned long concatAllocations = allocations - before;
+	before = allocations;
+	for(int i = 0; i < runs; i++) total += writerReport(buffer, sizeof(buffer));
+	auto end = std::chrono::steady_clock::now();
+	unsigned long writerAllocations = allocations - before;
+	double concatNs = std::chrono::duration<double, std::nano>(mid - start).count()/runs;
+	double writerNs = std::chrono::duration<double, std::nano>(end - mid).count()/runs;
+	printf("String: %.0f ns, %lu allocations per report\n", concatNs, concatAllocations/runs);
+	printf("JsonWriter: %.0f ns, %lu allocations per report\n", writerNs, writerAllocations/runs);
+	CHECK(total == 2*runs*expected.length());
+	CHECK(writerAllocations == 0);
+	CHECK(concatAllocations > 0);
+
+	//A report that does not fit is never handed out half written, it is dropped and the overflow logged
+	Sim::reset();
+	Kestrel logger(true);
+	bool criticalFault = false;
+	bool fault = false;
+	logger.begin(Time.now(), criticalFault, fault);
+	logger.getErrors(buffer, sizeof(buffer)); //Start from an empty log
+	char small[32];
+	CHECK(logger.getMetadata(small, sizeof(small)) == 0);
+	CHECK(small[0] == '\0');
+	CHECK(logger.getErrors(buffer, sizeof(buffer)) > 0);
+	CHECK(strstr(buffer, "\"0xf00d0300\"") != nullptr);
+
+	//Errors that do not fit are split, the oldest go now and the rest stay logged for the next report
+	for(uint32_t i = 0; i < 10; i++) logger.throwError(0x10000000 | i);
+	char part[160];
+	size_t length = logger.getErrors(part, sizeof(part));
+	CHECK(length > 0);
+	CHECK(strstr(part, "\"0x10000000\"") != nullptr);
+	CHECK(strstr(part, "\"0x10000009\"") == nullptr);
+	int reports = 1;
+	bool last = false;
+	while(logger.totalErrors() > 0 && reports < 10) {
+		CHECK(logger.getErrors(part, sizeof(part)) > 0);
+		reports++;
+		if(strstr(part, "\"0x10000009\"") != nullptr) last = true;
+	}
+	CHECK(last);
+	CHECK(reports > 1);
+	CHECK(logger.totalErrors() == 0);
+	return checkResult("json_bench_test");
+}
@@ -0,0 +1,56 @@
+/******************************************************************************
+profile_test
+Operation profiles of the Kestrel driver against the simulated board
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#include <Kestrel.h>
+#include <Sim.h>
+#include "Check.h"
+
+int main()
+{
+	Sim::reset();
+	Kestrel logger(true);
+	bool criticalFault = false;
+	bool fault = false;
+
+	uint64_t start = Sim::now();
+	unsigned long startBus = Sim::bus.transactions;
+	logger.begin(Time.now(), criticalFault, fault);
+	const OperationProfile &begin = logger.getProfile(ProfileOp::BEGIN);
+	CHECK(begin.calls == 1);
+	CHECK_NEAR(begin.lastDuration, (Sim::now() - start)/1000.0, 1);
+	CHECK(begin.lastBusOps > 0);
+	CHECK(begin.lastBusOps < Sim::bus.transactions - startBus); //Driver side count is a subset of the real bus traffic
+	CHECK(logger.getProfile(ProfileOp::SYNC_TIME).calls == 1);
+
+	//Out of range operations must not alias a real one
+	CHECK(logger.getProfile(ProfileOp::COUNT).calls == 0);
+	CHECK(logger.getProfile(255).calls == 0);
+	CHECK(&logger.getProfile(ProfileOp::COUNT) != &logger.getProfile(ProfileOp::BEGIN));
+
+	//Sleep profile is the work around System.sleep, not the time asleep
+	logger.powerSaveMode = PowerSaveModes::BALANCED;
+	start = Sim::now();
+	uint64_t asleep = Sim::particle.asleep;
+	logger.sleep();
+	uint64_t slept = Sim::particle.asleep - asleep;
+	const OperationProfile &sleep = logger.getProfile(ProfileOp::SLEEP);
+	CHECK(Sim::particle.sleeps == 1);
+	CHECK(slept >= 60000000ULL);
+	CHECK(sleep.calls == 1);
+	CHECK(sleep.lastDuration < slept/1000);
+	CHECK_NEAR(sleep.lastDuration, (Sim::now() - start - slept)/1000.0, 2);
+	CHECK(sleep.maxDuration == sleep.lastDuration);
+
+	logger.wake();
+	CHECK(logger.getProfile(ProfileOp::WAKE).calls == 1);
+	logger.selfDiagnostic(2, Time.now());
+	CHECK(logger.getProfile(ProfileOp::DIAGNOSTIC).calls == 1);
+	return checkResult("profile_test");
+}
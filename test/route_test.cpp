@@ -0,0 +1,69 @@
+/******************************************************************************
+route_test
+I2C routing pin writes made by the Kestrel driver against the simulated board
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#include <Kestrel.h>
+#include <Sim.h>
+#include "Check.h"
+
+static unsigned long pinWrites()
+{
+	return Sim::pins.writes[Pins::I2C_OB_EN] + Sim::pins.writes[Pins::I2C_GLOBAL_EN];
+}
+
+static void checkOperation(Kestrel &logger, const char *name, unsigned long maxWrites, void (*operation)(Kestrel &))
+{
+	//Every pin write the HAL sees is one the driver counted, and routing is back where it started
+	unsigned long pins = pinWrites();
+	unsigned long writes = logger.i2cRouteWrites();
+	int ob = digitalRead(Pins::I2C_OB_EN);
+	int global = digitalRead(Pins::I2C_GLOBAL_EN);
+	operation(logger);
+	printf("%s: %lu routing pin writes, %lu skipped\n", name, pinWrites() - pins, logger.i2cRouteWritesSaved());
+	CHECK(pinWrites() - pins == logger.i2cRouteWrites() - writes);
+	CHECK(pinWrites() - pins <= maxWrites);
+	CHECK(digitalRead(Pins::I2C_OB_EN) == ob);
+	CHECK(digitalRead(Pins::I2C_GLOBAL_EN) == global);
+}
+
+int main()
+{
+	Sim::reset();
+	Kestrel logger(true);
+	bool criticalFault = false;
+	bool fault = false;
+	logger.begin(Time.now(), criticalFault, fault);
+	CHECK(pinWrites() == logger.i2cRouteWrites());
+	CHECK(pinWrites() <= 4); //Out to the internal bus and back once, however many guards begin() nests
+
+	checkOperation(logger, "getData", 4, [](Kestrel &k) {k.getData(Time.now());});
+	checkOperation(logger, "selfDiagnostic", 4, [](Kestrel &k) {k.selfDiagnostic(2, Time.now());});
+	checkOperation(logger, "getMetadata", 4, [](Kestrel &k) {k.getMetadata();});
+
+	{ //Nested guard asking for the routing already in place writes nothing, and counts each skipped setup and restore once
+		I2CRoute outer(logger);
+		unsigned long pins = pinWrites();
+		unsigned long saved = logger.i2cRouteWritesSaved();
+		{
+			I2CRoute inner(logger);
+			CHECK(digitalRead(Pins::I2C_OB_EN) == HIGH);
+			CHECK(digitalRead(Pins::I2C_GLOBAL_EN) == LOW);
+		}
+		CHECK(pinWrites() == pins);
+		CHECK(logger.i2cRouteWritesSaved() - saved == 4);
+		{ //Nested guard asking for something different restores the outer routing, not the original
+			I2CRoute inner(logger, false, true);
+			CHECK(digitalRead(Pins::I2C_GLOBAL_EN) == HIGH);
+		}
+		CHECK(digitalRead(Pins::I2C_OB_EN) == HIGH);
+		CHECK(digitalRead(Pins::I2C_GLOBAL_EN) == LOW);
+		CHECK(pinWrites() - pins == 4);
+	}
+	return checkResult("route_test");
+}
@@ -0,0 +1,47 @@
+/******************************************************************************
+trim_test
+MCP79412 trim calibration against GPS, across the RTC sets the sync makes
+Bobby Schulz @ GEMS Sensing
+https://github.com/gemsiot/Driver_-_Kestrel
+
+Distributed as-is; no warranty is given.
+© 2023 Regents of the University of Minnesota. All rights reserved.
+******************************************************************************/
+
+#include <Kestrel.h>
+#include <Sim.h>
+#include <math.h>
+#include "Check.h"
+
+static const double TRIM_STEP = 1.017; ///<[ppm] One OSCTRIM step
+
+static void run(double crystalPpm, double days)
+{
+	Sim::reset();
+	Kestrel logger(true);
+	bool criticalFault = false;
+	bool fault = false;
+	logger.begin(Time.now(), criticalFault, fault);
+	Sim::board.rtc.setDrift(crystalPpm);
+	unsigned long setsAtStart = Sim::board.rtc.sets;
+	bool overshoot = false;
+	while(Sim::now() < days*86400e6) {
+		delay(logger.getSyncInterval()*1000UL);
+		logger.syncTime();
+		double net = crystalPpm + Sim::board.rtc.trimPpm();
+		if(net*crystalPpm < 0 && fabs(net) > TRIM_STEP) overshoot = true; //Only ever trimmed by what the window resolved
+	}
+	double net = crystalPpm + Sim::board.rtc.trimPpm();
+	printf("Crystal %+.0fppm: net %+.1fppm after %.0f days, %lu RTC sets\n", crystalPpm, net, days, Sim::board.rtc.sets - setsAtStart);
+	CHECK(Sim::board.rtc.sets - setsAtStart >= 2); //Windows had sets carried across them
+	CHECK(Sim::board.rtc.trimWrites > 0);
+	CHECK(fabs(net) < fabs(crystalPpm)/2);
+	CHECK(!overshoot);
+}
+
+int main()
+{
+	run(40, 14);
+	run(-90, 14);
+	return checkResult("trim_test");
+}